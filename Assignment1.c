@@ -1,691 +1,8743 @@
+#define _GNU_SOURCE // used for sync_file_range
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h> // used to format event descriptions
+#include <stddef.h> // used for offsetof in the collector table
+#include <time.h> // used for CLOCK_MONOTONIC stage timestamps
 
 #include <unistd.h> //used for usleep
 #include <ctype.h> //used for detecting space between strings
 #include <sys/resource.h> // used for cpu utilization calculations
 #include <sys/sysinfo.h> // used to retrieve system memory details
+#include <sys/mman.h> // used to reserve the memory arenas
+#include <fcntl.h> // used to keep /proc files open between samples
+#include <sys/stat.h> // used to find the owner of a process
+#include <sys/syscall.h> // used to list /proc with getdents64 without allocating
+#include <sys/time.h>
+#include <sys/wait.h> // used to reap a wrapped command
+#include <sys/prctl.h> // used to adopt orphaned descendants of a wrapped command
+#include <sys/socket.h> // used for the --control socket
+#include <sys/un.h>
+#include <netinet/in.h> // used for the --web server
+#include <arpa/inet.h>
+#include <signal.h>
+#include <fnmatch.h> // used to match --pid name patterns against process names
+#include <dirent.h> // used for the DT_DIR type of getdents64 records
+#include <poll.h> // used to wait for markers between samples
+#include <errno.h> // used to tell a full socket from a closed one
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // used by the SSE2 and AVX2 history reduction kernels
+#endif
+
+/*
+ * Compile-time collector and renderer selection.
+ * 
+ * Each collector and renderer is compiled in only when its SYSMON_WITH_* macro 
+ * is non-zero, and only compiled-in entries appear in the registration tables 
+ * that drive flag parsing, sampling and drawing. A CPU-only headless build is:
+ * 
+ *      gcc -DSYSMON_WITH_MEMORY=0 -DSYSMON_WITH_CORES=0 -DSYSMON_WITH_PROCS=0 \
+ *          -DSYSMON_WITH_CGROUPS=0 -DSYSMON_WITH_DISKS=0 -DSYSMON_WITH_TERMINAL=0 ...
+ */
+#ifndef SYSMON_WITH_MEMORY
+#define SYSMON_WITH_MEMORY 1
+#endif
+#ifndef SYSMON_WITH_CPU
+#define SYSMON_WITH_CPU 1
+#endif
+#ifndef SYSMON_WITH_CORES
+#define SYSMON_WITH_CORES 1
+#endif
+#ifndef SYSMON_WITH_PROCS
+#define SYSMON_WITH_PROCS 1
+#endif
+#ifndef SYSMON_WITH_CGROUPS
+#define SYSMON_WITH_CGROUPS 1
+#endif
+#ifndef SYSMON_WITH_DISKS
+#define SYSMON_WITH_DISKS 1
+#endif
+#ifndef SYSMON_WITH_TERMINAL
+#define SYSMON_WITH_TERMINAL 1
+#endif
+#ifndef SYSMON_WITH_HEADLESS
+#define SYSMON_WITH_HEADLESS 1
+#endif
+
+#if !SYSMON_WITH_MEMORY && !SYSMON_WITH_CPU && !SYSMON_WITH_CORES && !SYSMON_WITH_PROCS && !SYSMON_WITH_CGROUPS && \
+    !SYSMON_WITH_DISKS
+#error "at least one collector must be compiled in"
+#endif
+#if !SYSMON_WITH_TERMINAL && !SYSMON_WITH_HEADLESS
+#error "at least one renderer must be compiled in"
+#endif
+
+typedef struct
+{
+    unsigned char *base;
+    size_t size; // bytes reserved at startup; the arena never grows past this
+    size_t used;
+    size_t peak;
+} Arena;
+
+#define RUN_ARENA_SIZE (64UL << 20) // address space only; --max-rss decides how much of it may be used
+#define SCRATCH_ARENA_SIZE (256UL << 10)
+#define STDOUT_BUFFER_SIZE (64UL << 10)
+#define PROC_READ_SIZE 4096
+
+static Arena run_arena;     // per-run state: arguments, trace ring, output buffer
+static Arena scratch_arena; // per-tick parsing buffers, reset at the start of every tick
+
+typedef struct
+{
+    const char *path;
+    int fd; // kept open for the whole run and re-read with pread()
+} ProcFile;
+
+typedef struct
+{
+    size_t budget; // --max-rss in bytes, 0 when unbounded
+    size_t baseline; // resident set before any per-run state is allocated
+    size_t history_capacity; // samples kept per series
+    size_t trace_capacity; // events kept in the trace ring
+    size_t process_capacity; // processes tracked by the process table, 0 when it is disabled
+    size_t cgroup_capacity; // nodes of the cgroup tree, 0 when it is disabled
+    size_t output_size; // stdout buffer
+    size_t flight_ticks; // ticks kept by the --flight ring, 0 without it
+    size_t scratch_size; // per-tick scratch arena
+    size_t run_size; // everything the run arena may hand out
+} MemoryPlan;
+
+#define MAX_TARGETS 8
+#define MAX_SELECTED_CGROUPS 4
+#define MAX_DISKS 8
 
 typedef struct
 {
     bool memory_flag;
+    bool overview_flag;
+    bool writeback_flag;
     bool cpu_flag;
     bool cores_flag;
+    bool cstates_flag;
+    bool procs_flag;
+    bool procs_view; // show the process table panel (the table can also be enabled just to track targets)
+    bool cgroups_flag;
+    bool throttle_flag;
+    bool memcg_flag;
+    bool disks_flag;
+    char *disk_names[MAX_DISKS]; // --disks=NAME,...: block devices to watch, all when empty
+    int disk_name_count;
+    char *cgroup_paths[MAX_SELECTED_CGROUPS]; // --cgroup=PATH,...: cgroups watched instead of our own
+    int cgroup_path_count;
+    int cgroup_depth; // deepest cgroup level shown expanded in the tree
+    int group_by; // GROUP_NONE, GROUP_USER or GROUP_CGROUP
+    int sort_key; // SORT_CPU, SORT_RSS or SORT_IO
+    int top; // rows shown in the process table
     int samples;
     unsigned long tdelay;
     bool updated_sample;
     bool updated_tdelay;
+    char **command; // `-- command args`: run and measure this command, NULL when absent
+    char *target_specs[MAX_TARGETS]; // --pid=A,B,C: pids or process name patterns
+    int target_spec_count;
+    char *trace_file;
+    char *flight_file;
+    char *markers_path;
+    char *record_file;
+    char *control_path;
+    char *web_address; // host:port of the --web dashboard
+    char *export_trace_file; // --export-trace: samples streamed as Chrome trace counters
+    char *gate_rules; // --gate rules, or @FILE holding them
+    int trigger_metric; // index into capture_metrics, -1 without --trigger
+    bool trigger_above; // fire when the metric is above (true) or below the threshold
+    double trigger_threshold;
+    unsigned long capture_pre_ms;
+    unsigned long capture_post_ms;
+    const char *capture_prefix; // captures are written to <prefix>.<date>-<time>-<n>
+    unsigned long capture_rate; // microseconds between sub-samples
+    int flight_minutes; // length of the flight recorder ring
+    size_t max_rss; // --max-rss budget in bytes, 0 when unbounded
+    int renderer; // index into the renderer table
     int argc;
     char **argv;
 } ArgsInfo;
 
-typedef struct
+enum { GROUP_NONE, GROUP_USER, GROUP_CGROUP };
+enum { SORT_CPU, SORT_RSS, SORT_IO };
+
+typedef struct
+{
+    int row;
+    int col;
+} CursorPosition;
+
+#define MAX_PANELS 8
+
+typedef struct
+{
+    char title[64];
+    int rows; // text lines reserved below the title
+    int width;
+    char *text; // `rows` NUL-terminated lines of `width + 1` bytes, rewritten by the collector
+    CursorPosition origin; // where the title is printed
+} TextPanel;
+
+typedef struct
+{
+    char *pool; // NUL-terminated strings packed back to back
+    size_t pool_size;
+    size_t pool_used;
+    uint32_t *slots; // open-addressing hash of pool offset + 1, 0 for an empty slot
+    size_t slot_count; // power of two
+    size_t count;
+} StringTable;
+
+#define INTERN_FAILED UINT32_MAX
+
+typedef struct
+{
+    pid_t pid; // 0 for an empty slot
+    pid_t ppid;
+    uid_t uid;
+    int dir_fd; // /proc/<pid>; reads through it fail once the process is gone, even if the pid is reused
+    int stat_fd; // /proc/<pid>/stat, re-read with pread()
+    int io_fd; // /proc/<pid>/io, re-read with pread(); -1 if not readable (another user's process)
+    uint32_t cgroup; // interned cgroup path, resolved once when the process is first seen
+    char comm[16];
+    unsigned long long cpu_ticks; // utime + stime
+    unsigned long long blkio_ticks; // delayacct_blkio_ticks
+    unsigned long long read_bytes; // /proc/<pid>/io counters at the last scan
+    unsigned long long write_bytes;
+    unsigned long long cancelled_bytes; // cancelled_write_bytes
+    unsigned long generation; // scan in which the process was last seen
+    double cpu; // % of one CPU over the last tick
+    double io_wait; // ms of block I/O wait per second over the last tick
+    double read_rate; // bytes per second read from storage over the last tick
+    double write_rate; // bytes per second written
+    double cancelled_rate; // bytes per second of writes cancelled by truncation
+    size_t rss; // bytes
+    unsigned long tree_generation; // scan in which `in_tree` was computed
+    bool in_tree; // descends from the wrapped command
+} ProcEntry;
+
+typedef struct
+{
+    uint32_t key; // uid or interned cgroup path
+    bool used;
+    int processes;
+    double cpu;
+    double io_wait;
+    double read_rate;
+    double write_rate;
+    size_t rss;
+} GroupStat;
+
+#define MAX_TOP 50
+#define GROUP_SLOTS 1024
+#define MAX_USER_NAMES 1024
+#define PROCESS_CAPACITY 4096 // default; --max-rss may shrink it
+#define DIRENT_BUFFER_SIZE (32UL << 10)
+#define PROC_STRING_POOL (256UL << 10)
+#define PROC_STRING_SLOTS 8192
+#define PROCS_PANEL_WIDTH 96
+
+typedef struct
+{
+    ProcEntry *entries; // open-addressing hash keyed by pid
+    size_t slot_count; // power of two, at least twice `capacity`
+    size_t capacity;
+    size_t count;
+    size_t untracked; // processes seen this scan that did not fit
+    unsigned long generation;
+    int proc_fd; // /proc, listed with getdents64 into the scratch arena
+    uint64_t last_scan_ns;
+    long clock_ticks;
+    long page_size;
+    StringTable strings; // cgroup paths and user names
+    int cpus; // online CPUs, to express process CPU as % of the machine
+    pid_t self; // this process; orphans of a wrapped command are re-parented to it
+    GroupStat *by_user; // GROUP_SLOTS running aggregates, rebuilt each scan
+    GroupStat *by_cgroup;
+    uid_t user_ids[MAX_USER_NAMES]; // loaded from /etc/passwd at setup
+    uint32_t user_names[MAX_USER_NAMES];
+    int user_count;
+} ProcTable;
+
+#define CGROUP_CAPACITY 1024 // default; --max-rss may shrink it
+#define CGROUP_NAME_SIZE 96
+#define CGROUP_ROWS 20
+#define CGROUP_RESCAN_TICKS 10
+#define CGROUPS_PANEL_WIDTH 80
+
+typedef struct
+{
+    bool used;
+    int parent; // node index, -1 for the root
+    int first_child; // -1 when there are no children
+    int next_sibling; // next child of the parent, or next free node
+    int depth;
+    unsigned long generation; // listing of the parent in which the directory was last seen
+    int dir_fd; // the cgroup directory; its other files are opened relative to it
+    int cpu_fd; // cpu.stat, re-read with pread() every tick to detect activity
+    uint64_t usage_usec; // cpu.stat usage_usec, which includes every descendant
+    uint64_t io_bytes; // io.stat rbytes + wbytes over all devices
+    double cpu; // % of the machine over the last tick
+    double io_rate; // bytes per second
+    size_t memory; // memory.current in bytes
+    float pressure[3]; // "some avg10" of cpu.pressure, memory.pressure and io.pressure
+    bool has_memory; // memory.current was readable
+    bool has_io;
+    bool has_pressure;
+    bool fresh; // added since the last walk, so no rates can be computed yet
+    uint32_t name_hash;
+    char name[CGROUP_NAME_SIZE];
+} CgroupNode;
+
+typedef struct
+{
+    CgroupNode *nodes; // nodes[0] is the root of the hierarchy
+    size_t capacity;
+    size_t count;
+    size_t untracked; // directories that did not fit or could not be opened
+    size_t reread; // nodes whose files were read on the last walk
+    int free; // head of the free node list
+    unsigned long generation;
+    uint64_t last_walk_ns;
+    double seconds; // length of the last tick
+    int cpus;
+    char *dirents; // getdents64 buffer for the current walk
+    const char *root_path;
+} CgroupTree;
+
+#define MAX_SERIES 32
+#define MAX_HISTORY 4096
+
+typedef struct Series
+{
+    const char *name; // metric name used by the headless renderer, e.g. "mem.used"
+    const char *label; // graph title, e.g. "v Memory "
+    const char *unit; // unit printed next to the latest value
+    char top_label[20]; // label of the top of the y-axis, e.g. "16 GB"
+    const char *baseline; // label of the bottom of the y-axis
+    char glyph; // character plotted for each sample
+    bool auto_scale; // the terminal grows `scale` to fit the largest value in view
+    struct Series *overlay_of; // drawn on this series' graph and scale instead of its own graph
+    int overlays; // number of series overlaid on this one
+    int gap; // blank rows left above the graph
+    int height; // rows of the y-axis
+    double scale; // value represented by one row
+    double value; // latest sample, set by the collector
+    float *history; // ring of the last `capacity` samples
+    size_t capacity;
+    size_t count; // total samples pushed; the newest is history[(count - 1) % capacity]
+    CursorPosition heading; // where the latest value is printed
+    CursorPosition plot; // bottom-left corner of the plot area
+} Series;
+
+typedef struct
+{
+    float min;
+    float max;
+    double sum;
+    size_t count; // samples reduced; NaN samples are gaps and are not counted
+} Reduction;
+
+typedef struct
+{
+    size_t count;
+    double min;
+    double max;
+    double mean;
+    double p50;
+    double p90;
+    double p99;
+} SeriesSummary;
+
+#define RUN_SUB_BUCKETS 16 // histogram buckets per power of two, so a percentile is within about 3%
+#define RUN_BUCKETS (64 * RUN_SUB_BUCKETS) // 2^-32 to 2^32; bucket 0 holds zero and below
+
+typedef struct
+{
+    double min; // over the whole run, which a series' history may no longer hold
+    double max;
+    double sum;
+    size_t count; // NaN samples are gaps and are not counted
+    uint32_t histogram[RUN_BUCKETS]; // for percentiles once the history has wrapped
+} RunStats;
+
+typedef struct
+{
+    char path[192]; // the cgroup's cpu.stat
+    char name[24]; // label: the cgroup's directory name, or "self"
+    char series_name[40]; // e.g. "throttle.self"
+    ProcFile cpu_stat;
+    uint64_t periods; // nr_periods
+    uint64_t throttled; // nr_throttled
+    uint64_t throttled_usec;
+    bool throttling; // throttled during the last tick
+    Series *series; // % of the last tick's periods that were throttled
+} ThrottleGroup;
+
+enum { MEMCG_LOW, MEMCG_HIGH, MEMCG_MAX, MEMCG_OOM, MEMCG_OOM_KILL, MEMCG_EVENT_COUNT };
+
+#define MEMCG_PANEL_WIDTH 100
+#define WRITEBACK_PANEL_WIDTH 96
+
+typedef struct
+{
+    char name[24]; // label: the cgroup's directory name, or "self"
+    char series_name[40]; // e.g. "memcg.self"
+    bool v1; // cgroup v1 memory controller, which has no memory.events
+    int dir_fd;
+    ProcFile current; // memory.current (v1: memory.usage_in_bytes)
+    ProcFile events; // memory.events (v1: memory.oom_control)
+    ProcFile failcnt; // v1 only: memory.failcnt, counted as "max" events
+    ProcFile stat; // memory.stat
+    uint64_t counts[MEMCG_EVENT_COUNT]; // event counters at the last tick
+    uint64_t anon; // memory.stat anon (v1: rss), bytes
+    uint64_t file; // file (v1: cache)
+    uint64_t shmem;
+    uint64_t major_faults; // pgmajfault
+    double major_fault_rate; // per second over the last tick
+    Series *series; // memory.current, GB
+} MemoryCgroup;
+
+typedef struct
+{
+    ProcFile meminfo;
+    ProcFile vmstat;
+    int sysctl_fds[4]; // vm.dirty_ratio, dirty_background_ratio, dirty_bytes, dirty_background_bytes
+    uint64_t dirtied; // nr_dirtied pages at the last tick
+    uint64_t written; // nr_written pages
+    uint64_t last_ns;
+    double dirtied_rate; // bytes per second
+    double written_rate;
+    double nfs_unstable; // bytes, -1 on kernels without NFS_Unstable
+    double limit; // bytes: writers are throttled above this much dirty memory
+    double background_limit; // bytes: background writeback starts above this
+    Series *dirty; // MB
+    Series *writeback;
+    Series *limit_series;
+    Series *background_series;
+} WritebackState;
+
+#define MAX_IDLE_STATES 8
+#define MAX_PSTATES 32
+#define CSTATE_MAX_CPUS 64
+#define CSTATES_PANEL_WIDTH 96
+
+typedef struct
+{
+    int cpu; // logical CPU number
+    int idle_fds[MAX_IDLE_STATES]; // cpuidle/state<N>/time, microseconds spent in the state; -1 if absent
+    uint64_t idle_usec[MAX_IDLE_STATES]; // at the last tick
+    double idle_share[MAX_IDLE_STATES]; // % of the last tick
+    int freq_fd; // cpufreq/stats/time_in_state, -1 if absent
+    int freq_count;
+    uint32_t freqs[MAX_PSTATES]; // kHz, in the order the file lists them
+    uint64_t freq_time[MAX_PSTATES]; // 10 ms units, at the last tick
+    double freq_share[MAX_PSTATES]; // % of the last tick's time in state
+    double average_mhz; // time-weighted over the last tick
+} CoreResidency;
+
+typedef struct
+{
+    CoreResidency *cores;
+    int count;
+    int idle_states; // states listed under cpu0/cpuidle
+    char idle_names[MAX_IDLE_STATES][16]; // e.g. "POLL", "C1E", "C6"
+    uint32_t max_khz; // highest P-state seen in time_in_state
+    uint32_t min_khz;
+    uint64_t last_ns;
+} ResidencyTable;
+
+#define DISK_FIELDS 11 // the fields of /sys/block/<dev>/stat used, as in /proc/diskstats
+#define DISKS_PANEL_WIDTH 80
+
+typedef struct
+{
+    char name[32];
+    char path[64]; // /sys/block/<name>/stat
+    char series_name[48]; // e.g. "disk.sda.await"
+    ProcFile stat; // fd -1 when the device is read from /proc/diskstats instead
+    unsigned long long fields[DISK_FIELDS]; // counters at the last tick
+    double reads; // requests completed per second
+    double writes;
+    double read_bytes; // bytes per second
+    double write_bytes;
+    double read_await; // ms per read completed during the tick
+    double write_await;
+    double queue_depth; // average requests in flight
+    double utilization; // % of the tick with requests in flight
+    Series *series; // ms per request completed during the tick
+} Disk;
+
+#define EVENT_RING_SIZE 256
+
+typedef struct
+{
+    uint64_t t_ns; // CLOCK_MONOTONIC time the event was seen
+    int tick;
+    Series *series; // the graph the event is marked on, NULL for none
+    char glyph; // marker drawn on the graph's time axis
+    bool marker; // an external marker, drawn as a vertical line across every graph
+    char text[64];
+} Event;
+
+typedef struct
+{
+    int fd; // read end of the --markers FIFO, -1 without one
+    int keep_fd; // write end held open so the FIFO does not report end-of-file between writers
+    char line[64]; // the marker being read, up to its newline
+    size_t length;
+} MarkerPipe;
+
+static volatile sig_atomic_t snapshot_requested = 0; // set by SIGUSR1
+
+#define RECORD_MAGIC "SYSMREC1"
+#define RECORD_HEADER_SIZE 4096
+#define RECORD_VALUES 12
+#define RECORD_NAME_SIZE 32
+
+enum { RECORD_EMPTY, RECORD_SAMPLES, RECORD_MARKER };
+
+/*
+ * A recording is a RECORD_HEADER_SIZE header followed by 64-byte entries. 
+ * Each tick takes one entry per RECORD_VALUES series. Ring recordings keep 
+ * the last `capacity` entries: entry i lives in slot i % capacity. Linear 
+ * recordings (capacity 0) hold `head` entries in order. `head` only advances 
+ * once a tick's entries are complete, so a recording cut short by a crash 
+ * ends on the last whole tick.
+ */
+typedef struct
+{
+    char magic[8]; // RECORD_MAGIC
+    uint32_t entry_size; // sizeof(RecordEntry)
+    uint32_t series_count;
+    uint64_t capacity; // entries in the ring, 0 for a linear recording
+    uint64_t head; // entries written so far
+    uint64_t tdelay; // microseconds between samples
+    uint64_t start_ns; // CLOCK_MONOTONIC time of the monitor's start
+    int64_t start_realtime_ns; // wall-clock time of the monitor's start
+    char names[MAX_SERIES][RECORD_NAME_SIZE];
+    char units[MAX_SERIES][8];
+} RecordHeader;
+
+typedef struct
+{
+    uint64_t t_ns; // CLOCK_MONOTONIC time of the tick
+    int32_t tick;
+    uint16_t kind; // RECORD_SAMPLES, RECORD_MARKER, or RECORD_EMPTY for a dropped entry
+    uint16_t first; // index of the series in values[0], or the marker glyph
+    union
+    {
+        float values[RECORD_VALUES]; // NaN past the last series
+        char text[RECORD_VALUES * sizeof(float)];
+    };
+} RecordEntry;
+
+_Static_assert(sizeof(RecordHeader) <= RECORD_HEADER_SIZE, "recording header overflows its page");
+_Static_assert(sizeof(RecordEntry) == 64, "recording entries are 64 bytes");
+
+typedef struct
+{
+    int fd;
+    RecordHeader *header; // the whole file is mapped shared
+    RecordEntry *entries;
+    size_t map_size;
+    int entries_per_tick;
+    int sync_every; // ticks between asynchronous writebacks of the file
+    pid_t snapshot_pid; // the child writing a snapshot, 0 if none
+} FlightRecorder;
+
+#define CAPTURE_METRICS 4
+
+static const char *const capture_metrics[CAPTURE_METRICS] = {"cpu", "psi.cpu", "psi.memory", "psi.io"};
+
+typedef struct
+{
+    uint64_t t_ns;
+    float values[CAPTURE_METRICS]; // cpu, psi.cpu, psi.memory, psi.io in %; NaN when unavailable
+} CaptureSample;
+
+typedef struct
+{
+    int fd; // /proc/stat
+    int pressure_fds[3]; // /proc/pressure/{cpu,memory,io}, -1 without PSI
+    uint64_t min_jiffies; // jiffies a CPU reading must span, so one jiffy does not read as 0% or 100%
+    uint64_t cpu_total; // jiffies at the previous CPU reading
+    uint64_t cpu_idle;
+    uint64_t stall_us[3]; // "some" stall totals at the previous sub-sample
+    uint64_t last_ns;
+    CaptureSample *ring; // the pre-trigger window followed by room for the post-trigger one
+    unsigned char *file; // a capture's header page and entries, built here and written at once
+    size_t capacity;
+    size_t pre; // sub-samples kept before the trigger
+    size_t post; // sub-samples recorded after the trigger
+    size_t count; // sub-samples taken
+    size_t triggered_at; // index of the sub-sample that fired, while a capture is in progress
+    bool capturing;
+    bool armed; // the trigger fires again only after its condition has been false
+    int captures;
+} Capture;
+
+typedef struct
+{
+    int fd; // -1 when not recording
+    uint32_t series_count; // series in the header; series added later are not recorded
+    uint64_t entries;
+    char path[256];
+} Recording;
+
+#define MAX_CONTROL_CLIENTS 4
+#define CONTROL_FD_LIMIT 1024 // descriptors a failed `enable` is checked for and rolled back
+#define CONTROL_LINE_SIZE 128
+
+typedef struct
+{
+    int fd; // listening socket, -1 without --control
+    int clients[MAX_CONTROL_CLIENTS]; // -1 for a free slot
+    char lines[MAX_CONTROL_CLIENTS][CONTROL_LINE_SIZE]; // each client's command up to its newline
+    size_t lengths[MAX_CONTROL_CLIENTS];
+} ControlSocket;
+
+#define MAX_WEB_CLIENTS 8
+#define WEB_QUEUE_SIZE (64UL << 10) // bytes a slow client may fall behind before it is dropped
+#define WEB_FRAME_SIZE 8192
+#define WEB_REQUEST_SIZE 512
+
+typedef struct
+{
+    int fd; // -1 for a free slot
+    bool streaming; // sent the /events headers; otherwise still reading its request
+    char request[WEB_REQUEST_SIZE];
+    size_t request_length;
+    char *queue; // WEB_QUEUE_SIZE bytes not yet accepted by the socket
+    size_t queued;
+} WebClient;
+
+typedef struct
+{
+    int fd; // listening socket, -1 without --web
+    WebClient clients[MAX_WEB_CLIENTS];
+    char *frame; // the latest tick as an SSE message, encoded once for every client
+    int series_count; // series announced to the clients so far
+    size_t events_sent;
+} WebServer;
+
+#define EXPORT_CHUNK_SIZE (64UL << 10)
+#define EXPORT_EVENT_SIZE 512 // room kept free in the chunk for the next event
+#define EXPORT_MAX_CPUS 256
+
+typedef struct
+{
+    int fd; // -1 without --export-trace
+    char *chunk; // EXPORT_CHUNK_SIZE bytes of events not yet written
+    size_t length;
+    ProcFile stat; // /proc/stat, for the per-core counters
+    uint64_t *core_total; // jiffies of cpuN at the previous tick, indexed by N; 0 until seen
+    uint64_t *core_idle;
+    size_t events_exported; // monitor events already written as instant events
+    int pid; // of the trace's process track
+} TraceExport;
+
+typedef struct
+{
+    FILE *terminal; // the real stdout, while frames are rendered into `frame`
+    int fd; // our own non-blocking description of stdout, or fd 1 itself
+    bool socket; // stdout is a socket, written with MSG_DONTWAIT
+    char *frame; // the chunk of the frame being rendered, through a stream installed as stdout
+    size_t length;
+    size_t size; // of `frame` and `pending`
+    bool discarding; // a chunk of this frame could not be sent: the rest is dropped
+    char *pending; // the unwritten end of the last chunk sent
+    size_t pending_length;
+    size_t pending_offset;
+    unsigned long frames;
+    unsigned long dropped; // frames not sent because the previous one had not drained
+    bool redraw; // frames were dropped: the next frame sent must draw everything
+} FrameOutput;
+
+typedef struct
+{
+    const RecordHeader *header; // the recording, mapped read-only
+    const RecordEntry *entries;
+    uint64_t first; // index of the oldest entry still held
+    uint64_t count; // entries held
+    size_t map_size;
+} RecordingView;
+
+typedef struct
+{
+    const char *name;
+    const char *unit;
+    size_t count[2]; // samples in the baseline and the candidate
+    double p50[2];
+    double p90[2];
+    double p99[2];
+    double mean[2];
+    double superiority; // probability that a candidate sample exceeds a baseline sample, ties counting half
+    bool neutral; // a threshold rather than a cost: a change is neither better nor worse
+    double p_value; // two-sided Mann-Whitney U test
+} MetricComparison;
+
+#define MAX_GATE_RULES 16
+
+enum { GATE_MIN, GATE_MAX, GATE_MEAN, GATE_P50, GATE_P90, GATE_P99 };
+
+typedef struct
+{
+    char text[64]; // the rule as written, for the verdict
+    char metric[RECORD_NAME_SIZE];
+    int function; // GATE_MIN ... GATE_P99
+    char op[3]; // "<", "<=", ">" or ">="
+    double threshold; // in the unit written in the rule, converted once the series is known
+    char unit[8]; // the threshold's unit, empty for the series' own unit
+    Series *series; // resolved after setup
+    RunStats stats;
+} GateRule;
+
+#define MAX_COLLECTORS 16
+
+typedef struct
+{
+    bool set_up; // setup ran; a disabled collector that was set up is paused
+    int first_series; // the collector's series are series[first_series .. first_series + series_count)
+    int series_count;
+} CollectorState;
+
+enum { TARGET_TREE, TARGET_PID, TARGET_NAME };
+
+typedef struct
+{
+    int kind;
+    pid_t pid; // root of a TARGET_TREE, or the process of a TARGET_PID
+    const char *pattern; // process name pattern of a TARGET_NAME
+    char name[24]; // label in headings and summaries
+    char cpu_name[32]; // series names, e.g. "cmd.cpu"
+    char mem_name[32];
+    Series *cpu; // % of the whole machine, so it shares the system CPU graph
+    Series *mem; // GB
+    RunStats cpu_stats; // whole-run distributions for the summary
+    RunStats mem_stats;
+    int processes;
+    size_t rss; // bytes
+    size_t peak_rss;
+} Target;
+
+typedef struct
+{
+    pid_t pid; // 0 when no command is being run
+    bool done;
+    int status; // wait status of the command
+    struct rusage usage; // summed over the command and every descendant reaped
+    uint64_t start_ns;
+    uint64_t end_ns;
+} CommandRun;
+
+typedef struct
+{
+    long double preTotalCPU;
+    long double preIdleCPU;
+    long double finalTotalCPU;
+    long double finalIdleCPU;
+    ProcFile proc_stat;
+} CpuState;
+
+typedef struct
+{
+    ArgsInfo *args;
+    Series series[MAX_SERIES];
+    int series_count;
+    MemoryPlan plan;
+    size_t history_capacity;
+    int tick;
+    uint64_t start_ns;
+    TextPanel panels[MAX_PANELS];
+    int panel_count;
+    Series *memory_used;
+    Series *cpu_utilization;
+    CpuState cpu;
+    ProcTable *procs;
+    TextPanel *procs_panel;
+    CgroupTree *cgroups;
+    TextPanel *cgroups_panel;
+    ThrottleGroup throttles[MAX_SELECTED_CGROUPS];
+    int throttle_count;
+    WritebackState writeback;
+    TextPanel *writeback_panel;
+    ResidencyTable residency;
+    TextPanel *cstates_panel;
+    Disk disks[MAX_DISKS];
+    int disk_count;
+    ProcFile diskstats; // /proc/diskstats, for devices without /sys/block/<dev>/stat
+    TextPanel *disks_panel;
+    uint64_t disks_last_ns;
+    MemoryCgroup memcgs[MAX_SELECTED_CGROUPS];
+    int memcg_count;
+    TextPanel *memcg_panel;
+    uint64_t memcg_last_ns;
+    Event events[EVENT_RING_SIZE]; // ring of the latest events
+    size_t event_count; // total events; the newest is events[(event_count - 1) % EVENT_RING_SIZE]
+    size_t events_drawn; // events already shown by the renderer
+    Target targets[MAX_TARGETS];
+    int target_count;
+    CommandRun command;
+    struct rlimit fd_limit; // RLIMIT_NOFILE as inherited, before plan_descriptors() raises it
+    FlightRecorder flight;
+    Capture capture;
+    MarkerPipe markers;
+    Recording recording;
+    ControlSocket control;
+    WebServer web;
+    TraceExport export;
+    FrameOutput output;
+    GateRule gate_rules[MAX_GATE_RULES];
+    int gate_rule_count;
+    CollectorState collector_states[MAX_COLLECTORS];
+    int cores;
+    double max_frequency;
+    int current_row; // terminal layout cursor
+    int current_column;
+} Monitor;
+
+typedef struct
+{
+    const char *name; // also the name of the collector's trace stage
+    const char *flag; // command-line flag that enables the collector
+    size_t flag_offset; // offset of the collector's enable flag in ArgsInfo
+    bool default_on; // enabled when no collector flag is given
+    int (*setup)(Monitor *monitor); // optional: create series, open files
+    void (*sample)(Monitor *monitor); // optional: called once per tick
+    void (*finish)(Monitor *monitor); // optional: called once after the last tick
+} Collector;
+
+typedef struct
+{
+    const char *name;
+    const char *flag; // command-line flag that selects the renderer, NULL for the default
+    void (*begin)(Monitor *monitor);
+    void (*frame)(Monitor *monitor);
+    void (*redraw)(Monitor *monitor); // draws everything again after dropped frames, NULL if frames are independent
+    void (*end)(Monitor *monitor);
+} Renderer;
+
+#define TRACE_RING_SIZE 4096 // default capacity; --max-rss may shrink it
+#define TICK_HISTOGRAM_BUCKETS 24
+#define STARTUP_BUDGET_US 5000
+
+typedef struct
+{
+    const char *name; // stage name: "wakeup", "memory", "cpu", "aggregate", "render", "flush"
+    uint64_t start_ns; // CLOCK_MONOTONIC timestamp at stage entry
+    uint64_t dur_ns;
+    int tick;
+} TraceEvent;
+
+typedef struct
+{
+    TraceEvent *events; // `capacity` entries carved out of the run arena
+    unsigned long capacity;
+    unsigned long head; // total number of events ever recorded; the ring keeps the newest `capacity`
+    unsigned long tick_histogram[TICK_HISTOGRAM_BUCKETS]; // bucket k counts ticks taking [2^k, 2^(k+1)) us
+    unsigned long ticks;
+    unsigned long overruns;
+    uint64_t max_tick_ns;
+    uint64_t startup_ns; // cold start: entry to main() until the first frame was flushed
+} TraceRing;
+
+static TraceRing trace_ring;
+
+#ifdef SYSMON_ALLOC_CHECK
+/*
+ * Allocation verification harness.
+ * 
+ * Building with -DSYSMON_ALLOC_CHECK interposes malloc, calloc, realloc and free. 
+ * Once the harness is armed (after the first tick), any call into the heap 
+ * aborts the program with the name of the offending function, so a plain run 
+ * such as `./sysmon 50 1000` doubles as a test that the steady state is 
+ * allocation-free. Messages are written with write(2) because stdio may itself 
+ * allocate.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static volatile bool alloc_check_armed = false;
+
+static void alloc_check_fail(const char *function)
+{
+    static const char message[] = "Error: heap call after the first tick: ";
+    if (write(STDERR_FILENO, message, sizeof(message) - 1) < 0 ||
+        write(STDERR_FILENO, function, strlen(function)) < 0 ||
+        write(STDERR_FILENO, "\n", 1) < 0)
+    {
+        // nothing more can be reported; abort below regardless
+    }
+    abort();
+}
+
+void *malloc(size_t size)
+{
+    if (alloc_check_armed)
+    {
+        alloc_check_fail("malloc");
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    if (alloc_check_armed)
+    {
+        alloc_check_fail("calloc");
+    }
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (alloc_check_armed)
+    {
+        alloc_check_fail("realloc");
+    }
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    if (alloc_check_armed && ptr != NULL)
+    {
+        alloc_check_fail("free");
+    }
+    __libc_free(ptr);
+}
+
+#define ALLOC_CHECK_ARM(armed) (alloc_check_armed = (armed))
+#else
+#define ALLOC_CHECK_ARM(armed) ((void)0)
+#endif
+
+/**
+ * Reserves the address space for an arena.
+ * 
+ * The whole reservation is mapped once at startup with MAP_NORESERVE, so only 
+ * the pages that are actually handed out count towards the resident set. After 
+ * startup no allocation in the program touches the heap: per-run state is 
+ * carved out of one arena and per-tick parsing buffers out of a second one 
+ * that is reset every tick.
+ * 
+ * @param arena The arena to initialize.
+ * @param size The number of bytes to reserve.
+ * @return 0 on success, -1 if the reservation fails.
+ */
+int arena_init(Arena *arena, size_t size)
+{
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        return -1;
+    }
+    arena->base = (unsigned char *)base;
+    arena->size = size;
+    arena->used = 0;
+    arena->peak = 0;
+    return 0;
+}
+
+/**
+ * Hands out a zeroed, 16-byte aligned block from an arena.
+ * 
+ * Zeroing touches every page of the block, so the memory is resident from the 
+ * moment it is allocated and the steady state incurs no page faults for it.
+ * 
+ * @param arena The arena to allocate from.
+ * @param size The number of bytes requested.
+ * @return A pointer to the block, or NULL if the arena is exhausted.
+ */
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size_t offset = (arena->used + 15) & ~(size_t)15;
+    if (offset > arena->size || size > arena->size - offset)
+    {
+        return NULL;
+    }
+    arena->used = offset + size;
+    if (arena->used > arena->peak)
+    {
+        arena->peak = arena->used;
+    }
+    memset(arena->base + offset, 0, size);
+    return arena->base + offset;
+}
+
+/**
+ * Releases every block of an arena at once.
+ * 
+ * The pages stay mapped and resident, so the scratch arena can be reset at the 
+ * start of every tick and refilled without any system calls.
+ * 
+ * @param arena The arena to reset.
+ */
+void arena_reset(Arena *arena)
+{
+    arena->used = 0;
+}
+
+/**
+ * Hashes a byte string with 32-bit FNV-1a.
+ * 
+ * @param str The bytes to hash.
+ * @param len The number of bytes.
+ * @return The hash value.
+ */
+uint32_t hash_bytes(const char *str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Allocates the pool and hash slots of a string table from an arena.
+ * 
+ * @param table The table to initialize.
+ * @param arena The arena to allocate from.
+ * @param pool_size The bytes available for string contents.
+ * @param slot_count The number of hash slots; must be a power of two.
+ * @return 0 on success, -1 if the arena is exhausted.
+ */
+int string_table_init(StringTable *table, Arena *arena, size_t pool_size, size_t slot_count)
+{
+    table->pool = (char *)arena_alloc(arena, pool_size);
+    table->slots = (uint32_t *)arena_alloc(arena, slot_count * sizeof(uint32_t));
+    table->pool_size = pool_size;
+    table->pool_used = 0;
+    table->slot_count = slot_count;
+    table->count = 0;
+    return table->pool == NULL || table->slots == NULL ? -1 : 0;
+}
+
+/**
+ * Interns a string: returns the id of an equal string already in the table, or 
+ * copies the string into the pool and returns its new id.
+ * 
+ * Interned strings are never freed, so an id stays valid for the whole run and 
+ * two ids are equal exactly when their strings are.
+ * 
+ * @param table The string table.
+ * @param str The string to intern (need not be NUL-terminated).
+ * @param len The length of the string.
+ * @return The string id, or `INTERN_FAILED` if the table is full.
+ */
+uint32_t intern_string(StringTable *table, const char *str, size_t len)
+{
+    size_t mask = table->slot_count - 1;
+    size_t i = hash_bytes(str, len) & mask;
+    while (table->slots[i] != 0)
+    {
+        const char *candidate = table->pool + table->slots[i] - 1;
+        if (strncmp(candidate, str, len) == 0 && candidate[len] == '\0')
+        {
+            return table->slots[i] - 1;
+        }
+        i = (i + 1) & mask;
+    }
+    if (table->pool_used + len + 1 > table->pool_size || (table->count + 1) * 4 > table->slot_count * 3)
+    {
+        return INTERN_FAILED;
+    }
+    uint32_t id = (uint32_t)table->pool_used;
+    memcpy(table->pool + id, str, len);
+    table->pool[id + len] = '\0';
+    table->pool_used += len + 1;
+    table->slots[i] = id + 1;
+    table->count++;
+    return id;
+}
+
+/**
+ * Looks up the contents of an interned string.
+ * 
+ * @param table The string table.
+ * @param id The id returned by `intern_string`.
+ * @return The string, or "?" for `INTERN_FAILED`.
+ */
+const char *string_table_get(const StringTable *table, uint32_t id)
+{
+    return id == INTERN_FAILED ? "?" : table->pool + id;
+}
+
+/**
+ * Initializes the `ArgsInfo` structure with default values.
+ * 
+ * This function allocates the `ArgsInfo` structure from the run arena and 
+ * initializes its fields. It sets default values for the number of samples and 
+ * time delay while ensuring that flags for memory, CPU, and core usage are 
+ * initially disabled. The `updated_sample` and `updated_tdelay` fields are set 
+ * to `false` to prevent the user from specifying multiple values for `samples` 
+ * and `tdelay`.
+ * 
+ * Behavior:
+ * - `samples` is set to 20 (default sample count).
+ * - `tdelay` is set to 500,000 microseconds (default time delay).
+ * - `memory_flag`, `cpu_flag`, and `cores_flag` are set to `false` (disabled by default).
+ * - `updated_sample` and `updated_tdelay` are set to `false` to track whether 
+ *   user-specified values have been assigned.
+ * - The `argc` and `argv` fields store the command-line arguments.
+ * 
+ * @param arena The run arena the structure is allocated from.
+ * @param argc The number of command-line arguments.
+ * @param argv The array of command-line argument strings.
+ * @return A pointer to an initialized `ArgsInfo` structure.
+ *         Exits the program if memory allocation fails.
+ */
+ArgsInfo* initializeArgument(Arena *arena, int argc, char **argv){
+    ArgsInfo *argsInfo = (ArgsInfo *)arena_alloc(arena, sizeof(ArgsInfo));
+    if (argsInfo == NULL)
+    {
+        fprintf(stderr, "Error:Memory allocation\n");
+        exit(1);
+    }
+    argsInfo->argc = argc;
+    argsInfo->argv = argv;
+    argsInfo->cores_flag = false;
+    argsInfo->cstates_flag = false;
+    argsInfo->cpu_flag = false;
+    argsInfo->memory_flag = false;
+    argsInfo->overview_flag = false;
+    argsInfo->writeback_flag = false;
+    argsInfo->procs_flag = false;
+    argsInfo->procs_view = false;
+    argsInfo->cgroups_flag = false;
+    argsInfo->throttle_flag = false;
+    argsInfo->memcg_flag = false;
+    argsInfo->disks_flag = false;
+    argsInfo->disk_name_count = 0;
+    argsInfo->cgroup_path_count = 0;
+    argsInfo->cgroup_depth = 2;
+    argsInfo->group_by = GROUP_NONE;
+    argsInfo->sort_key = SORT_CPU;
+    argsInfo->top = 10;
+    argsInfo->samples = 20;    // default values
+    argsInfo->tdelay = 500000; // default values
+    argsInfo->updated_sample = false;
+    argsInfo->updated_tdelay = false;
+    argsInfo->command = NULL;
+    argsInfo->target_spec_count = 0;
+    argsInfo->trace_file = NULL;
+    argsInfo->flight_file = NULL;
+    argsInfo->markers_path = NULL;
+    argsInfo->record_file = NULL;
+    argsInfo->control_path = NULL;
+    argsInfo->web_address = NULL;
+    argsInfo->export_trace_file = NULL;
+    argsInfo->gate_rules = NULL;
+    argsInfo->trigger_metric = -1;
+    argsInfo->trigger_above = true;
+    argsInfo->trigger_threshold = 0;
+    argsInfo->capture_pre_ms = 2000;
+    argsInfo->capture_post_ms = 2000;
+    argsInfo->capture_prefix = "sysmon-capture";
+    argsInfo->capture_rate = 10000;
+    argsInfo->flight_minutes = 10;
+    argsInfo->max_rss = 0;
+    argsInfo->renderer = 0;
+    return argsInfo;
+}
+
+/**
+ * Removes leading whitespace characters from a given string.
+ * Uses the isspace function to check for spaces and moves the pointer
+ * forward to the first non-space character.
+ * @param str The input string.
+ * @return A pointer to the modified string with leading spaces removed,
+ *         or NULL if the input is NULL.
+ */
+char *removeWhiteSpace(char *str)
+{
+    if (str == NULL)
+    {
+        return NULL;
+    }
+    while (isspace((unsigned char)*str))
+    {
+        str++;
+    }
+    return str;
+}
+
+/**
+ * Parses a byte count with an optional binary unit suffix.
+ * 
+ * Accepted forms are a plain number of bytes ("1048576") or a number followed 
+ * by K, M or G, optionally followed by "iB" or "B" ("512K", "256MiB", "1GB"). 
+ * All suffixes are powers of 1024.
+ * 
+ * @param str The string to parse.
+ * @param bytes Receives the parsed byte count.
+ * @return 0 on success, -1 if the string is not a valid size.
+ */
+int parse_size(const char *str, size_t *bytes)
+{
+    char *endptr;
+    double value = strtod(str, &endptr);
+    if (endptr == str || value < 0)
+    {
+        return -1;
+    }
+    double multiplier = 1;
+    switch (toupper((unsigned char)*endptr))
+    {
+    case 'K':
+        multiplier = 1024.0;
+        endptr++;
+        break;
+    case 'M':
+        multiplier = 1024.0 * 1024.0;
+        endptr++;
+        break;
+    case 'G':
+        multiplier = 1024.0 * 1024.0 * 1024.0;
+        endptr++;
+        break;
+    }
+    if (multiplier > 1 && (strcmp(endptr, "iB") == 0 || strcmp(endptr, "B") == 0))
+    {
+        endptr += strlen(endptr);
+    }
+    if (*endptr != '\0')
+    {
+        return -1;
+    }
+    *bytes = (size_t)(value * multiplier);
+    return 0;
+}
+
+/**
+ * Stores a cursor position (row and column) for terminal-based graph plotting.
+ * Used to track positions for elements like headers, memory, and CPU plots,
+ * as well as terminal navigation using escape codes.
+ * @param row The row position in the terminal.
+ * @param col The column position in the terminal.
+ * @return A CursorPosition struct containing the given row and column values.
+ */
+CursorPosition save_position(int row, int col)
+{
+    CursorPosition pos;
+    pos.row = row;
+    pos.col = col;
+    return pos;
+}
+
+/**
+ * Prints a specified number of newline characters to move the cursor down.
+ * 
+ * This function iterates and prints newline characters to shift the terminal output 
+ * down by the specified number of lines.
+ * 
+ * @param num_lines The number of lines to move down.
+ */
+void change_line(int num_lines)
+{
+    for (int i = 0; i < num_lines; i++)
+    {
+        printf("%s", "\n");
+    }
+}
+
+/**
+ * Reads the monotonic clock in nanoseconds.
+ * 
+ * CLOCK_MONOTONIC is unaffected by wall-clock adjustments, so differences 
+ * between two readings are always valid stage durations.
+ * 
+ * @return The current CLOCK_MONOTONIC time in nanoseconds.
+ */
+uint64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Allocates the trace ring's event storage from the run arena.
+ * 
+ * @param arena The run arena.
+ * @param capacity The number of events the ring keeps.
+ * @return 0 on success, -1 if the arena cannot hold the ring.
+ */
+int trace_init(Arena *arena, size_t capacity)
+{
+    trace_ring.events = (TraceEvent *)arena_alloc(arena, capacity * sizeof(TraceEvent));
+    trace_ring.capacity = capacity;
+    return trace_ring.events == NULL ? -1 : 0;
+}
+
+/**
+ * Records one stage of a sampling tick into the fixed trace ring.
+ * 
+ * The stage is assumed to have started at `start_ns` and to end now. The ring 
+ * never grows: once its capacity of events has been recorded, the oldest 
+ * events are overwritten. The end timestamp is returned so that consecutive 
+ * stages can be chained without reading the clock twice:
+ * 
+ *      t = trace_stage("memory", t, tick);
+ *      t = trace_stage("cpu", t, tick);
+ * 
+ * @param name The stage name (must be a string literal or otherwise outlive the run).
+ * @param start_ns The CLOCK_MONOTONIC timestamp at which the stage began.
+ * @param tick The index of the sample the stage belongs to.
+ * @return The CLOCK_MONOTONIC timestamp at which the stage ended.
+ */
+uint64_t trace_stage(const char *name, uint64_t start_ns, int tick)
+{
+    uint64_t end_ns = monotonic_ns();
+    TraceEvent *event = &trace_ring.events[trace_ring.head % trace_ring.capacity];
+    event->name = name;
+    event->start_ns = start_ns;
+    event->dur_ns = end_ns - start_ns;
+    event->tick = tick;
+    trace_ring.head++;
+    return end_ns;
+}
+
+/**
+ * Records the cold start time: from entry to main() until the first frame 
+ * has been flushed to the terminal.
+ * 
+ * @param start_ns The CLOCK_MONOTONIC timestamp taken on entry to main().
+ * @param first_frame_ns The CLOCK_MONOTONIC timestamp at which the first frame was flushed.
+ */
+void trace_startup(uint64_t start_ns, uint64_t first_frame_ns)
+{
+    trace_ring.startup_ns = first_frame_ns - start_ns;
+    TraceEvent *event = &trace_ring.events[trace_ring.head % trace_ring.capacity];
+    event->name = "startup";
+    event->start_ns = start_ns;
+    event->dur_ns = trace_ring.startup_ns;
+    event->tick = -1;
+    trace_ring.head++;
+}
+
+/**
+ * Adds the latency of one complete tick (collectors through flush) to the 
+ * tick latency histogram.
+ * 
+ * Buckets are powers of two in microseconds. A tick whose work takes longer 
+ * than the sampling interval is counted as a budget overrun, since it delays 
+ * every sample that follows it.
+ * 
+ * @param start_ns The CLOCK_MONOTONIC timestamp at which the tick began.
+ * @param end_ns The CLOCK_MONOTONIC timestamp at which the tick was flushed.
+ * @param budget_us The tick budget (the sampling interval) in microseconds.
+ */
+void trace_tick(uint64_t start_ns, uint64_t end_ns, unsigned long budget_us)
+{
+    uint64_t dur_ns = end_ns - start_ns;
+    uint64_t dur_us = dur_ns / 1000;
+    int bucket = 0;
+    while (dur_us > 1 && bucket < TICK_HISTOGRAM_BUCKETS - 1)
+    {
+        dur_us >>= 1;
+        bucket++;
+    }
+    trace_ring.tick_histogram[bucket]++;
+    trace_ring.ticks++;
+    if (dur_ns > trace_ring.max_tick_ns)
+    {
+        trace_ring.max_tick_ns = dur_ns;
+    }
+    if (dur_ns / 1000 > budget_us)
+    {
+        trace_ring.overruns++;
+    }
+}
+
+/**
+ * Prints the tick latency histogram to stderr.
+ * 
+ * Each non-empty bucket is printed as its microsecond range, the number of 
+ * ticks that fell into it and a bar proportional to that count.
+ * 
+ * @param budget_us The tick budget (the sampling interval) in microseconds.
+ */
+void print_tick_histogram(unsigned long budget_us)
+{
+    unsigned long largest = 0;
+    for (int i = 0; i < TICK_HISTOGRAM_BUCKETS; i++)
+    {
+        if (trace_ring.tick_histogram[i] > largest)
+        {
+            largest = trace_ring.tick_histogram[i];
+        }
+    }
+    fprintf(stderr, "Cold start to first frame: %.2f ms%s\n", trace_ring.startup_ns / 1000000.0,
+            trace_ring.startup_ns / 1000 > STARTUP_BUDGET_US ? " (over the startup budget)" : "");
+    fprintf(stderr, "Tick latency (%lu ticks, max %.1f us, %lu over the %lu us budget):\n",
+            trace_ring.ticks, trace_ring.max_tick_ns / 1000.0, trace_ring.overruns, budget_us);
+    for (int i = 0; i < TICK_HISTOGRAM_BUCKETS; i++)
+    {
+        if (trace_ring.tick_histogram[i] == 0)
+        {
+            continue;
+        }
+        int bar = (int)(trace_ring.tick_histogram[i] * 40 / largest);
+        fprintf(stderr, "  %8lu - %8lu us %6lu ", i == 0 ? 0UL : 1UL << i, (1UL << (i + 1)) - 1, trace_ring.tick_histogram[i]);
+        for (int j = 0; j < bar; j++)
+        {
+            fputc('#', stderr);
+        }
+        fputc('\n', stderr);
+    }
+}
+
+/**
+ * Writes the contents of the trace ring as Chrome trace-event JSON.
+ * 
+ * Every recorded stage becomes a complete ("ph":"X") event on a single thread 
+ * track, with timestamps in microseconds relative to the oldest event still 
+ * held in the ring. The file can be opened directly in chrome://tracing or 
+ * the Perfetto UI to see which stage of which tick blew the budget.
+ * 
+ * @param path The file to write the trace to.
+ * @return 0 on success, -1 if the file cannot be written.
+ */
+int export_chrome_trace(const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Error: cannot open trace file %s\n", path);
+        return -1;
+    }
+
+    unsigned long count = trace_ring.head < trace_ring.capacity ? trace_ring.head : trace_ring.capacity;
+    unsigned long first = trace_ring.head - count;
+    uint64_t origin_ns = count > 0 ? trace_ring.events[first % trace_ring.capacity].start_ns : 0;
+    int pid = (int)getpid();
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":1,\"args\":{\"name\":\"sysmon\"}}", pid);
+    for (unsigned long i = first; i < trace_ring.head; i++)
+    {
+        const TraceEvent *event = &trace_ring.events[i % trace_ring.capacity];
+        fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"tick\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":1,\"args\":{\"tick\":%d}}",
+                event->name, (event->start_ns - origin_ns) / 1000.0, event->dur_ns / 1000.0, pid, event->tick);
+    }
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    if (fclose(fp) != 0)
+    {
+        fprintf(stderr, "Error: Failed to close file\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Reads the current and peak resident set size of this process.
+ * 
+ * @param rss Receives VmRSS in bytes.
+ * @param peak Receives VmHWM (the high-water mark) in bytes; may be NULL.
+ * @return 0 on success, -1 if `/proc/self/status` cannot be read.
+ */
+int read_self_memory(size_t *rss, size_t *peak)
+{
+    char input_string[256];
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    unsigned long kb;
+    while (fgets(input_string, sizeof(input_string), fp))
+    {
+        if (sscanf(input_string, "VmRSS: %lu kB", &kb) == 1)
+        {
+            *rss = kb * 1024;
+        }
+        else if (peak != NULL && sscanf(input_string, "VmHWM: %lu kB", &kb) == 1)
+        {
+            *peak = kb * 1024;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+/**
+ * Computes the run arena bytes needed by a process table of a given capacity: 
+ * the pid hash (at least twice the capacity, rounded up to a power of two), 
+ * both group aggregate tables and the interned string pool.
+ * 
+ * @param capacity The number of processes tracked.
+ * @return The bytes the table takes from the run arena.
+ */
+size_t process_table_size(size_t capacity)
+{
+    size_t slot_count = 16;
+    while (slot_count < capacity * 2)
+    {
+        slot_count *= 2;
+    }
+    return sizeof(ProcTable) + slot_count * sizeof(ProcEntry) + 2 * GROUP_SLOTS * sizeof(GroupStat) +
+           PROC_STRING_POOL + PROC_STRING_SLOTS * sizeof(uint32_t) + (MAX_TOP + 1) * (PROCS_PANEL_WIDTH + 1);
+}
+
+/**
+ * Returns the run arena space taken by a cgroup tree of a given capacity, 
+ * including its panel.
+ * 
+ * @param capacity The number of cgroups tracked.
+ * @return The bytes the tree takes from the run arena.
+ */
+size_t cgroup_tree_size(size_t capacity)
+{
+    return sizeof(CgroupTree) + capacity * sizeof(CgroupNode) + (CGROUP_ROWS + 1) * (CGROUPS_PANEL_WIDTH + 1);
+}
+
+/**
+ * Returns the number of sub-samples a capture keeps: the pre-trigger window 
+ * plus the post-trigger window at the capture rate.
+ * 
+ * @param argsInfo The parsed command-line arguments.
+ * @return The capacity of the capture ring, 0 without `--trigger`.
+ */
+size_t capture_capacity(const ArgsInfo *argsInfo)
+{
+    if (argsInfo->trigger_metric == -1)
+    {
+        return 0;
+    }
+    return (argsInfo->capture_pre_ms + argsInfo->capture_post_ms) * 1000 / argsInfo->capture_rate + 1;
+}
+
+/**
+ * Sizes the per-run buffers so that the whole process fits in the memory budget.
+ * 
+ * Without a budget the defaults are used: a history ring as long as the 
+ * sample count (`MAX_HISTORY` when running a command, whose length is unknown), a `TRACE_RING_SIZE` trace ring, a 
+ * `PROCESS_CAPACITY` process table and a `CGROUP_CAPACITY` cgroup tree (when 
+ * enabled), a `STDOUT_BUFFER_SIZE` output buffer and the `--flight` ring. With 
+ * `--max-rss`, the resident set measured before any per-run state exists is 
+ * subtracted from the budget along with a fixed headroom for the stack and 
+ * libc, and the history, flight ring (down to one minute), trace ring, process 
+ * table, cgroup tree and output buffer are halved in turn until everything fits. A budget that 
+ * cannot hold even the minimum sizes is refused rather than risking an OOM kill 
+ * halfway through a run.
+ * 
+ * Every series is assumed to need a history ring, so the plan stays valid 
+ * whichever collectors end up enabled. With `--control` the tables and panels 
+ * of every compiled-in collector are planned for too, since any of them can 
+ * be enabled during the run.
+ * 
+ * @param argsInfo The parsed command-line arguments.
+ * @param plan Receives the sizes of every per-run buffer.
+ * @return 0 on success, -1 if the budget is too small.
+ */
+int plan_memory(ArgsInfo *argsInfo, MemoryPlan *plan)
+{
+    const size_t headroom = 512UL << 10;
+    const size_t min_history = 16;
+    const size_t min_trace = 256;
+    const size_t min_output = 4096;
+    const size_t min_processes = 256;
+    const size_t min_cgroups = 64;
+    size_t fixed = sizeof(ArgsInfo) + sizeof(Monitor) + 4096; // structures plus alignment slack
+
+    plan->budget = argsInfo->max_rss;
+    plan->baseline = 0;
+    read_self_memory(&plan->baseline, NULL);
+    plan->history_capacity = argsInfo->samples < MAX_HISTORY && argsInfo->command == NULL ? (size_t)argsInfo->samples : MAX_HISTORY;
+    plan->trace_capacity = TRACE_RING_SIZE;
+    // With --control any compiled-in collector can be enabled later, so every one of them is planned for
+    bool reconfigurable = argsInfo->control_path != NULL;
+    plan->process_capacity = SYSMON_WITH_PROCS && (argsInfo->procs_flag || reconfigurable) ? PROCESS_CAPACITY : 0;
+    plan->cgroup_capacity = SYSMON_WITH_CGROUPS && (argsInfo->cgroups_flag || reconfigurable) ? CGROUP_CAPACITY : 0;
+    size_t panels = (SYSMON_WITH_MEMORY && (argsInfo->writeback_flag || reconfigurable) ? 3 * (WRITEBACK_PANEL_WIDTH + 1) : 0) +
+                    (SYSMON_WITH_CGROUPS && (argsInfo->memcg_flag || reconfigurable) ? (1 + MAX_SELECTED_CGROUPS) * (MEMCG_PANEL_WIDTH + 1) : 0) +
+                    (SYSMON_WITH_DISKS && (argsInfo->disks_flag || reconfigurable) ? (1 + MAX_DISKS) * (DISKS_PANEL_WIDTH + 1) : 0);
+    bool cstates = SYSMON_WITH_CORES && (argsInfo->cstates_flag || reconfigurable);
+    // A frame chunk fits a scrolling graph's redraw (blank rows, plot and axis, about 96 bytes a column)
+    size_t graph_redraw = (size_t)(argsInfo->samples < MAX_HISTORY ? argsInfo->samples : MAX_HISTORY) * 96;
+    plan->output_size = graph_redraw > STDOUT_BUFFER_SIZE ? graph_redraw : STDOUT_BUFFER_SIZE;
+    plan->scratch_size = SCRATCH_ARENA_SIZE;
+    // The flight ring is a shared file mapping, resident once it wraps, so it counts against the budget
+    unsigned long tdelay = argsInfo->tdelay > 0 ? argsInfo->tdelay : 1;
+    size_t min_flight = 60000000UL / tdelay > 0 ? 60000000UL / tdelay : 1; // one minute
+    size_t flight_ticks = (size_t)argsInfo->flight_minutes * 60000000UL / tdelay;
+    plan->flight_ticks = argsInfo->flight_file == NULL ? 0 : flight_ticks > 0 ? flight_ticks : 1;
+    size_t flight_tick_size = (MAX_SERIES + RECORD_VALUES - 1) / RECORD_VALUES * sizeof(RecordEntry);
+
+    size_t total;
+    for (;;)
+    {
+        plan->run_size = fixed + panels + 3 * plan->output_size + plan->trace_capacity * sizeof(TraceEvent) +
+                         MAX_SERIES * plan->history_capacity * sizeof(float) +
+                         (plan->process_capacity > 0 ? process_table_size(plan->process_capacity) : 0) +
+                         (plan->cgroup_capacity > 0 ? cgroup_tree_size(plan->cgroup_capacity) : 0) +
+                         capture_capacity(argsInfo) * (sizeof(CaptureSample) + sizeof(RecordEntry)) +
+                         (argsInfo->trigger_metric != -1 ? RECORD_HEADER_SIZE : 0) +
+                         (argsInfo->web_address != NULL ? MAX_WEB_CLIENTS * WEB_QUEUE_SIZE + WEB_FRAME_SIZE : 0) +
+                         (argsInfo->export_trace_file != NULL ? EXPORT_CHUNK_SIZE + 2 * EXPORT_MAX_CPUS * sizeof(uint64_t) : 0) +
+                         (cstates ? CSTATE_MAX_CPUS * sizeof(CoreResidency) +
+                                                       (CSTATE_MAX_CPUS + 2) * (CSTATES_PANEL_WIDTH + 1) : 0);
+        total = plan->baseline + headroom + plan->run_size + plan->scratch_size +
+                (plan->flight_ticks > 0 ? RECORD_HEADER_SIZE + plan->flight_ticks * flight_tick_size : 0);
+        if (plan->budget == 0 || total <= plan->budget)
+        {
+            return 0;
+        }
+        if (plan->history_capacity > min_history)
+        {
+            plan->history_capacity /= 2;
+        }
+        else if (plan->flight_ticks > min_flight)
+        {
+            plan->flight_ticks = plan->flight_ticks / 2 > min_flight ? plan->flight_ticks / 2 : min_flight;
+        }
+        else if (plan->trace_capacity > min_trace)
+        {
+            plan->trace_capacity /= 2;
+        }
+        else if (plan->process_capacity > min_processes)
+        {
+            plan->process_capacity /= 2;
+        }
+        else if (plan->cgroup_capacity > min_cgroups)
+        {
+            plan->cgroup_capacity /= 2;
+        }
+        else if (plan->output_size > min_output)
+        {
+            plan->output_size /= 2;
+        }
+        else
+        {
+            fprintf(stderr, "Error: --max-rss budget of %zu KiB cannot fit the minimum configuration (%zu KiB needed)\n",
+                    plan->budget >> 10, total >> 10);
+            return -1;
+        }
+    }
+}
+
+/**
+ * Shares the open file limit between the collectors that keep a descriptor 
+ * per tracked object.
+ * 
+ * The soft limit is raised to the hard one, once. Descriptors are first set 
+ * aside for the fixed ones: stdio, the /proc files of the base collectors, 
+ * recordings and exports, and, when enabled (or enabling is possible through 
+ * `--control`), cstates (up to 9 per CPU), writeback, memcg, throttle, disks 
+ * and the web and control clients. What is left is the process table's (3 per 
+ * process) and the cgroup tree's (2 per cgroup), and when it cannot hold both 
+ * planned capacities, each is cut in proportion to what it asked for.
+ * 
+ * @param argsInfo The parsed command-line arguments.
+ * @param plan The memory plan whose process and cgroup capacities are limited.
+ */
+void plan_descriptors(const ArgsInfo *argsInfo, MemoryPlan *plan)
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == -1)
+    {
+        return;
+    }
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur == RLIM_INFINITY)
+    {
+        return;
+    }
+
+    bool reconfigurable = argsInfo->control_path != NULL;
+    long possible = sysconf(_SC_NPROCESSORS_CONF);
+    size_t cpus = possible > 0 && possible < CSTATE_MAX_CPUS ? (size_t)possible : CSTATE_MAX_CPUS; // as cstates_setup
+    size_t reserved = 64 +
+                      (SYSMON_WITH_CORES && (argsInfo->cstates_flag || reconfigurable) ? cpus * (MAX_IDLE_STATES + 1) : 0) +
+                      (SYSMON_WITH_MEMORY && (argsInfo->writeback_flag || reconfigurable) ? 6 : 0) +
+                      (SYSMON_WITH_CGROUPS && (argsInfo->memcg_flag || reconfigurable) ? 5 * MAX_SELECTED_CGROUPS : 0) +
+                      (SYSMON_WITH_CGROUPS && (argsInfo->throttle_flag || reconfigurable) ? MAX_SELECTED_CGROUPS : 0) +
+                      (SYSMON_WITH_DISKS && (argsInfo->disks_flag || reconfigurable) ? MAX_DISKS + 1 : 0) +
+                      (argsInfo->web_address != NULL ? MAX_WEB_CLIENTS + 1 : 0) +
+                      (reconfigurable ? MAX_CONTROL_CLIENTS + 1 : 0);
+    size_t available = limit.rlim_cur > reserved ? limit.rlim_cur - reserved : 0;
+    size_t wanted = 3 * plan->process_capacity + 2 * plan->cgroup_capacity;
+    if (wanted > available)
+    {
+        plan->process_capacity = (size_t)((double)plan->process_capacity * available / wanted);
+        plan->cgroup_capacity = (size_t)((double)plan->cgroup_capacity * available / wanted);
+    }
+}
+
+/**
+ * Prints the monitor's own memory use against its budget to stderr.
+ * 
+ * Reported are the actual and peak resident set, the budget, how much of each 
+ * arena was used, and the buffer sizes the plan settled on, so a run that came 
+ * close to its budget can be seen before it becomes an OOM kill.
+ * 
+ * @param plan The memory plan the run was sized with.
+ */
+void print_self_stats(const MemoryPlan *plan)
+{
+    size_t rss = 0;
+    size_t peak = 0;
+    read_self_memory(&rss, &peak);
+    fprintf(stderr, "Self memory: rss %.1f MiB (peak %.1f MiB)", rss / 1048576.0, peak / 1048576.0);
+    if (plan->budget > 0)
+    {
+        fprintf(stderr, " of %.1f MiB budget%s", plan->budget / 1048576.0, peak > plan->budget ? " (OVER BUDGET)" : "");
+    }
+    fprintf(stderr, "\n  run arena %zu/%zu KiB, scratch arena %zu/%zu KiB\n",
+            run_arena.peak >> 10, plan->run_size >> 10, scratch_arena.peak >> 10, plan->scratch_size >> 10);
+    fprintf(stderr, "  history %zu samples/series, trace ring %zu events, process table %zu, cgroup tree %zu, output buffer %zu KiB\n",
+            plan->history_capacity, plan->trace_capacity, plan->process_capacity, plan->cgroup_capacity, plan->output_size >> 10);
+    if (plan->flight_ticks > 0)
+    {
+        fprintf(stderr, "  flight ring %zu ticks\n", plan->flight_ticks);
+    }
+}
+
+/**
+ * Opens a /proc (or /sys) file once so that it can be re-read every tick.
+ * 
+ * Keeping the descriptor open avoids an open/close pair and the stdio `FILE` 
+ * allocation on every sample; the kernel regenerates the contents on each 
+ * pread() from offset 0.
+ * 
+ * @param file The structure that receives the path and descriptor.
+ * @param path The file to open.
+ * @return 0 on success, -1 if the file cannot be opened.
+ */
+int open_proc_file(ProcFile *file, const char *path)
+{
+    file->path = path;
+    file->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (file->fd == -1)
+    {
+        fprintf(stderr, "Error: Failed opening %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Reads the current contents of an open /proc file into the scratch arena.
+ * 
+ * At most `max_len` bytes are read, which is enough for files whose useful 
+ * data sits at the start (such as the aggregate "cpu" line of /proc/stat). 
+ * The returned buffer is NUL-terminated and lives until the scratch arena is 
+ * reset at the start of the next tick.
+ * 
+ * @param file The file opened with `open_proc_file`.
+ * @param scratch The per-tick scratch arena.
+ * @param max_len The maximum number of bytes to read.
+ * @return The file contents, or NULL if the read fails or the arena is exhausted.
+ */
+char *read_proc_file(ProcFile *file, Arena *scratch, size_t max_len)
+{
+    char *buffer = (char *)arena_alloc(scratch, max_len + 1);
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
+    ssize_t len = pread(file->fd, buffer, max_len, 0);
+    if (len < 0)
+    {
+        return NULL;
+    }
+    buffer[len] = '\0';
+    return buffer;
+}
+
+/**
+ * Finds the value of a "key value" line, the format of cpu.stat, memory.stat, 
+ * memory.events and /proc/vmstat.
+ * 
+ * @param text The file contents.
+ * @param key The key, e.g. "nr_throttled".
+ * @param value Receives the value.
+ * @return `true` if the key is present.
+ */
+bool keyed_value(const char *text, const char *key, uint64_t *value)
+{
+    size_t len = strlen(key);
+    for (const char *line = text; line != NULL && *line != '\0'; line = strchr(line, '\n'), line = line != NULL ? line + 1 : NULL)
+    {
+        if (strncmp(line, key, len) == 0 && line[len] == ' ')
+        {
+            *value = strtoull(line + len + 1, NULL, 10);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Reads a decimal counter from a sysfs file kept open.
+ * 
+ * @param fd The file descriptor.
+ * @return The counter, or 0 if it cannot be read.
+ */
+uint64_t read_counter(int fd)
+{
+    char buffer[32];
+    ssize_t len = fd != -1 ? pread(fd, buffer, sizeof(buffer) - 1, 0) : -1;
+    if (len <= 0)
+    {
+        return 0;
+    }
+    buffer[len] = '\0';
+    return strtoull(buffer, NULL, 10);
+}
+
+/**
+ * Gets the total memory using 'sysinfo()'
+ * This function fetches the total RAM available in the system 
+ * and converts it from bytes to gigabytes.
+ * 
+ * @return The total system memory in gigabytes as a long double.
+ *         Exits the program if `sysinfo()` fails.
+ */
+long double get_total_memory()
+{
+    struct sysinfo info;
+    if (sysinfo(&info) == -1)
+    {
+        fprintf(stderr, "Error: Cannot read system memory information\n");
+        exit(1);
+    }
+    long double total_memory = (info.totalram * info.mem_unit) / (1024.0 * 1024.0 * 1024.0); 
+    if(total_memory < 0){
+        fprintf(stderr,"Error:Total memory cannot be negative\n");
+    }
+    return total_memory;
+}
+
+/**
+ * Calculates the CPU utilization percentage over time.
+ * 
+ * This function reads CPU time statistics from `/proc/stat` (kept open in 
+ * `stat_file` and read into the scratch arena) and calculates the 
+ * CPU utilization using the following method:
+ * 
+ * 1. **Total CPU Utilization Time** (Tᵢ) is computed as:
+ *      Tᵢ = user + nice + system + idle + iowait + irq + softirq + steal;
+ * 
+ * 2. **Idle Time** (Iᵢ) consists of:
+ *      Iᵢ = idle + iowait;
+ * 
+ * 3. **CPU Usage Time** (Uᵢ) at time i is determined by:
+ *      Uᵢ = Tᵢ - Iᵢ;
+ * 
+ * 4. **CPU Utilization Calculation**:
+ *    The CPU utilization between two sampling times is given by:
+ * 
+ *        CPU Utilization (%) = ((U₂ - U₁) / (T₂ - T₁)) * 100;
+ * 
+ *    Where:
+ *    - **T₁, I₁, U₁** represent total, idle, and usage times at the first sampling.
+ *    - **T₂, I₂, U₂** represent total, idle, and usage times at the second sampling.
+ *    - **U₂ - U₁** is the change in CPU usage.
+ *    - **T₂ - T₁** is the change in total CPU time.
+ * 
+ * The function updates the previous total and idle CPU values for subsequent calculations.
+ * 
+ * @param stat_file The open `/proc/stat` file.
+ * @param scratch The per-tick scratch arena the file is read into.
+ * @param preTotalCPU A pointer to store the previous total CPU time.
+ * @param preIdleCPU A pointer to store the previous idle CPU time.
+ * @param finalTotalCPU A pointer to store the current total CPU time.
+ * @param finalIdleCPU A pointer to store the current idle CPU time.
+ * @return The CPU utilization as a percentage. Returns 0 if no valid data is available.
+ */
+long double calculate_cpu_utilization(ProcFile *stat_file, Arena *scratch, long double *preTotalCPU, long double *preIdleCPU, long double *finalTotalCPU, long double *finalIdleCPU)
+{
+    char input_string[16];
+    long double user, nice, system, idle, iowait, irq, softirq, steal;
+
+    char *contents = read_proc_file(stat_file, scratch, PROC_READ_SIZE);
+    if (contents == NULL)
+    {
+        fprintf(stderr, "Error: Failed reading /proc/stat\n");
+        return 0;
+    }
+
+    if (sscanf(contents, "%15s %Lf %Lf %Lf %Lf %Lf %Lf %Lf %Lf",
+               input_string, &user, &nice, &system, &idle,
+               &iowait, &irq, &softirq, &steal) != 9)
+    {
+        fprintf(stderr, "Error: Failed parsing /proc/stat\n");
+        return 0;
+    }
+
+    // Compute total and idle CPU times
+    long double currentTotalCPU = user + nice + system + idle + iowait + irq + softirq + steal;
+    long double currentIdleCPU = idle + iowait;
+
+    // First run initialization
+    if (*preTotalCPU == 0 && *preIdleCPU == 0)
+    {
+        *preTotalCPU = currentTotalCPU;
+        *preIdleCPU = currentIdleCPU;
+        return 0;
+    }
+
+    long double U_initial = *preTotalCPU - *preIdleCPU;
+    *finalTotalCPU = currentTotalCPU;
+    *finalIdleCPU = currentIdleCPU;
+    long double U_final = *finalTotalCPU - *finalIdleCPU;
+
+    // Compute deltas
+    long double delta_total = U_final - U_initial;
+    long double delta_idle = *finalTotalCPU - *preTotalCPU;
+
+    // Update stored values for next iteration
+    *preTotalCPU = currentTotalCPU;
+    *preIdleCPU = currentIdleCPU;
+
+    if (delta_total == 0 || delta_idle == 0)
+    {
+        return 0;
+    }
+    return (delta_total / delta_idle) * 100.0;
+}
+
+/**
+ * Calculates the amount of free memory available in the system.
+ * 
+ * This function uses 'sysinfo()' to retrieve the "freeram" value, 
+ * converts it from kilobytes to gigabytes, and subtracts it from total memory 
+ * and then returns the available memory.
+ * 
+ * @return The amount of used system memory in gigabytes as a long double.
+ *         Returns 0 if the sysinfo() fails.
+ */
+long double calculate_memory_used()
+{
+    struct sysinfo info;
+    if (sysinfo(&info) == -1)
+    {
+        fprintf(stderr, "Error: Cannot read memory used file\n");
+        return 0;
+    }
+    long double freeMemory = (info.freeram * info.mem_unit)/(1024.0 * 1024.0 * 1024.0);
+    return (get_total_memory()- freeMemory);
+}
+
+/**
+ * Retrieves the maximum CPU frequency from the system.
+ * 
+ * This function reads the `/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq` 
+ * file to determine the highest supported CPU frequency, converting it from 
+ * kilohertz to gigahertz.
+ * 
+ * @return The maximum CPU frequency in gigahertz as a long double.
+ *         Returns 0 if the file cannot be accessed.
+ */
+long double calculate_max_frequency()
+{ 
+    FILE *fp = fopen("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq", "r");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Error reading the file\n");
+        return 0;
+    }
+    long double max_freq;
+    if (fscanf(fp, "%Lf", &max_freq) == 1)
+    {
+        fclose(fp);
+        return max_freq / 1000000;
+    }
+    else
+    {
+        fclose(fp);
+        fprintf(stderr, "Error: failed to calculate max frequency\n");
+        exit(1);
+    }
+}
+
+/**
+ * Counts the CPUs listed in a kernel CPU list such as "0-3,8,10-11".
+ * 
+ * This is the format of `/sys/devices/system/cpu/online` and the other 
+ * cpumask files under `/sys/devices/system/cpu`.
+ * 
+ * @param list The NUL-terminated CPU list.
+ * @return The number of CPUs in the list, or -1 if the list is malformed.
+ */
+int count_cpu_list(const char *list)
+{
+    int count = 0;
+    while (*list != '\0' && *list != '\n')
+    {
+        char *endptr;
+        long first = strtol(list, &endptr, 10);
+        if (endptr == list)
+        {
+            return -1;
+        }
+        long last = first;
+        if (*endptr == '-')
+        {
+            list = endptr + 1;
+            last = strtol(list, &endptr, 10);
+            if (endptr == list || last < first)
+            {
+                return -1;
+            }
+        }
+        count += (int)(last - first + 1);
+        list = endptr;
+        if (*list == ',')
+        {
+            list++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Counts the number of CPU cores available on the system.
+ * 
+ * The count comes from `sysconf(_SC_NPROCESSORS_ONLN)`, falling back to 
+ * parsing `/sys/devices/system/cpu/online` directly. Both are a few bytes 
+ * regardless of the machine size, unlike `/proc/cpuinfo`, which grows to 
+ * megabytes on hosts with hundreds of CPUs and on some kernels queries the 
+ * current frequency of every CPU while it is being generated. Per-CPU 
+ * topology is not read here; panels that need it load it on first use.
+ * 
+ * @return The total number of online logical CPU cores.
+ *         Returns -1 if neither source is available.
+ */
+int calculate_cores()
+{
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online > 0)
+    {
+        return (int)online;
+    }
+
+    char input_string[1024];
+    int fd = open("/sys/devices/system/cpu/online", O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        fprintf(stderr, "Error reading the file\n");
+        return -1;
+    }
+    ssize_t len = read(fd, input_string, sizeof(input_string) - 1);
+    close(fd);
+    if (len <= 0)
+    {
+        fprintf(stderr, "Error reading the file\n");
+        return -1;
+    }
+    input_string[len] = '\0';
+    return count_cpu_list(input_string);
+}
+
+/**
+ * Adds a series to the monitor and gives it a history ring from the run arena.
+ * 
+ * @param monitor The monitor the series belongs to.
+ * @param name The metric name, e.g. "cpu".
+ * @param label The graph title.
+ * @param unit The unit printed next to the latest value.
+ * @return The new series, or NULL if the series table or the run arena is full.
+ */
+Series *add_series(Monitor *monitor, const char *name, const char *label, const char *unit)
+{
+    if (monitor->series_count == MAX_SERIES)
+    {
+        fprintf(stderr, "Error: too many series\n");
+        return NULL;
+    }
+    Series *series = &monitor->series[monitor->series_count];
+    series->history = (float *)arena_alloc(&run_arena, monitor->history_capacity * sizeof(float));
+    if (series->history == NULL)
+    {
+        fprintf(stderr, "Error: cannot allocate history for %s\n", name);
+        return NULL;
+    }
+    series->capacity = monitor->history_capacity;
+    series->name = name;
+    series->label = label;
+    series->unit = unit;
+    series->glyph = '#';
+    series->gap = 2;
+    monitor->series_count++;
+    return series;
+}
+
+/**
+ * Appends a series' latest value to its history ring.
+ * 
+ * @param series The series to update.
+ */
+void series_push(Series *series)
+{
+    series->history[series->count % series->capacity] = (float)series->value;
+    series->count++;
+}
+
+/**
+ * Folds a run of floats into a reduction with plain C, skipping NaN gaps. 
+ * Used on CPUs without SSE2 and for the tails the vector kernels leave.
+ * 
+ * @param values The floats.
+ * @param count The number of floats.
+ * @param out The reduction to fold into.
+ */
+void reduce_scalar(const float *values, size_t count, Reduction *out)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        float value = values[i];
+        if (value != value)
+        {
+            continue;
+        }
+        out->min = value < out->min ? value : out->min;
+        out->max = value > out->max ? value : out->max;
+        out->sum += value;
+        out->count++;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * Folds a run of floats into a reduction four lanes at a time. NaN lanes are 
+ * masked out with an ordered self-comparison: they become +inf for the 
+ * minimum, -inf for the maximum and 0 for the sum.
+ * 
+ * @param values The floats.
+ * @param count The number of floats.
+ * @param out The reduction to fold into.
+ */
+__attribute__((target("sse2"))) void reduce_sse2(const float *values, size_t count, Reduction *out)
+{
+    __m128 lo = _mm_set1_ps(__builtin_inff());
+    __m128 hi = _mm_set1_ps(-__builtin_inff());
+    __m128 sum = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 counted = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 v = _mm_loadu_ps(values + i);
+        __m128 valid = _mm_cmpord_ps(v, v);
+        lo = _mm_min_ps(lo, _mm_or_ps(_mm_and_ps(valid, v), _mm_andnot_ps(valid, _mm_set1_ps(__builtin_inff()))));
+        hi = _mm_max_ps(hi, _mm_or_ps(_mm_and_ps(valid, v), _mm_andnot_ps(valid, _mm_set1_ps(-__builtin_inff()))));
+        sum = _mm_add_ps(sum, _mm_and_ps(valid, v));
+        counted = _mm_add_ps(counted, _mm_and_ps(valid, one));
+    }
+    float lanes[4][4];
+    _mm_storeu_ps(lanes[0], lo);
+    _mm_storeu_ps(lanes[1], hi);
+    _mm_storeu_ps(lanes[2], sum);
+    _mm_storeu_ps(lanes[3], counted);
+    for (int lane = 0; lane < 4; lane++)
+    {
+        out->min = lanes[0][lane] < out->min ? lanes[0][lane] : out->min;
+        out->max = lanes[1][lane] > out->max ? lanes[1][lane] : out->max;
+        out->sum += lanes[2][lane];
+        out->count += (size_t)lanes[3][lane];
+    }
+    reduce_scalar(values + i, count - i, out);
+}
+
+/**
+ * Folds a run of floats into a reduction eight lanes at a time, masking NaN 
+ * gaps the same way as `reduce_sse2`.
+ * 
+ * @param values The floats.
+ * @param count The number of floats.
+ * @param out The reduction to fold into.
+ */
+__attribute__((target("avx2"))) void reduce_avx2(const float *values, size_t count, Reduction *out)
+{
+    const __m256 inf = _mm256_set1_ps(__builtin_inff());
+    const __m256 minus_inf = _mm256_set1_ps(-__builtin_inff());
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 lo = inf;
+    __m256 hi = minus_inf;
+    __m256 sum = _mm256_setzero_ps();
+    __m256 counted = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 v = _mm256_loadu_ps(values + i);
+        __m256 valid = _mm256_cmp_ps(v, v, _CMP_ORD_Q);
+        lo = _mm256_min_ps(lo, _mm256_blendv_ps(inf, v, valid));
+        hi = _mm256_max_ps(hi, _mm256_blendv_ps(minus_inf, v, valid));
+        sum = _mm256_add_ps(sum, _mm256_and_ps(valid, v));
+        counted = _mm256_add_ps(counted, _mm256_and_ps(valid, one));
+    }
+    float lanes[4][8];
+    _mm256_storeu_ps(lanes[0], lo);
+    _mm256_storeu_ps(lanes[1], hi);
+    _mm256_storeu_ps(lanes[2], sum);
+    _mm256_storeu_ps(lanes[3], counted);
+    for (int lane = 0; lane < 8; lane++)
+    {
+        out->min = lanes[0][lane] < out->min ? lanes[0][lane] : out->min;
+        out->max = lanes[1][lane] > out->max ? lanes[1][lane] : out->max;
+        out->sum += lanes[2][lane];
+        out->count += (size_t)lanes[3][lane];
+    }
+    reduce_scalar(values + i, count - i, out);
+}
+#endif
+
+/**
+ * Picks the widest reduction kernel the CPU supports.
+ * 
+ * @return The kernel.
+ */
+void (*select_reduce_kernel(void))(const float *, size_t, Reduction *)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return reduce_avx2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return reduce_sse2;
+    }
+#endif
+    return reduce_scalar;
+}
+
+/**
+ * Reduces a window of a series' history ring to its minimum, maximum, sum and 
+ * count, splitting the window where it wraps around the end of the ring. The 
+ * kernel is chosen on first use.
+ * 
+ * @param series The series.
+ * @param first The index of the first sample in the window, as counted by `series->count`.
+ * @param count The number of samples in the window, all still in the ring.
+ * @param out Receives the reduction; its count is 0 if every sample was a gap.
+ */
+void reduce_history(const Series *series, size_t first, size_t count, Reduction *out)
+{
+    static void (*kernel)(const float *, size_t, Reduction *) = NULL;
+    if (kernel == NULL)
+    {
+        kernel = select_reduce_kernel();
+    }
+    out->min = __builtin_inff();
+    out->max = -__builtin_inff();
+    out->sum = 0;
+    out->count = 0;
+    size_t start = first % series->capacity;
+    size_t head = series->capacity - start < count ? series->capacity - start : count;
+    kernel(series->history + start, head, out);
+    kernel(series->history, count - head, out);
+}
+
+/**
+ * Records an event, such as the start of a throttling burst, in the event 
+ * ring. Renderers show its description and mark it on the time axis of the 
+ * given graph.
+ * 
+ * @param monitor The monitor recording the event.
+ * @param series The series whose graph is marked (an overlay marks its base's graph), or NULL.
+ * @param glyph The marker character.
+ * @param format printf-style description of the event.
+ */
+void add_event(Monitor *monitor, Series *series, char glyph, const char *format, ...)
+{
+    Event *event = &monitor->events[monitor->event_count % EVENT_RING_SIZE];
+    event->t_ns = monotonic_ns();
+    event->tick = monitor->tick;
+    event->series = series != NULL && series->overlay_of != NULL ? series->overlay_of : series;
+    event->glyph = glyph;
+    event->marker = false;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(event->text, sizeof(event->text), format, args);
+    va_end(args);
+    monitor->event_count++;
+}
+
+/**
+ * Compares two floats for qsort.
+ * 
+ * @param a The first float.
+ * @param b The second float.
+ * @return A negative, zero or positive value as `a` is less, equal or greater.
+ */
+int compare_floats(const void *a, const void *b)
+{
+    float x = *(const float *)a;
+    float y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Computes the distribution of the samples held in a series' history ring.
+ * 
+ * Percentiles use the nearest-rank method over a sorted copy made in the 
+ * scratch arena. Only the samples still in the ring are considered, so for 
+ * runs longer than the ring this describes the most recent window.
+ * 
+ * @param series The series to summarize.
+ * @param scratch The arena the sorted copy is made in.
+ * @param summary Receives the distribution.
+ * @return 0 on success, -1 if the series is empty or the arena is exhausted.
+ */
+int summarize_series(const Series *series, Arena *scratch, SeriesSummary *summary)
+{
+    size_t count = series->count < series->capacity ? series->count : series->capacity;
+    float *sorted = (float *)arena_alloc(scratch, count * sizeof(float));
+    if (count == 0 || sorted == NULL)
+    {
+        return -1;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (series->history[i] == series->history[i])
+        {
+            sorted[kept++] = series->history[i]; // leave out gaps
+        }
+    }
+    if (kept == 0)
+    {
+        return -1;
+    }
+    count = kept;
+    qsort(sorted, count, sizeof(float), compare_floats);
+
+    double sum = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        sum += sorted[i];
+    }
+    summary->count = count;
+    summary->min = sorted[0];
+    summary->max = sorted[count - 1];
+    summary->mean = sum / count;
+    summary->p50 = sorted[(size_t)(0.50 * (count - 1) + 0.5)];
+    summary->p90 = sorted[(size_t)(0.90 * (count - 1) + 0.5)];
+    summary->p99 = sorted[(size_t)(0.99 * (count - 1) + 0.5)];
+    return 0;
+}
+
+/**
+ * Returns the histogram bucket of a value: the value's binary exponent and the 
+ * top bits of its mantissa, read straight from the double.
+ * 
+ * @param value The value.
+ * @return The bucket, from 0 to `RUN_BUCKETS - 1`.
+ */
+int run_bucket(double value)
+{
+    if (!(value > 0))
+    {
+        return 0;
+    }
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    long bucket = ((long)(bits >> 52) - (1023 - 32)) * RUN_SUB_BUCKETS + (long)((bits >> 48) & (RUN_SUB_BUCKETS - 1));
+    return bucket < 1 ? 1 : bucket > RUN_BUCKETS - 1 ? RUN_BUCKETS - 1 : (int)bucket;
+}
+
+/**
+ * Returns the value in the middle of a histogram bucket.
+ * 
+ * @param bucket The bucket.
+ * @return The value.
+ */
+double run_bucket_value(int bucket)
+{
+    if (bucket == 0)
+    {
+        return 0;
+    }
+    uint64_t bits = ((uint64_t)(bucket / RUN_SUB_BUCKETS + 1023 - 32) << 52) | ((uint64_t)(bucket % RUN_SUB_BUCKETS) << 48) | (1ULL << 47);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * Adds a sample to whole-run statistics: minimum, maximum, sum and histogram. 
+ * Gaps are left out.
+ * 
+ * @param stats The statistics.
+ * @param value The sample.
+ */
+void run_stats_add(RunStats *stats, double value)
+{
+    if (value != value)
+    {
+        return;
+    }
+    stats->min = stats->count == 0 || value < stats->min ? value : stats->min;
+    stats->max = stats->count == 0 || value > stats->max ? value : stats->max;
+    stats->sum += value;
+    stats->count++;
+    stats->histogram[run_bucket(value)]++;
+}
+
+/**
+ * Estimates a percentile over the whole run from the histogram, within the 
+ * run's minimum and maximum.
+ * 
+ * @param stats The statistics.
+ * @param fraction The percentile, e.g. 0.99.
+ * @return The estimate.
+ */
+double run_percentile(const RunStats *stats, double fraction)
+{
+    size_t rank = (size_t)(fraction * (stats->count - 1) + 0.5);
+    size_t seen = 0;
+    int bucket = 0;
+    while (bucket < RUN_BUCKETS - 1 && seen + stats->histogram[bucket] <= rank)
+    {
+        seen += stats->histogram[bucket++];
+    }
+    double value = run_bucket_value(bucket);
+    return value < stats->min ? stats->min : value > stats->max ? stats->max : value;
+}
+
+/**
+ * Computes the distribution of a series over the whole run. The minimum, 
+ * maximum and mean are exact; the percentiles are exact while the series' 
+ * history still holds every sample, and come from the histogram once it has 
+ * wrapped.
+ * 
+ * @param series The series.
+ * @param stats Its whole-run statistics.
+ * @param scratch The arena a sorted copy of the history is made in.
+ * @param summary Receives the distribution.
+ * @return 0 on success, -1 if the run has no samples.
+ */
+int summarize_run(const Series *series, const RunStats *stats, Arena *scratch, SeriesSummary *summary)
+{
+    if (stats->count == 0)
+    {
+        return -1;
+    }
+    bool whole = series->count <= series->capacity && summarize_series(series, scratch, summary) == 0;
+    if (!whole)
+    {
+        summary->p50 = run_percentile(stats, 0.50);
+        summary->p90 = run_percentile(stats, 0.90);
+        summary->p99 = run_percentile(stats, 0.99);
+    }
+    summary->count = stats->count;
+    summary->min = stats->min;
+    summary->max = stats->max;
+    summary->mean = stats->sum / stats->count;
+    return 0;
+}
+
+/**
+ * Adds a text panel to the monitor and allocates its lines from the run arena.
+ * 
+ * Text panels hold tables (such as the process table) that collectors rewrite 
+ * every tick and renderers print below the graphs.
+ * 
+ * @param monitor The monitor the panel belongs to.
+ * @param rows The number of text lines below the title.
+ * @param width The maximum width of a line.
+ * @return The new panel, or NULL if the panel table or the run arena is full.
+ */
+TextPanel *add_panel(Monitor *monitor, int rows, int width)
+{
+    if (monitor->panel_count == MAX_PANELS)
+    {
+        fprintf(stderr, "Error: too many panels\n");
+        return NULL;
+    }
+    TextPanel *panel = &monitor->panels[monitor->panel_count];
+    panel->text = (char *)arena_alloc(&run_arena, (size_t)rows * (width + 1));
+    if (panel->text == NULL)
+    {
+        fprintf(stderr, "Error: cannot allocate panel\n");
+        return NULL;
+    }
+    panel->rows = rows;
+    panel->width = width;
+    monitor->panel_count++;
+    return panel;
+}
+
+/**
+ * Returns one line of a text panel for the collector to write into.
+ * 
+ * @param panel The panel.
+ * @param row The line index, from 0 to `rows - 1`.
+ * @return The line buffer, `width + 1` bytes long.
+ */
+char *panel_line(TextPanel *panel, int row)
+{
+    return panel->text + (size_t)row * (panel->width + 1);
+}
+
+/**
+ * Fills in a recording header for the monitor's series.
+ * 
+ * @param monitor The monitor being recorded.
+ * @param header The header to fill in.
+ * @param capacity The ring capacity in entries, 0 for a linear recording.
+ */
+void record_header_init(const Monitor *monitor, RecordHeader *header, uint64_t capacity)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, RECORD_MAGIC, sizeof(header->magic));
+    header->entry_size = sizeof(RecordEntry);
+    header->series_count = (uint32_t)monitor->series_count;
+    header->capacity = capacity;
+    header->tdelay = monitor->args->tdelay;
+    header->start_ns = monitor->start_ns;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    header->start_realtime_ns = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec - (int64_t)(monotonic_ns() - monitor->start_ns);
+    for (int i = 0; i < monitor->series_count; i++)
+    {
+        snprintf(header->names[i], RECORD_NAME_SIZE, "%s", monitor->series[i].name);
+        snprintf(header->units[i], sizeof(header->units[i]), "%s", monitor->series[i].unit);
+    }
+}
+
+/**
+ * Fills the entries of one tick with the latest value of every recorded series.
+ * 
+ * @param monitor The monitor being recorded.
+ * @param series_count The number of series in the recording's header.
+ * @param entry The entry for the first RECORD_VALUES series.
+ * @param index The index of `entry` in the recording, used to find the next 
+ *              entry when `ring` is not NULL.
+ * @param ring The ring the entries wrap around in, or NULL if they are contiguous.
+ * @param capacity The number of entries in `ring`.
+ */
+void record_samples(const Monitor *monitor, int series_count, RecordEntry *entry, uint64_t index, RecordEntry *ring, uint64_t capacity)
+{
+    uint64_t t_ns = monotonic_ns();
+    for (int first = 0; first < series_count; first += RECORD_VALUES)
+    {
+        if (ring != NULL)
+        {
+            entry = &ring[index++ % capacity];
+        }
+        entry->t_ns = t_ns;
+        entry->tick = monitor->tick;
+        entry->kind = RECORD_SAMPLES;
+        entry->first = (uint16_t)first;
+        for (int v = 0; v < RECORD_VALUES; v++)
+        {
+            entry->values[v] = first + v < series_count ? (float)monitor->series[first + v].value : __builtin_nanf("");
+        }
+        if (ring == NULL)
+        {
+            entry++;
+        }
+    }
+}
+
+/**
+ * Sets up the flight recorder: a ring holding the last `--flight` minutes of 
+ * samples in a file mapped shared, so that the samples are on disk even if 
+ * the monitor is killed. The file's pages are pushed to disk asynchronously 
+ * about once a second, which bounds what a crash of the machine loses.
+ * 
+ * @param monitor The monitor, with every collector set up.
+ * @return 0 on success, -1 on failure.
+ */
+int flight_open(Monitor *monitor)
+{
+    FlightRecorder *flight = &monitor->flight;
+    const char *path = monitor->args->flight_file;
+    uint64_t ticks = monitor->plan.flight_ticks; // --flight minutes, unless --max-rss shrank them
+    uint64_t requested = (uint64_t)monitor->args->flight_minutes * 60 * 1000000 / (monitor->args->tdelay > 0 ? monitor->args->tdelay : 1);
+    if (ticks < requested)
+    {
+        fprintf(stderr, "Warning: --max-rss leaves room for %.1f of %d minutes of flight recording\n",
+                monitor->args->flight_minutes * (double)ticks / requested, monitor->args->flight_minutes);
+    }
+    flight->entries_per_tick = (monitor->series_count + RECORD_VALUES - 1) / RECORD_VALUES;
+    uint64_t capacity = (ticks > 0 ? ticks : 1) * flight->entries_per_tick;
+    flight->map_size = RECORD_HEADER_SIZE + capacity * sizeof(RecordEntry);
+    flight->sync_every = monitor->args->tdelay < 1000000 ? (int)(1000000 / (monitor->args->tdelay > 0 ? monitor->args->tdelay : 1)) : 1;
+
+    // A ring left by an earlier run, which may have crashed, is kept as FILE.prev rather than truncated
+    int previous_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (previous_fd != -1)
+    {
+        RecordHeader previous;
+        if (pread(previous_fd, &previous, sizeof(previous), 0) == (ssize_t)sizeof(previous) &&
+            memcmp(previous.magic, RECORD_MAGIC, sizeof(previous.magic)) == 0 && previous.head > 0)
+        {
+            char previous_path[512];
+            snprintf(previous_path, sizeof(previous_path), "%s.prev", path);
+            if (rename(path, previous_path) == -1)
+            {
+                fprintf(stderr, "Error: cannot keep the previous flight recording as %s\n", previous_path);
+                close(previous_fd);
+                return -1;
+            }
+            fprintf(stderr, "Kept the previous flight recording as %s\n", previous_path);
+        }
+        close(previous_fd);
+    }
+    flight->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (flight->fd == -1 || ftruncate(flight->fd, (off_t)flight->map_size) == -1)
+    {
+        fprintf(stderr, "Error: cannot create flight recording %s\n", path);
+        return -1;
+    }
+    void *map = mmap(NULL, flight->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, flight->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: cannot map flight recording %s\n", path);
+        return -1;
+    }
+    flight->header = (RecordHeader *)map;
+    flight->entries = (RecordEntry *)((unsigned char *)map + RECORD_HEADER_SIZE);
+    record_header_init(monitor, flight->header, capacity);
+    tzset(); // snapshot names use localtime_r, which must not load the zone once sampling
+    return 0;
+}
+
+/**
+ * Appends the latest tick to the flight recorder ring and publishes it by 
+ * advancing the header's head.
+ * 
+ * @param monitor The monitor being recorded.
+ */
+void flight_record(Monitor *monitor)
+{
+    FlightRecorder *flight = &monitor->flight;
+    RecordHeader *header = flight->header;
+    record_samples(monitor, (int)header->series_count, NULL, header->head, flight->entries, header->capacity);
+    __atomic_store_n(&header->head, header->head + flight->entries_per_tick, __ATOMIC_RELEASE);
+    if (monitor->tick % flight->sync_every == 0)
+    {
+        sync_file_range(flight->fd, 0, (off_t)flight->map_size, SYNC_FILE_RANGE_WRITE);
+    }
+}
+
+/**
+ * Writes the flight recorder ring to `<file>.<YYYYmmdd-HHMMSS>` as a linear 
+ * recording, oldest tick first, from a forked child so that sampling does not 
+ * pause. The ring is shared with the child rather than copied, so once the 
+ * child is done it marks as dropped the oldest entries the monitor may have 
+ * overwritten while it was writing them.
+ * 
+ * @param monitor The monitor being recorded.
+ */
+void flight_snapshot(Monitor *monitor)
+{
+    FlightRecorder *flight = &monitor->flight;
+    if (flight->snapshot_pid > 0)
+    {
+        return; // the previous snapshot is still being written
+    }
+    char path[PATH_MAX];
+    struct tm now;
+    time_t seconds = time(NULL);
+    localtime_r(&seconds, &now);
+    int length = snprintf(path, sizeof(path), "%s.", monitor->args->flight_file);
+    strftime(path + length, sizeof(path) - length, "%Y%m%d-%H%M%S", &now);
+
+    pid_t pid = fork();
+    if (pid != 0)
+    {
+        flight->snapshot_pid = pid > 0 ? pid : 0;
+        return;
+    }
+    const RecordHeader *ring = flight->header;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > ring->capacity ? head - ring->capacity : 0;
+    RecordHeader header = *ring;
+    header.capacity = 0;
+    header.head = head - first;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1 || pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+    {
+        _exit(1);
+    }
+    // Write the ring in at most two runs, split where it wraps
+    off_t offset = RECORD_HEADER_SIZE;
+    for (uint64_t i = first; i < head;)
+    {
+        uint64_t slot = i % ring->capacity;
+        uint64_t run = ring->capacity - slot < head - i ? ring->capacity - slot : head - i;
+        if (pwrite(fd, &flight->entries[slot], run * sizeof(RecordEntry), offset) != (ssize_t)(run * sizeof(RecordEntry)))
+        {
+            _exit(1);
+        }
+        offset += run * sizeof(RecordEntry);
+        i += run;
+    }
+    // Entries of ticks written since the copy started may have replaced the oldest ones
+    uint64_t now_head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) + flight->entries_per_tick;
+    RecordEntry dropped;
+    memset(&dropped, 0, sizeof(dropped));
+    for (uint64_t i = first; i < head && i + ring->capacity < now_head; i++)
+    {
+        pwrite(fd, &dropped, sizeof(dropped), RECORD_HEADER_SIZE + (off_t)((i - first) * sizeof(RecordEntry)));
+    }
+    _exit(close(fd) == 0 ? 0 : 1);
+}
+
+/**
+ * Reaps the child writing a flight recorder snapshot once it has exited.
+ * 
+ * @param monitor The monitor being recorded.
+ */
+void flight_reap(Monitor *monitor)
+{
+    FlightRecorder *flight = &monitor->flight;
+    int status;
+    if (flight->snapshot_pid > 0 && waitpid(flight->snapshot_pid, &status, WNOHANG) == flight->snapshot_pid)
+    {
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            fprintf(stderr, "Error: flight recorder snapshot failed\n");
+        }
+        flight->snapshot_pid = 0;
+    }
+}
+
+/**
+ * Starts a linear recording of every series, one set of entries per tick, 
+ * written as the ticks happen. The header's head is rewritten after every 
+ * tick so that a recording cut short is still readable.
+ * 
+ * @param monitor The monitor to record.
+ * @param path The file to record to.
+ * @return 0 on success, -1 on failure.
+ */
+int record_start(Monitor *monitor, const char *path)
+{
+    Recording *recording = &monitor->recording;
+    RecordHeader header;
+    record_header_init(monitor, &header, 0);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1 || pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || lseek(fd, RECORD_HEADER_SIZE, SEEK_SET) == -1)
+    {
+        fprintf(stderr, "Error: cannot start recording %s\n", path);
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    recording->fd = fd;
+    recording->series_count = header.series_count;
+    recording->entries = 0;
+    snprintf(recording->path, sizeof(recording->path), "%s", path);
+    return 0;
+}
+
+/**
+ * Appends entries to the recording and publishes them in its header.
+ * 
+ * @param recording The recording.
+ * @param entries The entries.
+ * @param count The number of entries.
+ */
+void record_append(Recording *recording, const RecordEntry *entries, int count)
+{
+    if (write(recording->fd, entries, count * sizeof(RecordEntry)) == (ssize_t)(count * sizeof(RecordEntry)))
+    {
+        recording->entries += count;
+        pwrite(recording->fd, &recording->entries, sizeof(recording->entries), offsetof(RecordHeader, head));
+    }
+}
+
+/**
+ * Appends the latest tick to the recording.
+ * 
+ * @param monitor The monitor being recorded.
+ */
+void record_tick(Monitor *monitor)
+{
+    Recording *recording = &monitor->recording;
+    RecordEntry entries[(MAX_SERIES + RECORD_VALUES - 1) / RECORD_VALUES];
+    record_samples(monitor, (int)recording->series_count, entries, 0, NULL, 0);
+    record_append(recording, entries, ((int)recording->series_count + RECORD_VALUES - 1) / RECORD_VALUES);
+}
+
+/**
+ * Stops the recording.
+ * 
+ * @param monitor The monitor being recorded.
+ */
+void record_stop(Monitor *monitor)
+{
+    Recording *recording = &monitor->recording;
+    if (recording->fd != -1)
+    {
+        close(recording->fd);
+        recording->fd = -1;
+    }
+}
+
+/**
+ * Requests a flight recorder snapshot; installed for SIGUSR1. The snapshot is 
+ * taken at the next tick boundary.
+ * 
+ * @param signal_number The signal number (unused).
+ */
+void on_snapshot_signal(int signal_number)
+{
+    (void)signal_number;
+    snapshot_requested = 1;
+}
+
+/**
+ * Creates (or reuses) the `--markers` FIFO and opens it without blocking. 
+ * Other processes write one marker per line, such as "phase=warmup". An 
+ * existing FIFO is only reused if it is ours and only we can write to it.
+ * 
+ * @param monitor The monitor.
+ * @return 0 on success, -1 on failure.
+ */
+int markers_setup(Monitor *monitor)
+{
+    MarkerPipe *markers = &monitor->markers;
+    const char *path = monitor->args->markers_path;
+    struct stat info;
+    if (mkfifo(path, 0600) == -1 && errno != EEXIST)
+    {
+        fprintf(stderr, "Error: cannot create marker FIFO %s\n", path);
+        return -1;
+    }
+    markers->fd = open(path, O_RDONLY | O_NONBLOCK | O_NOFOLLOW | O_CLOEXEC);
+    if (markers->fd == -1 || fstat(markers->fd, &info) == -1 || !S_ISFIFO(info.st_mode))
+    {
+        fprintf(stderr, "Error: cannot open marker FIFO %s\n", path);
+        return -1;
+    }
+    if (info.st_uid != geteuid() || (info.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+    {
+        fprintf(stderr, "Error: marker FIFO %s must be owned by us and not writable by group or others\n", path);
+        return -1;
+    }
+    // The write end is opened through the read end, so both are the FIFO just checked
+    char self_path[64];
+    snprintf(self_path, sizeof(self_path), "/proc/self/fd/%d", markers->fd);
+    markers->keep_fd = open(self_path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (markers->keep_fd == -1)
+    {
+        fprintf(stderr, "Error: cannot open marker FIFO %s\n", path);
+        return -1;
+    }
+    markers->length = 0;
+    return 0;
+}
+
+/**
+ * Records a marker: as an event drawn across every graph and, when the flight 
+ * recorder or a recording is on, as a marker entry in it.
+ * 
+ * @param monitor The monitor.
+ * @param text The marker text.
+ */
+void marker_add(Monitor *monitor, const char *text)
+{
+    // Markers come from other processes: control characters would reach the terminal and split headless columns
+    char clean[sizeof(monitor->markers.line)];
+    size_t length = 0;
+    for (; text[length] != '\0' && length < sizeof(clean) - 1; length++)
+    {
+        clean[length] = (unsigned char)text[length] < ' ' || text[length] == 0x7f ? ' ' : text[length];
+    }
+    clean[length] = '\0';
+    text = clean;
+    add_event(monitor, NULL, '|', "%s", text);
+    monitor->events[(monitor->event_count - 1) % EVENT_RING_SIZE].marker = true;
+
+    FlightRecorder *flight = &monitor->flight;
+    if (flight->header != NULL)
+    {
+        RecordHeader *header = flight->header;
+        RecordEntry *entry = &flight->entries[header->head % header->capacity];
+        entry->t_ns = monitor->events[(monitor->event_count - 1) % EVENT_RING_SIZE].t_ns;
+        entry->tick = monitor->tick;
+        entry->kind = RECORD_MARKER;
+        entry->first = '|';
+        snprintf(entry->text, sizeof(entry->text), "%.*s", (int)sizeof(entry->text) - 1, text);
+        __atomic_store_n(&header->head, header->head + 1, __ATOMIC_RELEASE);
+    }
+    if (monitor->recording.fd != -1)
+    {
+        RecordEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.t_ns = monitor->events[(monitor->event_count - 1) % EVENT_RING_SIZE].t_ns;
+        entry.tick = monitor->tick;
+        entry.kind = RECORD_MARKER;
+        entry.first = '|';
+        snprintf(entry.text, sizeof(entry.text), "%.*s", (int)sizeof(entry.text) - 1, text);
+        record_append(&monitor->recording, &entry, 1);
+    }
+}
+
+/**
+ * Reads whatever markers have arrived on the FIFO. Each line becomes a marker 
+ * timestamped now; lines longer than a marker are cut short.
+ * 
+ * @param monitor The monitor.
+ */
+void markers_poll(Monitor *monitor)
+{
+    MarkerPipe *markers = &monitor->markers;
+    char buffer[512];
+    ssize_t len;
+    while ((len = read(markers->fd, buffer, sizeof(buffer))) > 0)
+    {
+        for (ssize_t i = 0; i < len; i++)
+        {
+            if (buffer[i] != '\n')
+            {
+                if (markers->length < sizeof(markers->line) - 1)
+                {
+                    markers->line[markers->length++] = buffer[i];
+                }
+                continue;
+            }
+            markers->line[markers->length] = '\0';
+            if (markers->length > 0)
+            {
+                marker_add(monitor, markers->line);
+            }
+            markers->length = 0;
+        }
+    }
+}
+
+/**
+ * Sleeps until the next tick while watching the marker FIFO, so that markers 
+ * are timestamped when they arrive rather than at the next tick. Like the 
+ * plain sleep between ticks, a signal ends the sleep early.
+ * 
+ * @param monitor The monitor.
+ * @param delay The time to sleep in microseconds.
+ */
+void markers_sleep(Monitor *monitor, unsigned long delay)
+{
+    uint64_t end_ns = monotonic_ns() + delay * 1000ULL;
+    for (uint64_t now = monotonic_ns(); now < end_ns; now = monotonic_ns())
+    {
+        struct pollfd fifo = {monitor->markers.fd, POLLIN, 0};
+        struct timespec timeout = {(time_t)((end_ns - now) / 1000000000), (long)((end_ns - now) % 1000000000)};
+        int ready = ppoll(&fifo, 1, &timeout, NULL);
+        if (ready == -1)
+        {
+            return;
+        }
+        if (ready > 0)
+        {
+            markers_poll(monitor);
+        }
+    }
+}
+
+/**
+ * Reads one sub-sample: the CPU utilization and the share of wall time some 
+ * task stalled on CPU, memory and I/O since the previous sub-sample. Only the 
+ * aggregate line of /proc/stat is read.
+ * 
+ * @param capture The capture state.
+ * @param sample Receives the sub-sample.
+ */
+void capture_read(Capture *capture, CaptureSample *sample)
+{
+    char buffer[256];
+    uint64_t now = monotonic_ns();
+    double elapsed_us = (now - capture->last_ns) / 1000.0;
+    sample->t_ns = now;
+    for (int i = 0; i < CAPTURE_METRICS; i++)
+    {
+        sample->values[i] = __builtin_nanf("");
+    }
+
+    ssize_t len = pread(capture->fd, buffer, sizeof(buffer) - 1, 0);
+    if (len > 0)
+    {
+        buffer[len] = '\0';
+        uint64_t fields[8] = {0};
+        char *cursor = buffer + 3; // skip "cpu"
+        for (int i = 0; i < 8; i++)
+        {
+            fields[i] = strtoull(cursor, &cursor, 10);
+        }
+        uint64_t total = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            total += fields[i];
+        }
+        uint64_t idle = fields[3] + fields[4];
+        // Jiffies are coarser than sub-samples: until enough have passed the last reading is kept
+        if (total >= capture->cpu_total + capture->min_jiffies)
+        {
+            sample->values[0] = 100.0f * (1 - (float)(idle - capture->cpu_idle) / (total - capture->cpu_total));
+            capture->cpu_total = total;
+            capture->cpu_idle = idle;
+        }
+        else if (capture->count > 0)
+        {
+            sample->values[0] = capture->ring[(capture->count - 1) % capture->capacity].values[0];
+        }
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        len = capture->pressure_fds[i] != -1 ? pread(capture->pressure_fds[i], buffer, sizeof(buffer) - 1, 0) : -1;
+        if (len <= 0)
+        {
+            continue;
+        }
+        buffer[len] = '\0';
+        char *total = strstr(buffer, "total=");
+        uint64_t stall = total != NULL ? strtoull(total + 6, NULL, 10) : 0;
+        if (capture->last_ns > 0 && stall >= capture->stall_us[i])
+        {
+            sample->values[i + 1] = (float)(100.0 * (stall - capture->stall_us[i]) / elapsed_us);
+        }
+        capture->stall_us[i] = stall;
+    }
+    capture->last_ns = now;
+}
+
+/**
+ * Sets up the triggered capture: a ring in the run arena that keeps filling 
+ * with sub-samples of the CPU utilization and pressure stall times between 
+ * ticks, so that the window before an incident is available once it fires.
+ * 
+ * @param monitor The monitor.
+ * @return 0 on success, -1 on failure.
+ */
+int capture_setup(Monitor *monitor)
+{
+    static const char *const pressure_files[3] = {"/proc/pressure/cpu", "/proc/pressure/memory", "/proc/pressure/io"};
+    const ArgsInfo *argsInfo = monitor->args;
+    Capture *capture = &monitor->capture;
+    capture->capacity = capture_capacity(argsInfo);
+    capture->pre = argsInfo->capture_pre_ms * 1000 / argsInfo->capture_rate;
+    capture->post = capture->capacity - capture->pre - 1;
+    capture->ring = (CaptureSample *)arena_alloc(&run_arena, capture->capacity * sizeof(CaptureSample));
+    capture->file = (unsigned char *)arena_alloc(&run_arena, RECORD_HEADER_SIZE + capture->capacity * sizeof(RecordEntry));
+    capture->fd = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+    if (capture->ring == NULL || capture->file == NULL || capture->fd == -1)
+    {
+        fprintf(stderr, "Error: cannot set up the capture\n");
+        return -1;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        capture->pressure_fds[i] = open(pressure_files[i], O_RDONLY | O_CLOEXEC);
+    }
+    if (argsInfo->trigger_metric > 0 && capture->pressure_fds[argsInfo->trigger_metric - 1] == -1)
+    {
+        fprintf(stderr, "Error: %s needs pressure stall information (/proc/pressure)\n", capture_metrics[argsInfo->trigger_metric]);
+        return -1;
+    }
+    capture->armed = true;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    capture->min_jiffies = 4 * (uint64_t)(cpus > 0 ? cpus : 1);
+    CaptureSample discard;
+    capture_read(capture, &discard);
+    tzset();
+    return 0;
+}
+
+/**
+ * Writes a finished capture, from the start of its pre-trigger window to the 
+ * end of its post-trigger window (or to the last sub-sample, for a capture 
+ * still running when the monitor exits), to `<prefix>.<date>-<time>-<n>` as a linear 
+ * recording whose series are the capture metrics.
+ * 
+ * @param monitor The monitor.
+ * @return 0 on success, -1 on failure.
+ */
+int capture_write(Monitor *monitor)
+{
+    Capture *capture = &monitor->capture;
+    size_t first = capture->triggered_at > capture->pre ? capture->triggered_at - capture->pre : 0;
+    if (capture->count - first > capture->capacity)
+    {
+        first = capture->count - capture->capacity;
+    }
+    char path[PATH_MAX];
+    struct tm now;
+    time_t seconds = time(NULL);
+    localtime_r(&seconds, &now);
+    int length = snprintf(path, sizeof(path), "%s.", monitor->args->capture_prefix);
+    length += strftime(path + length, sizeof(path) - length, "%Y%m%d-%H%M%S", &now);
+    snprintf(path + length, sizeof(path) - length, "-%d", capture->captures);
+
+    // The whole file is built in the capture's buffer and written with one pwrite
+    RecordHeader *header = (RecordHeader *)capture->file;
+    memset(capture->file, 0, RECORD_HEADER_SIZE);
+    memcpy(header->magic, RECORD_MAGIC, sizeof(header->magic));
+    header->entry_size = sizeof(RecordEntry);
+    header->series_count = CAPTURE_METRICS;
+    header->head = capture->count - first;
+    header->tdelay = monitor->args->capture_rate;
+    header->start_ns = monitor->start_ns;
+    for (int i = 0; i < CAPTURE_METRICS; i++)
+    {
+        snprintf(header->names[i], RECORD_NAME_SIZE, "%s", capture_metrics[i]);
+        strcpy(header->units[i], "%");
+    }
+    RecordEntry *entries = (RecordEntry *)(capture->file + RECORD_HEADER_SIZE);
+    for (size_t i = first; i < capture->count; i++)
+    {
+        const CaptureSample *sample = &capture->ring[i % capture->capacity];
+        RecordEntry *entry = &entries[i - first];
+        memset(entry, 0, sizeof(*entry));
+        entry->t_ns = sample->t_ns;
+        entry->tick = (int32_t)(i - capture->triggered_at); // negative before the trigger
+        entry->kind = RECORD_SAMPLES;
+        memcpy(entry->values, sample->values, sizeof(sample->values));
+        for (int v = CAPTURE_METRICS; v < RECORD_VALUES; v++)
+        {
+            entry->values[v] = __builtin_nanf("");
+        }
+    }
+    size_t size = RECORD_HEADER_SIZE + (capture->count - first) * sizeof(RecordEntry);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int status = fd != -1 && pwrite(fd, capture->file, size, 0) == (ssize_t)size ? 0 : -1;
+    if (status == -1)
+    {
+        fprintf(stderr, "Error: cannot write capture %s\n", path);
+    }
+    if (fd != -1)
+    {
+        close(fd);
+    }
+    if (status == 0)
+    {
+        add_event(monitor, NULL, 'C', "capture %s saved", path + (strrchr(path, '/') != NULL ? strrchr(path, '/') - path + 1 : 0));
+    }
+    return status;
+}
+
+/**
+ * Sleeps until the next tick while taking sub-samples at the capture rate. 
+ * Each sub-sample is checked against the trigger: when it fires, the 
+ * sub-samples already in the ring form the pre-trigger window, and once the 
+ * post-trigger window has been taken the capture is written out. The trigger 
+ * re-arms after its condition has cleared. A sub-sample is also taken at the 
+ * end of the sleep, so a tick no longer than the capture rate still gets one.
+ * 
+ * Like the plain sleep between ticks, a signal (a wrapped command exiting) 
+ * ends the sleep early.
+ * 
+ * @param monitor The monitor.
+ * @param delay The time to sleep in microseconds.
+ */
+void capture_sleep(Monitor *monitor, unsigned long delay)
+{
+    Capture *capture = &monitor->capture;
+    const ArgsInfo *argsInfo = monitor->args;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    uint64_t end_ns = (uint64_t)deadline.tv_sec * 1000000000 + deadline.tv_nsec + delay * 1000ULL;
+    for (;;)
+    {
+        uint64_t next_ns = (uint64_t)deadline.tv_sec * 1000000000 + deadline.tv_nsec + argsInfo->capture_rate * 1000ULL;
+        next_ns = next_ns < end_ns ? next_ns : end_ns;
+        deadline.tv_sec = (time_t)(next_ns / 1000000000);
+        deadline.tv_nsec = (long)(next_ns % 1000000000);
+        if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) != 0)
+        {
+            return;
+        }
+
+        if (monitor->markers.fd != -1)
+        {
+            markers_poll(monitor);
+        }
+        CaptureSample *sample = &capture->ring[capture->count % capture->capacity];
+        capture_read(capture, sample);
+        float value = sample->values[argsInfo->trigger_metric];
+        bool firing = value == value && (argsInfo->trigger_above ? value > argsInfo->trigger_threshold : value < argsInfo->trigger_threshold);
+        if (firing && capture->armed && !capture->capturing)
+        {
+            capture->capturing = true;
+            capture->armed = false;
+            capture->triggered_at = capture->count;
+            add_event(monitor, argsInfo->trigger_metric == 0 ? monitor->cpu_utilization : NULL, '!', "trigger: %s %.1f%% %c %g%%",
+                      capture_metrics[argsInfo->trigger_metric], value, argsInfo->trigger_above ? '>' : '<', argsInfo->trigger_threshold);
+        }
+        capture->armed = capture->armed || !firing;
+        capture->count++;
+        if (capture->capturing && capture->count - capture->triggered_at > capture->post)
+        {
+            capture->capturing = false;
+            capture_write(monitor);
+            capture->captures++;
+        }
+        if (next_ns == end_ns)
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * Keeps `limit` indices ordered by descending key, inserting `index` if its key 
+ * is large enough. Used to pick the top rows of a table without sorting (and 
+ * without the allocation qsort may perform).
+ * 
+ * @param top The indices kept so far.
+ * @param keys The keys of the indices kept so far.
+ * @param count The number of indices kept so far; updated.
+ * @param limit The maximum number of indices to keep.
+ * @param index The candidate index.
+ * @param key The candidate's key.
+ */
+void insert_top(int *top, double *keys, int *count, int limit, int index, double key)
+{
+    if (*count == limit && key <= keys[limit - 1])
+    {
+        return;
+    }
+    int pos = *count < limit ? (*count)++ : limit - 1;
+    while (pos > 0 && keys[pos - 1] < key)
+    {
+        top[pos] = top[pos - 1];
+        keys[pos] = keys[pos - 1];
+        pos--;
+    }
+    top[pos] = index;
+    keys[pos] = key;
+}
+
+/**
+ * Formats a byte count as a short human-readable string, e.g. "512.0M".
+ * 
+ * @param buffer Receives the string.
+ * @param size The size of the buffer.
+ * @param bytes The byte count.
+ */
+void format_bytes(char *buffer, size_t size, double bytes)
+{
+    static const char units[] = "BKMGTP";
+    int unit = 0;
+    while (bytes >= 1024 && unit < 5)
+    {
+        bytes /= 1024;
+        unit++;
+    }
+    snprintf(buffer, size, unit == 0 ? "%.0f%c" : "%.1f%c", bytes, units[unit]);
+}
+
+#if SYSMON_WITH_MEMORY
+/**
+ * Sets up the memory collector.
+ * 
+ * The memory graph has a fixed scale from 0 to the total system memory over 
+ * 10 rows, so each row represents a tenth of the installed memory.
+ * 
+ * @param monitor The monitor to add the memory series to.
+ * @return 0 on success, -1 on failure.
+ */
+int memory_setup(Monitor *monitor)
+{
+    Series *series = add_series(monitor, "mem.used", "v Memory ", "GB");
+    if (series == NULL)
+    {
+        return -1;
+    }
+    long double max_memory = get_total_memory();
+    series->height = 10;
+    series->scale = (double)(max_memory / series->height);
+    series->gap = 1;
+    sprintf(series->top_label, "%.Lf GB", max_memory);
+    series->baseline = "0 GB";
+    monitor->memory_used = series;
+    return 0;
+}
+
+/**
+ * Samples the used system memory.
+ * 
+ * @param monitor The monitor holding the memory series.
+ */
+void memory_sample(Monitor *monitor)
+{
+    monitor->memory_used->value = (double)calculate_memory_used();
+}
+
+/**
+ * Reads the dirty page counters and recomputes the dirty thresholds.
+ * 
+ * The thresholds follow the kernel: vm.dirty_bytes and 
+ * vm.dirty_background_bytes when set, otherwise vm.dirty_ratio and 
+ * vm.dirty_background_ratio percent of the dirtyable memory, approximated 
+ * as free memory plus the file page cache.
+ * 
+ * @param state The writeback state.
+ * @param dirty Receives the Dirty memory in bytes.
+ * @param writeback Receives the Writeback memory in bytes.
+ * @return 0 on success, -1 if /proc/meminfo cannot be read.
+ */
+int writeback_read(WritebackState *state, double *dirty, double *writeback)
+{
+    char *text = read_proc_file(&state->meminfo, &scratch_arena, 4 * PROC_READ_SIZE);
+    if (text == NULL)
+    {
+        return -1;
+    }
+    uint64_t kb[6] = {0};
+    keyed_value(text, "Dirty:", &kb[0]);
+    keyed_value(text, "Writeback:", &kb[1]);
+    bool has_nfs = keyed_value(text, "NFS_Unstable:", &kb[2]);
+    keyed_value(text, "MemFree:", &kb[3]);
+    keyed_value(text, "Active(file):", &kb[4]);
+    keyed_value(text, "Inactive(file):", &kb[5]);
+    *dirty = kb[0] * 1024.0;
+    *writeback = kb[1] * 1024.0;
+    state->nfs_unstable = has_nfs ? kb[2] * 1024.0 : -1;
+
+    double dirtyable = (kb[3] + kb[4] + kb[5]) * 1024.0;
+    uint64_t ratio = read_counter(state->sysctl_fds[0]);
+    uint64_t background_ratio = read_counter(state->sysctl_fds[1]);
+    uint64_t bytes = read_counter(state->sysctl_fds[2]);
+    uint64_t background_bytes = read_counter(state->sysctl_fds[3]);
+    state->limit = bytes > 0 ? (double)bytes : dirtyable * ratio / 100;
+    state->background_limit = background_bytes > 0 ? (double)background_bytes : dirtyable * background_ratio / 100;
+    return 0;
+}
+
+/**
+ * Sets up the writeback collector: a graph of dirty and writeback memory 
+ * drawn against the background and throttling thresholds, plus a panel with 
+ * the page dirtying and writeback rates.
+ * 
+ * @param monitor The monitor to add the series and panel to.
+ * @return 0 on success, -1 on failure.
+ */
+int writeback_setup(Monitor *monitor)
+{
+    static const char *const sysctls[4] = {"/proc/sys/vm/dirty_ratio", "/proc/sys/vm/dirty_background_ratio",
+                                           "/proc/sys/vm/dirty_bytes", "/proc/sys/vm/dirty_background_bytes"};
+    WritebackState *state = &monitor->writeback;
+    if (open_proc_file(&state->meminfo, "/proc/meminfo") == -1 || open_proc_file(&state->vmstat, "/proc/vmstat") == -1)
+    {
+        return -1;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        state->sysctl_fds[i] = open(sysctls[i], O_RDONLY | O_CLOEXEC);
+    }
+    double dirty, writeback;
+    if (writeback_read(state, &dirty, &writeback) == -1)
+    {
+        return -1;
+    }
+
+    state->dirty = add_series(monitor, "wb.dirty", "v Dirty pages ", "MB");
+    state->writeback = add_series(monitor, "wb.writeback", "writeback", "MB");
+    state->background_series = add_series(monitor, "wb.background", "bg limit", "MB");
+    state->limit_series = add_series(monitor, "wb.limit", "limit", "MB");
+    monitor->writeback_panel = add_panel(monitor, 3, WRITEBACK_PANEL_WIDTH);
+    if (state->limit_series == NULL || monitor->writeback_panel == NULL)
+    {
+        return -1;
+    }
+    Series *dirty_series = state->dirty;
+    dirty_series->height = 10;
+    dirty_series->scale = state->limit / 1048576.0 / dirty_series->height; // the limit is the top row
+    if (!(dirty_series->scale > 0))
+    {
+        dirty_series->scale = 0.1; // no limit to scale to; grows like a disk graph
+    }
+    dirty_series->gap = 1;
+    dirty_series->glyph = 'd';
+    dirty_series->auto_scale = true;
+    snprintf(dirty_series->top_label, sizeof(dirty_series->top_label), "%.0f MB", dirty_series->scale * dirty_series->height);
+    dirty_series->baseline = "0 MB";
+    Series *overlays[3] = {state->writeback, state->background_series, state->limit_series};
+    static const char glyphs[3] = {'w', '.', '-'};
+    for (int i = 0; i < 3; i++)
+    {
+        overlays[i]->overlay_of = dirty_series;
+        overlays[i]->height = dirty_series->height;
+        overlays[i]->scale = dirty_series->scale;
+        overlays[i]->glyph = glyphs[i];
+        dirty_series->overlays++;
+    }
+    state->last_ns = monotonic_ns();
+    char *text = read_proc_file(&state->vmstat, &scratch_arena, 8 * PROC_READ_SIZE);
+    if (text != NULL)
+    {
+        keyed_value(text, "nr_dirtied", &state->dirtied);
+        keyed_value(text, "nr_written", &state->written);
+    }
+    return 0;
+}
+
+/**
+ * Samples dirty and writeback memory, the thresholds, and the rates at which 
+ * pages are dirtied and written back. Dirty memory climbing towards the limit 
+ * while the written rate lags the dirtied rate is what precedes write stalls.
+ * 
+ * @param monitor The monitor holding the writeback state.
+ */
+void writeback_sample(Monitor *monitor)
+{
+    WritebackState *state = &monitor->writeback;
+    TextPanel *panel = monitor->writeback_panel;
+    double dirty, writeback;
+    if (writeback_read(state, &dirty, &writeback) == -1)
+    {
+        return;
+    }
+    uint64_t now = monotonic_ns();
+    double seconds = (now - state->last_ns) / 1e9;
+    state->last_ns = now;
+    char *text = read_proc_file(&state->vmstat, &scratch_arena, 8 * PROC_READ_SIZE);
+    uint64_t dirtied = state->dirtied, written = state->written;
+    if (text != NULL)
+    {
+        keyed_value(text, "nr_dirtied", &dirtied);
+        keyed_value(text, "nr_written", &written);
+    }
+    long page_size = sysconf(_SC_PAGESIZE);
+    state->dirtied_rate = seconds > 0 && dirtied >= state->dirtied ? (dirtied - state->dirtied) * page_size / seconds : 0;
+    state->written_rate = seconds > 0 && written >= state->written ? (written - state->written) * page_size / seconds : 0;
+    state->dirtied = dirtied;
+    state->written = written;
+
+    state->dirty->value = dirty / 1048576.0;
+    state->writeback->value = writeback / 1048576.0;
+    state->background_series->value = state->background_limit / 1048576.0;
+    state->limit_series->value = state->limit / 1048576.0;
+
+    char sizes[5][12];
+    format_bytes(sizes[0], sizeof(sizes[0]), dirty);
+    format_bytes(sizes[1], sizeof(sizes[1]), writeback);
+    format_bytes(sizes[2], sizeof(sizes[2]), state->nfs_unstable);
+    format_bytes(sizes[3], sizeof(sizes[3]), state->dirtied_rate);
+    format_bytes(sizes[4], sizeof(sizes[4]), state->written_rate);
+    snprintf(panel->title, sizeof(panel->title), "v Writeback");
+    snprintf(panel_line(panel, 0), panel->width + 1, "Dirty %s  Writeback %s  NFS_Unstable %s",
+             sizes[0], sizes[1], state->nfs_unstable < 0 ? "-" : sizes[2]);
+    snprintf(panel_line(panel, 1), panel->width + 1, "dirtied %s/s  written %s/s", sizes[3], sizes[4]);
+    format_bytes(sizes[0], sizeof(sizes[0]), state->background_limit);
+    format_bytes(sizes[1], sizeof(sizes[1]), state->limit);
+    snprintf(panel_line(panel, 2), panel->width + 1, "background writeback above %s, writers throttled above %s (%.0f%% of limit)",
+             sizes[0], sizes[1], state->limit > 0 ? dirty * 100 / state->limit : 0.0);
+}
+#endif
+
+#if SYSMON_WITH_CPU
+/**
+ * Sets up the CPU collector.
+ * 
+ * The CPU graph has a fixed scale from 0% to 100% with a height of 11 units:
+ * 
+ * 1st unit = 0% to 9%
+ * 2nd unit = 10% to 19%
+ * ......(and so on)
+ * 11th unit = 100%
+ * 
+ * `/proc/stat` is opened once and read here for the first time, because 
+ * `calculate_cpu_utilization` needs a previous sample to compute a delta.
+ * 
+ * @param monitor The monitor to add the CPU series to.
+ * @return 0 on success, -1 on failure.
+ */
+int cpu_setup(Monitor *monitor)
+{
+    Series *series = add_series(monitor, "cpu", "v CPU ", "%");
+    if (series == NULL || open_proc_file(&monitor->cpu.proc_stat, "/proc/stat") == -1)
+    {
+        return -1;
+    }
+    series->height = 11;
+    series->scale = 10;
+    series->glyph = ':';
+    strcpy(series->top_label, "100%");
+    series->baseline = "0%";
+    monitor->cpu_utilization = series;
+
+    CpuState *cpu = &monitor->cpu;
+    calculate_cpu_utilization(&cpu->proc_stat, &scratch_arena, &cpu->preTotalCPU, &cpu->preIdleCPU, &cpu->finalTotalCPU, &cpu->finalIdleCPU);
+    return 0;
+}
+
+/**
+ * Samples the CPU utilization since the previous tick.
+ * 
+ * @param monitor The monitor holding the CPU series and `/proc/stat` state.
+ */
+void cpu_sample(Monitor *monitor)
+{
+    CpuState *cpu = &monitor->cpu;
+    monitor->cpu_utilization->value = (double)calculate_cpu_utilization(&cpu->proc_stat, &scratch_arena, &cpu->preTotalCPU, &cpu->preIdleCPU, &cpu->finalTotalCPU, &cpu->finalIdleCPU);
+}
+#endif
+
+#if SYSMON_WITH_CORES
+/**
+ * Collects the core count and maximum frequency once sampling has finished.
+ * 
+ * @param monitor The monitor to store the core information in.
+ */
+void cores_finish(Monitor *monitor)
+{
+    monitor->max_frequency = (double)calculate_max_frequency();
+    monitor->cores = calculate_cores();
+}
+
+/**
+ * Reads a core's cpufreq time_in_state table: one "kHz time" line per 
+ * P-state, the time in units of 10 ms.
+ * 
+ * @param core The core; its frequency list is filled in on the first read.
+ * @param times Receives the time in each of the core's P-states.
+ * @return The number of P-states read.
+ */
+int residency_read_freqs(CoreResidency *core, uint64_t *times)
+{
+    char buffer[2048];
+    ssize_t len = core->freq_fd != -1 ? pread(core->freq_fd, buffer, sizeof(buffer) - 1, 0) : -1;
+    if (len <= 0)
+    {
+        return 0;
+    }
+    buffer[len] = '\0';
+    int count = 0;
+    for (char *p = buffer; *p != '\0' && count < MAX_PSTATES; count++)
+    {
+        char *end;
+        unsigned long khz = strtoul(p, &end, 10);
+        if (end == p)
+        {
+            break;
+        }
+        core->freqs[count] = (uint32_t)khz;
+        times[count] = strtoull(end, &p, 10);
+    }
+    return count;
+}
+
+/**
+ * Sets up the C-state and P-state residency collector.
+ * 
+ * The per-core sysfs topology is only walked here, when the collector is 
+ * enabled: for each possible CPU the cpuidle/state<N>/time files and the 
+ * cpufreq stats/time_in_state file are opened once and re-read with pread() 
+ * every tick. Idle state names are taken from cpu0.
+ * 
+ * @param monitor The monitor to attach the table and panel to.
+ * @return 0 on success, -1 on failure.
+ */
+int cstates_setup(Monitor *monitor)
+{
+    ResidencyTable *table = &monitor->residency;
+    long possible = sysconf(_SC_NPROCESSORS_CONF);
+    int limit = possible > 0 && possible < CSTATE_MAX_CPUS ? (int)possible : CSTATE_MAX_CPUS;
+    table->cores = (CoreResidency *)arena_alloc(&run_arena, (size_t)limit * sizeof(CoreResidency));
+    if (table->cores == NULL)
+    {
+        fprintf(stderr, "Error:Memory allocation\n");
+        return -1;
+    }
+
+    char path[128];
+    for (int state = 0; state < MAX_IDLE_STATES; state++)
+    {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cpuidle/state%d/name", state);
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL)
+        {
+            break;
+        }
+        char *name = table->idle_names[state];
+        if (fgets(name, sizeof(table->idle_names[state]), fp) == NULL)
+        {
+            name[0] = '\0';
+        }
+        name[strcspn(name, "\n")] = '\0';
+        fclose(fp);
+        table->idle_states = state + 1;
+    }
+
+    table->min_khz = UINT32_MAX;
+    for (int cpu = 0; cpu < limit; cpu++)
+    {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+        if (access(path, F_OK) != 0)
+        {
+            continue;
+        }
+        CoreResidency *core = &table->cores[table->count];
+        core->cpu = cpu;
+        for (int state = 0; state < MAX_IDLE_STATES; state++)
+        {
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpuidle/state%d/time", cpu, state);
+            core->idle_fds[state] = state < table->idle_states ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+            core->idle_usec[state] = read_counter(core->idle_fds[state]);
+        }
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/stats/time_in_state", cpu);
+        core->freq_fd = open(path, O_RDONLY | O_CLOEXEC);
+        core->freq_count = residency_read_freqs(core, core->freq_time);
+        for (int f = 0; f < core->freq_count; f++)
+        {
+            table->max_khz = core->freqs[f] > table->max_khz ? core->freqs[f] : table->max_khz;
+            table->min_khz = core->freqs[f] < table->min_khz ? core->freqs[f] : table->min_khz;
+        }
+        table->count++;
+    }
+    if (table->idle_states == 0 && table->max_khz == 0)
+    {
+        fprintf(stderr, "Error: no cpuidle or cpufreq statistics on this system\n");
+        return -1;
+    }
+    table->last_ns = monotonic_ns();
+    monitor->cstates_panel = add_panel(monitor, 2 + table->count, CSTATES_PANEL_WIDTH);
+    return monitor->cstates_panel != NULL ? 0 : -1;
+}
+
+/**
+ * Writes one panel row: the share of the tick spent busy (C0) and in each 
+ * idle state, the average frequency, and the share of time at the highest 
+ * and lowest P-state.
+ * 
+ * @param line The panel line.
+ * @param width The panel width.
+ * @param label The row label, a CPU number or "all".
+ * @param table The residency table (for the state count and P-state bounds).
+ * @param idle The % of time in each idle state.
+ * @param mhz The average frequency, 0 if unknown.
+ * @param at_max The % of time at the highest P-state.
+ * @param at_min The % of time at the lowest P-state.
+ */
+void cstates_format_row(char *line, int width, const char *label, const ResidencyTable *table,
+                        const double *idle, double mhz, double at_max, double at_min)
+{
+    double busy = 100;
+    int used = snprintf(line, width + 1, "%-5s", label);
+    for (int state = 0; state < table->idle_states; state++)
+    {
+        busy -= idle[state];
+    }
+    used += snprintf(line + used, width + 1 - used, " %6.1f", busy < 0 ? 0.0 : busy);
+    for (int state = 0; state < table->idle_states && used < width; state++)
+    {
+        used += snprintf(line + used, width + 1 - used, " %6.1f", idle[state]);
+    }
+    if (table->max_khz > 0 && used < width)
+    {
+        snprintf(line + used, width + 1 - used, " %7.0f %6.1f %6.1f", mhz, at_max, at_min);
+    }
+}
+
+/**
+ * Samples each core's idle-state and P-state residency over the last tick 
+ * and rewrites the panel, with an "all" row averaging the cores.
+ * 
+ * @param monitor The monitor holding the residency table.
+ */
+void cstates_sample(Monitor *monitor)
+{
+    ResidencyTable *table = &monitor->residency;
+    TextPanel *panel = monitor->cstates_panel;
+    uint64_t now = monotonic_ns();
+    double elapsed_usec = (now - table->last_ns) / 1e3;
+    table->last_ns = now;
+    double total_idle[MAX_IDLE_STATES] = {0};
+    double total_mhz = 0, total_max = 0, total_min = 0;
+
+    for (int i = 0; i < table->count; i++)
+    {
+        CoreResidency *core = &table->cores[i];
+        for (int state = 0; state < table->idle_states; state++)
+        {
+            uint64_t usec = read_counter(core->idle_fds[state]);
+            core->idle_share[state] = elapsed_usec > 0 && usec >= core->idle_usec[state]
+                                          ? (usec - core->idle_usec[state]) * 100.0 / elapsed_usec
+                                          : 0;
+            core->idle_usec[state] = usec;
+            total_idle[state] += core->idle_share[state] / table->count;
+        }
+
+        uint64_t times[MAX_PSTATES];
+        int count = residency_read_freqs(core, times);
+        uint64_t sum = 0;
+        double weighted = 0;
+        for (int f = 0; f < count && f < core->freq_count; f++)
+        {
+            uint64_t delta = times[f] >= core->freq_time[f] ? times[f] - core->freq_time[f] : 0;
+            sum += delta;
+            weighted += delta * (core->freqs[f] / 1000.0);
+        }
+        for (int f = 0; f < count && f < core->freq_count; f++)
+        {
+            uint64_t delta = times[f] >= core->freq_time[f] ? times[f] - core->freq_time[f] : 0;
+            core->freq_share[f] = sum > 0 ? delta * 100.0 / sum : 0;
+            core->freq_time[f] = times[f];
+        }
+        core->average_mhz = sum > 0 ? weighted / sum : core->average_mhz;
+
+        double at_max = 0, at_min = 0;
+        for (int f = 0; f < core->freq_count; f++)
+        {
+            at_max += core->freqs[f] == table->max_khz ? core->freq_share[f] : 0;
+            at_min += core->freqs[f] == table->min_khz ? core->freq_share[f] : 0;
+        }
+        total_mhz += core->average_mhz / table->count;
+        total_max += at_max / table->count;
+        total_min += at_min / table->count;
+
+        char label[8];
+        snprintf(label, sizeof(label), "%d", core->cpu);
+        cstates_format_row(panel_line(panel, i + 2), panel->width, label, table, core->idle_share,
+                           core->average_mhz, at_max, at_min);
+    }
+    cstates_format_row(panel_line(panel, 1), panel->width, "all", table, total_idle, total_mhz, total_max, total_min);
+
+    snprintf(panel->title, sizeof(panel->title), "v C-state and P-state residency %% (P-states %.2f-%.2f GHz)",
+             table->max_khz > 0 ? table->min_khz / 1e6 : 0.0, table->max_khz / 1e6);
+    char *header = panel_line(panel, 0);
+    int used = snprintf(header, panel->width + 1, "%-5s %6s", "CPU", "C0");
+    for (int state = 0; state < table->idle_states && used < panel->width; state++)
+    {
+        used += snprintf(header + used, panel->width + 1 - used, " %6.6s", table->idle_names[state]);
+    }
+    if (table->max_khz > 0 && used < panel->width)
+    {
+        snprintf(header + used, panel->width + 1 - used, " %7s %6s %6s", "avg MHz", "@max", "@min");
+    }
+}
+#endif
+
+typedef struct
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} LinuxDirent64; // record returned by the getdents64 system call
+
+#if SYSMON_WITH_PROCS
+
+/**
+ * Finds the slot a pid hashes to.
+ * 
+ * @param table The process table.
+ * @param pid The process id.
+ * @return The index of the pid's home slot.
+ */
+size_t proc_home_slot(const ProcTable *table, pid_t pid)
+{
+    return ((uint32_t)pid * 2654435761u) & (table->slot_count - 1);
+}
+
+/**
+ * Looks up a process in the process table.
+ * 
+ * @param table The process table.
+ * @param pid The process id.
+ * @return The process' entry, or NULL if it is not tracked.
+ */
+ProcEntry *proc_find(ProcTable *table, pid_t pid)
+{
+    size_t mask = table->slot_count - 1;
+    for (size_t i = proc_home_slot(table, pid); table->entries[i].pid != 0; i = (i + 1) & mask)
+    {
+        if (table->entries[i].pid == pid)
+        {
+            return &table->entries[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Stops tracking a process: closes its descriptors and frees its slot.
+ * 
+ * Deletion shifts later entries of the same probe chain back into the freed 
+ * slot, so lookups never need tombstones.
+ * 
+ * @param table The process table.
+ * @param entry The entry to remove.
+ */
+void proc_remove(ProcTable *table, ProcEntry *entry)
+{
+    close(entry->stat_fd);
+    close(entry->dir_fd);
+    if (entry->io_fd != -1)
+    {
+        close(entry->io_fd);
+    }
+    size_t mask = table->slot_count - 1;
+    size_t hole = (size_t)(entry - table->entries);
+    size_t next = hole;
+    for (;;)
+    {
+        next = (next + 1) & mask;
+        if (table->entries[next].pid == 0)
+        {
+            break;
+        }
+        size_t home = proc_home_slot(table, table->entries[next].pid);
+        // Move the entry back unless its home slot lies cyclically in (hole, next]
+        bool stays = hole <= next ? (home > hole && home <= next) : (home > hole || home <= next);
+        if (!stays)
+        {
+            table->entries[hole] = table->entries[next];
+            hole = next;
+        }
+    }
+    memset(&table->entries[hole], 0, sizeof(ProcEntry));
+    table->count--;
+}
+
+/**
+ * Resolves the cgroup of a newly seen process and interns its path.
+ * 
+ * The unified hierarchy ("0::/path") is preferred; on a v1-only system the 
+ * first listed hierarchy is used instead.
+ * 
+ * @param table The process table holding the string table.
+ * @param dir_fd The process' /proc directory.
+ * @return The interned cgroup path, or `INTERN_FAILED`.
+ */
+uint32_t proc_read_cgroup(ProcTable *table, int dir_fd)
+{
+    char input_string[1024];
+    int fd = openat(dir_fd, "cgroup", O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return INTERN_FAILED;
+    }
+    ssize_t len = read(fd, input_string, sizeof(input_string) - 1);
+    close(fd);
+    if (len <= 0)
+    {
+        return INTERN_FAILED;
+    }
+    input_string[len] = '\0';
+
+    char *line = strstr(input_string, "0::");
+    if (line != input_string && (line == NULL || line[-1] != '\n'))
+    {
+        line = input_string;
+    }
+    char *path = strchr(line, ':');
+    path = path == NULL ? NULL : strchr(path + 1, ':');
+    if (path == NULL)
+    {
+        return INTERN_FAILED;
+    }
+    path++;
+    return intern_string(&table->strings, path, strcspn(path, "\n"));
+}
+
+/**
+ * Starts tracking a process seen for the first time.
+ * 
+ * The process' /proc directory and stat file are opened once and kept open. 
+ * Its owner and cgroup are resolved here and never re-read.
+ * 
+ * @param table The process table.
+ * @param pid The process id.
+ * @param name The process' directory name under /proc.
+ * @return The new entry, or NULL if the table is full or the process is gone.
+ */
+ProcEntry *proc_insert(ProcTable *table, pid_t pid, const char *name)
+{
+    if (table->count >= table->capacity)
+    {
+        table->untracked++;
+        return NULL;
+    }
+    int dir_fd = openat(table->proc_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1)
+    {
+        return NULL;
+    }
+    int stat_fd = openat(dir_fd, "stat", O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (stat_fd == -1 || fstat(dir_fd, &st) == -1)
+    {
+        if (stat_fd != -1)
+        {
+            close(stat_fd);
+        }
+        close(dir_fd);
+        return NULL;
+    }
+
+    size_t mask = table->slot_count - 1;
+    size_t i = proc_home_slot(table, pid);
+    while (table->entries[i].pid != 0)
+    {
+        i = (i + 1) & mask;
+    }
+    ProcEntry *entry = &table->entries[i];
+    memset(entry, 0, sizeof(ProcEntry));
+    entry->pid = pid;
+    entry->dir_fd = dir_fd;
+    entry->stat_fd = stat_fd;
+    entry->io_fd = openat(dir_fd, "io", O_RDONLY | O_CLOEXEC);
+    entry->uid = st.st_uid;
+    entry->cgroup = proc_read_cgroup(table, dir_fd);
+    table->count++;
+    return entry;
+}
+
+/**
+ * Re-reads a tracked process' I/O counters and updates its I/O rates. Only 
+ * storage I/O is counted (read_bytes, write_bytes), not reads served from 
+ * the page cache.
+ * 
+ * @param entry The process to update.
+ * @param first `true` if this is the process' first sample (no rate yet).
+ * @param seconds The time since the previous scan.
+ */
+void proc_read_io(ProcEntry *entry, bool first, double seconds)
+{
+    char input_string[512];
+    ssize_t len = entry->io_fd != -1 ? pread(entry->io_fd, input_string, sizeof(input_string) - 1, 0) : -1;
+    if (len <= 0)
+    {
+        return;
+    }
+    input_string[len] = '\0';
+    uint64_t read_bytes = 0, write_bytes = 0, cancelled_bytes = 0;
+    keyed_value(input_string, "read_bytes:", &read_bytes);
+    keyed_value(input_string, "write_bytes:", &write_bytes);
+    keyed_value(input_string, "cancelled_write_bytes:", &cancelled_bytes);
+    if (!first && seconds > 0)
+    {
+        entry->read_rate = (read_bytes - entry->read_bytes) / seconds;
+        entry->write_rate = (write_bytes - entry->write_bytes) / seconds;
+        entry->cancelled_rate = (cancelled_bytes - entry->cancelled_bytes) / seconds;
+    }
+    entry->read_bytes = read_bytes;
+    entry->write_bytes = write_bytes;
+    entry->cancelled_bytes = cancelled_bytes;
+}
+
+/**
+ * Re-reads a tracked process' stat file and updates its rates.
+ * 
+ * The fields used are the parent pid (4), utime and stime (14, 15), the 
+ * resident set in pages (24) and the aggregated block I/O delay (42). The 
+ * command name is in parentheses and may itself contain spaces and 
+ * parentheses, so parsing starts after the last ')'.
+ * 
+ * @param table The process table.
+ * @param entry The process to update.
+ * @param first `true` if this is the process' first sample (no rate yet).
+ * @param seconds The time since the previous scan.
+ * @return 0 on success, -1 if the process no longer exists.
+ */
+int proc_read_stat(ProcTable *table, ProcEntry *entry, bool first, double seconds)
+{
+    char input_string[1024];
+    ssize_t len = pread(entry->stat_fd, input_string, sizeof(input_string) - 1, 0);
+    if (len <= 0)
+    {
+        return -1;
+    }
+    input_string[len] = '\0';
+
+    char *open_paren = strchr(input_string, '(');
+    char *close_paren = strrchr(input_string, ')');
+    if (open_paren == NULL || close_paren == NULL || close_paren[1] == '\0')
+    {
+        return -1;
+    }
+    size_t comm_len = (size_t)(close_paren - open_paren - 1);
+    if (comm_len >= sizeof(entry->comm))
+    {
+        comm_len = sizeof(entry->comm) - 1;
+    }
+    memcpy(entry->comm, open_paren + 1, comm_len);
+    entry->comm[comm_len] = '\0';
+
+    unsigned long long fields[43] = {0};
+    char *p = close_paren + 4; // skip ") S "
+    for (int field = 4; field <= 42 && *p != '\0'; field++)
+    {
+        fields[field] = strtoull(p, &p, 10);
+    }
+
+    unsigned long long cpu_ticks = fields[14] + fields[15];
+    unsigned long long blkio_ticks = fields[42];
+    if (!first && seconds > 0)
+    {
+        entry->cpu = (cpu_ticks - entry->cpu_ticks) * 100.0 / table->clock_ticks / seconds;
+        entry->io_wait = (blkio_ticks - entry->blkio_ticks) * 1000.0 / table->clock_ticks / seconds;
+    }
+    entry->ppid = (pid_t)fields[4];
+    entry->cpu_ticks = cpu_ticks;
+    entry->blkio_ticks = blkio_ticks;
+    entry->rss = (size_t)fields[24] * table->page_size;
+    proc_read_io(entry, first, seconds);
+    return 0;
+}
+
+/**
+ * Finds or claims the aggregate slot for a group key.
+ * 
+ * @param groups The GROUP_SLOTS aggregate table.
+ * @param key The uid or interned cgroup path.
+ * @return The group's aggregate, or NULL if the table is full.
+ */
+GroupStat *group_slot(GroupStat *groups, uint32_t key)
+{
+    size_t i = (key * 2654435761u) & (GROUP_SLOTS - 1);
+    for (int probes = 0; probes < GROUP_SLOTS; probes++)
+    {
+        if (!groups[i].used || groups[i].key == key)
+        {
+            groups[i].used = true;
+            groups[i].key = key;
+            return &groups[i];
+        }
+        i = (i + 1) & (GROUP_SLOTS - 1);
+    }
+    return NULL;
+}
+
+/**
+ * Adds one process to a group aggregate.
+ * 
+ * @param groups The aggregate table.
+ * @param key The process' uid or cgroup.
+ * @param entry The process.
+ */
+void group_add(GroupStat *groups, uint32_t key, const ProcEntry *entry)
+{
+    GroupStat *group = group_slot(groups, key);
+    if (group != NULL)
+    {
+        group->processes++;
+        group->cpu += entry->cpu;
+        group->io_wait += entry->io_wait;
+        group->read_rate += entry->read_rate;
+        group->write_rate += entry->write_rate;
+        group->rss += entry->rss;
+    }
+}
+
+/**
+ * Looks up the login name of a uid in the names loaded from /etc/passwd.
+ * 
+ * @param table The process table holding the names.
+ * @param uid The user id.
+ * @return The login name, or NULL if the uid has none.
+ */
+const char *proc_user_name(const ProcTable *table, uid_t uid)
+{
+    for (int i = 0; i < table->user_count; i++)
+    {
+        if (table->user_ids[i] == uid)
+        {
+            return string_table_get(&table->strings, table->user_names[i]);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Loads login names from /etc/passwd into the process table.
+ * 
+ * Names are resolved once at setup because getpwuid() may allocate and load 
+ * NSS modules, neither of which belongs in the sampling loop.
+ * 
+ * @param table The process table.
+ */
+void proc_load_user_names(ProcTable *table)
+{
+    char input_string[512];
+    FILE *fp = fopen("/etc/passwd", "r");
+    if (fp == NULL)
+    {
+        return;
+    }
+    while (table->user_count < MAX_USER_NAMES && fgets(input_string, sizeof(input_string), fp))
+    {
+        char *uid_field = strchr(input_string, ':');
+        uid_field = uid_field == NULL ? NULL : strchr(uid_field + 1, ':');
+        if (uid_field == NULL)
+        {
+            continue;
+        }
+        uint32_t name = intern_string(&table->strings, input_string, strcspn(input_string, ":"));
+        if (name != INTERN_FAILED)
+        {
+            table->user_ids[table->user_count] = (uid_t)strtoul(uid_field + 1, NULL, 10);
+            table->user_names[table->user_count] = name;
+            table->user_count++;
+        }
+    }
+    fclose(fp);
+}
+
+/**
+ * Creates a target: a process or group of processes whose CPU and memory are 
+ * drawn over the system-wide graphs.
+ * 
+ * The target's CPU series is overlaid on the system CPU graph and its memory 
+ * series on the memory graph, sharing their scales. If a system graph is not 
+ * enabled, the first target gets a graph of its own with the same scale and 
+ * later targets are overlaid on it.
+ * 
+ * @param monitor The monitor to add the target to.
+ * @param kind The kind of target (TARGET_TREE, TARGET_PID or TARGET_NAME).
+ * @param name The target's label, e.g. "cmd", a pid or a name pattern.
+ * @return The new target, or NULL on failure.
+ */
+Target *add_target(Monitor *monitor, int kind, const char *name)
+{
+    if (monitor->target_count == MAX_TARGETS)
+    {
+        fprintf(stderr, "Error: too many targets (at most %d)\n", MAX_TARGETS);
+        return NULL;
+    }
+    Target *target = &monitor->targets[monitor->target_count];
+    static const char glyphs[MAX_TARGETS] = {'*', '+', 'o', 'x', '%', '@', '&', '='};
+    target->kind = kind;
+    snprintf(target->name, sizeof(target->name), "%s", name);
+    snprintf(target->cpu_name, sizeof(target->cpu_name), "%.23s.cpu", name);
+    snprintf(target->mem_name, sizeof(target->mem_name), "%.23s.mem", name);
+
+    target->cpu = add_series(monitor, target->cpu_name, target->name, "%");
+    target->mem = add_series(monitor, target->mem_name, target->name, "GB");
+    if (target->cpu == NULL || target->mem == NULL)
+    {
+        return NULL;
+    }
+    target->cpu->glyph = target->mem->glyph = glyphs[monitor->target_count];
+    Series *bases[2] = {monitor->cpu_utilization, monitor->memory_used};
+    for (int i = 0; i < 2 && monitor->target_count > 0; i++)
+    {
+        // Without a system graph, later targets share the first target's graph
+        Series *first = i == 0 ? monitor->targets[0].cpu : monitor->targets[0].mem;
+        bases[i] = bases[i] != NULL ? bases[i] : first;
+    }
+    Series *series[2] = {target->cpu, target->mem};
+    for (int i = 0; i < 2; i++)
+    {
+        if (bases[i] != NULL)
+        {
+            series[i]->overlay_of = bases[i];
+            series[i]->height = bases[i]->height;
+            series[i]->scale = bases[i]->scale;
+            bases[i]->overlays++;
+        }
+    }
+    if (bases[0] == NULL)
+    {
+        target->cpu->label = "v Target CPU ";
+        target->cpu->height = 11;
+        target->cpu->scale = 10;
+        strcpy(target->cpu->top_label, "100%");
+        target->cpu->baseline = "0%";
+    }
+    if (bases[1] == NULL)
+    {
+        long double max_memory = get_total_memory();
+        target->mem->label = "v Target Memory ";
+        target->mem->height = 10;
+        target->mem->scale = (double)(max_memory / 10);
+        sprintf(target->mem->top_label, "%.Lf GB", max_memory);
+        target->mem->baseline = "0 GB";
+    }
+    monitor->target_count++;
+    return target;
+}
+
+/**
+ * Decides whether a process belongs to the process tree of a wrapped command.
+ * 
+ * The parent chain is followed through the process table until the command's 
+ * pid is reached. Descendants orphaned by an exiting parent are re-parented to 
+ * this monitor (it is a child subreaper while a command runs), so reaching the 
+ * monitor's own pid also counts. The answer is memoized per scan.
+ * 
+ * @param table The process table.
+ * @param entry The process to classify.
+ * @param root The pid of the wrapped command.
+ * @return `true` if the process is the command or one of its descendants.
+ */
+bool proc_in_tree(ProcTable *table, ProcEntry *entry, pid_t root)
+{
+    if (entry->tree_generation == table->generation)
+    {
+        return entry->in_tree;
+    }
+    bool in_tree = false;
+    ProcEntry *ancestor = entry;
+    for (int depth = 0; ancestor != NULL && depth < 64; depth++)
+    {
+        if (ancestor->pid == root || ancestor->ppid == table->self)
+        {
+            in_tree = ancestor->pid != table->self;
+            break;
+        }
+        if (ancestor != entry && ancestor->tree_generation == table->generation)
+        {
+            in_tree = ancestor->in_tree;
+            break;
+        }
+        ancestor = ancestor->ppid > 1 ? proc_find(table, ancestor->ppid) : NULL;
+    }
+    entry->tree_generation = table->generation;
+    entry->in_tree = in_tree;
+    return in_tree;
+}
+
+/**
+ * Decides whether a process belongs to a target.
+ * 
+ * @param table The process table.
+ * @param entry The process to classify.
+ * @param target The target.
+ * @return `true` if the process's CPU and memory count towards the target.
+ */
+bool target_matches(ProcTable *table, ProcEntry *entry, const Target *target)
+{
+    switch (target->kind)
+    {
+    case TARGET_TREE:
+        return target->pid != 0 && proc_in_tree(table, entry, target->pid);
+    case TARGET_PID:
+        return entry->pid == target->pid;
+    case TARGET_NAME:
+        return fnmatch(target->pattern, entry->comm, 0) == 0;
+    }
+    return false;
+}
+
+/**
+ * Sums the CPU and resident memory of every process of each target into the 
+ * targets' series, using the scan that has just completed.
+ * 
+ * The table is walked once for all targets, so comparing several processes 
+ * costs no more /proc reads than watching one.
+ * 
+ * @param monitor The monitor holding the targets and the process table.
+ */
+void targets_update(Monitor *monitor)
+{
+    ProcTable *table = monitor->procs;
+    double cpu[MAX_TARGETS] = {0};
+    for (int t = 0; t < monitor->target_count; t++)
+    {
+        monitor->targets[t].processes = 0;
+        monitor->targets[t].rss = 0;
+    }
+    for (size_t i = 0; i < table->slot_count && monitor->target_count > 0; i++)
+    {
+        ProcEntry *entry = &table->entries[i];
+        for (int t = 0; t < monitor->target_count && entry->pid != 0; t++)
+        {
+            Target *target = &monitor->targets[t];
+            if (target_matches(table, entry, target))
+            {
+                target->processes++;
+                target->rss += entry->rss;
+                cpu[t] += entry->cpu;
+            }
+        }
+    }
+    for (int t = 0; t < monitor->target_count; t++)
+    {
+        Target *target = &monitor->targets[t];
+        if (target->rss > target->peak_rss)
+        {
+            target->peak_rss = target->rss;
+        }
+        target->cpu->value = cpu[t] / table->cpus;
+        target->mem->value = target->rss / (1024.0 * 1024.0 * 1024.0);
+        run_stats_add(&target->cpu_stats, target->cpu->value);
+        run_stats_add(&target->mem_stats, target->mem->value);
+    }
+}
+
+/**
+ * Sets up the process collector.
+ * 
+ * The table capacity comes from the memory plan, already limited to the 
+ * process table's share of the open file limit by plan_descriptors(), since 
+ * every tracked process keeps three descriptors open.
+ * 
+ * @param monitor The monitor to attach the process table and panel to.
+ * @return 0 on success, -1 on failure.
+ */
+int procs_setup(Monitor *monitor)
+{
+    ProcTable *table = (ProcTable *)arena_alloc(&run_arena, sizeof(ProcTable));
+    if (table == NULL)
+    {
+        fprintf(stderr, "Error:Memory allocation\n");
+        return -1;
+    }
+
+    size_t capacity = monitor->plan.process_capacity;
+    table->capacity = capacity;
+    table->slot_count = 16;
+    while (table->slot_count < capacity * 2)
+    {
+        table->slot_count *= 2;
+    }
+    table->entries = (ProcEntry *)arena_alloc(&run_arena, table->slot_count * sizeof(ProcEntry));
+    table->by_user = (GroupStat *)arena_alloc(&run_arena, GROUP_SLOTS * sizeof(GroupStat));
+    table->by_cgroup = (GroupStat *)arena_alloc(&run_arena, GROUP_SLOTS * sizeof(GroupStat));
+    if (table->entries == NULL || table->by_user == NULL || table->by_cgroup == NULL ||
+        string_table_init(&table->strings, &run_arena, PROC_STRING_POOL, PROC_STRING_SLOTS) == -1)
+    {
+        fprintf(stderr, "Error:Memory allocation\n");
+        return -1;
+    }
+    table->proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (table->proc_fd == -1)
+    {
+        fprintf(stderr, "Error: Failed opening /proc\n");
+        return -1;
+    }
+    table->clock_ticks = sysconf(_SC_CLK_TCK);
+    table->page_size = sysconf(_SC_PAGESIZE);
+    table->cpus = calculate_cores() > 0 ? calculate_cores() : 1;
+    table->self = getpid();
+    proc_load_user_names(table);
+
+    monitor->procs = table;
+    if (monitor->args->procs_view)
+    {
+        monitor->procs_panel = add_panel(monitor, 1 + monitor->args->top, PROCS_PANEL_WIDTH);
+        if (monitor->procs_panel == NULL)
+        {
+            return -1;
+        }
+    }
+    if (monitor->args->command != NULL && add_target(monitor, TARGET_TREE, "cmd") == NULL)
+    {
+        return -1;
+    }
+    for (int i = 0; i < monitor->args->target_spec_count; i++)
+    {
+        const char *spec = monitor->args->target_specs[i];
+        bool is_pid = spec[strspn(spec, "0123456789")] == '\0';
+        Target *target = add_target(monitor, is_pid ? TARGET_PID : TARGET_NAME, spec);
+        if (target == NULL)
+        {
+            return -1;
+        }
+        target->pid = is_pid ? (pid_t)strtol(spec, NULL, 10) : 0;
+        target->pattern = spec;
+    }
+    return 0;
+}
+
+/**
+ * Returns the value a process or group is ranked by.
+ * 
+ * @param sort_key SORT_CPU, SORT_RSS or SORT_IO.
+ * @param cpu The CPU usage in %.
+ * @param rss The resident set in bytes.
+ * @param io The storage reads plus writes in bytes per second.
+ * @return The ranking key.
+ */
+double procs_rank(int sort_key, double cpu, size_t rss, double io)
+{
+    return sort_key == SORT_RSS ? (double)rss : sort_key == SORT_IO ? io : cpu;
+}
+
+/**
+ * Writes the process table panel: either the top processes, or the top users 
+ * or cgroups by aggregated consumption.
+ * 
+ * @param monitor The monitor holding the process table and its panel.
+ */
+void procs_format(Monitor *monitor)
+{
+    ProcTable *table = monitor->procs;
+    TextPanel *panel = monitor->procs_panel;
+    ArgsInfo *args = monitor->args;
+    static const char *const sort_names[] = {"CPU", "RSS", "I/O"};
+    const char *sort_name = sort_names[args->sort_key];
+    int top[MAX_TOP];
+    double keys[MAX_TOP];
+    int count = 0;
+
+    for (int row = 0; row < panel->rows; row++)
+    {
+        panel_line(panel, row)[0] = '\0';
+    }
+
+    if (args->group_by == GROUP_NONE)
+    {
+        snprintf(panel->title, sizeof(panel->title), "v Processes (by %s, %zu tracked, %zu untracked)",
+                 sort_name, table->count, table->untracked);
+        snprintf(panel_line(panel, 0), panel->width + 1, "%8s %8s %7s %10s %8s %8s %8s %8s  %s",
+                 "PID", "UID", "CPU%", "RSS MiB", "IO ms/s", "READ/s", "WRITE/s", "CANCEL/s", "COMMAND");
+        for (size_t i = 0; i < table->slot_count; i++)
+        {
+            const ProcEntry *entry = &table->entries[i];
+            if (entry->pid != 0)
+            {
+                insert_top(top, keys, &count, args->top, (int)i,
+                           procs_rank(args->sort_key, entry->cpu, entry->rss, entry->read_rate + entry->write_rate));
+            }
+        }
+        for (int row = 0; row < count; row++)
+        {
+            const ProcEntry *entry = &table->entries[top[row]];
+            char rates[3][12] = {"-", "-", "-"};
+            if (entry->io_fd != -1)
+            {
+                format_bytes(rates[0], sizeof(rates[0]), entry->read_rate);
+                format_bytes(rates[1], sizeof(rates[1]), entry->write_rate);
+                format_bytes(rates[2], sizeof(rates[2]), entry->cancelled_rate);
+            }
+            snprintf(panel_line(panel, row + 1), panel->width + 1, "%8d %8u %7.1f %10.1f %8.1f %8s %8s %8s  %s",
+                     (int)entry->pid, (unsigned)entry->uid, entry->cpu, entry->rss / 1048576.0, entry->io_wait,
+                     rates[0], rates[1], rates[2], entry->comm);
+        }
+        return;
+    }
+
+    GroupStat *groups = args->group_by == GROUP_USER ? table->by_user : table->by_cgroup;
+    snprintf(panel->title, sizeof(panel->title), "v %s (by %s)", args->group_by == GROUP_USER ? "Users" : "Cgroups", sort_name);
+    snprintf(panel_line(panel, 0), panel->width + 1, "%-40s %6s %7s %10s %8s %8s %8s",
+             args->group_by == GROUP_USER ? "USER" : "CGROUP", "PROCS", "CPU%", "RSS MiB", "IO ms/s", "READ/s", "WRITE/s");
+    for (int i = 0; i < GROUP_SLOTS; i++)
+    {
+        if (groups[i].used)
+        {
+            insert_top(top, keys, &count, args->top, i,
+                       procs_rank(args->sort_key, groups[i].cpu, groups[i].rss, groups[i].read_rate + groups[i].write_rate));
+        }
+    }
+    for (int row = 0; row < count; row++)
+    {
+        const GroupStat *group = &groups[top[row]];
+        char uid_name[16];
+        const char *name;
+        if (args->group_by == GROUP_USER)
+        {
+            name = proc_user_name(table, (uid_t)group->key);
+            if (name == NULL)
+            {
+                snprintf(uid_name, sizeof(uid_name), "%u", (unsigned)group->key);
+                name = uid_name;
+            }
+        }
+        else
+        {
+            name = string_table_get(&table->strings, group->key);
+            size_t len = strlen(name);
+            if (len > 40)
+            {
+                name += len - 40; // keep the leaf end of long cgroup paths
+            }
+        }
+        char rates[2][12];
+        format_bytes(rates[0], sizeof(rates[0]), group->read_rate);
+        format_bytes(rates[1], sizeof(rates[1]), group->write_rate);
+        snprintf(panel_line(panel, row + 1), panel->width + 1, "%-40s %6d %7.1f %10.1f %8.1f %8s %8s",
+                 name, group->processes, group->cpu, group->rss / 1048576.0, group->io_wait, rates[0], rates[1]);
+    }
+}
+
+/**
+ * Scans /proc once and updates every tracked process, then rebuilds the 
+ * per-user and per-cgroup aggregates.
+ * 
+ * /proc is listed with getdents64 into the scratch arena. Processes seen for 
+ * the first time are inserted; tracked processes are re-read through their 
+ * cached stat descriptor; processes that have exited, or whose pid now belongs 
+ * to a new process, are dropped.
+ * 
+ * @param monitor The monitor holding the process table.
+ */
+void procs_sample(Monitor *monitor)
+{
+    ProcTable *table = monitor->procs;
+    uint64_t now = monotonic_ns();
+    double seconds = table->last_scan_ns == 0 ? 0 : (now - table->last_scan_ns) / 1e9;
+    table->last_scan_ns = now;
+    table->generation++;
+    table->untracked = 0;
+
+    char *buffer = (char *)arena_alloc(&scratch_arena, DIRENT_BUFFER_SIZE);
+    if (buffer == NULL)
+    {
+        return;
+    }
+    lseek(table->proc_fd, 0, SEEK_SET);
+    for (;;)
+    {
+        long len = syscall(SYS_getdents64, table->proc_fd, buffer, DIRENT_BUFFER_SIZE);
+        if (len <= 0)
+        {
+            break;
+        }
+        for (long offset = 0; offset < len;)
+        {
+            LinuxDirent64 *dirent = (LinuxDirent64 *)(buffer + offset);
+            offset += dirent->d_reclen;
+            if (!isdigit((unsigned char)dirent->d_name[0]))
+            {
+                continue;
+            }
+            pid_t pid = (pid_t)strtol(dirent->d_name, NULL, 10);
+            ProcEntry *entry = proc_find(table, pid);
+            bool first = entry == NULL;
+            if (entry != NULL && proc_read_stat(table, entry, false, seconds) == -1)
+            {
+                proc_remove(table, entry); // exited, or the pid was reused
+                entry = NULL;
+                first = true;
+            }
+            if (first)
+            {
+                entry = proc_insert(table, pid, dirent->d_name);
+                if (entry == NULL)
+                {
+                    continue;
+                }
+                if (proc_read_stat(table, entry, true, seconds) == -1)
+                {
+                    proc_remove(table, entry);
+                    continue;
+                }
+            }
+            entry->generation = table->generation;
+        }
+    }
+
+    for (size_t i = 0; i < table->slot_count;)
+    {
+        ProcEntry *entry = &table->entries[i];
+        if (entry->pid != 0 && entry->generation != table->generation)
+        {
+            proc_remove(table, entry); // a later entry may have moved into slot i
+            continue;
+        }
+        i++;
+    }
+    // Removals can wrap an entry from the start of the table into a later slot, so groups are summed afterwards
+    memset(table->by_user, 0, GROUP_SLOTS * sizeof(GroupStat));
+    memset(table->by_cgroup, 0, GROUP_SLOTS * sizeof(GroupStat));
+    for (size_t i = 0; i < table->slot_count; i++)
+    {
+        ProcEntry *entry = &table->entries[i];
+        if (entry->pid != 0)
+        {
+            group_add(table->by_user, (uint32_t)entry->uid, entry);
+            group_add(table->by_cgroup, entry->cgroup, entry);
+        }
+    }
+    targets_update(monitor);
+    if (monitor->procs_panel != NULL)
+    {
+        procs_format(monitor);
+    }
+}
+
+/**
+ * Does nothing; installed for SIGCHLD so that the sleep between samples is 
+ * interrupted as soon as a wrapped command exits.
+ * 
+ * @param signal_number The signal number (unused).
+ */
+void on_child_exit(int signal_number)
+{
+    (void)signal_number;
+}
+
+/**
+ * Starts the wrapped command given after `--`.
+ * 
+ * The monitor becomes a child subreaper first, so descendants orphaned while 
+ * the command runs stay attributable to it and are reaped here.
+ * 
+ * @param monitor The monitor holding the command and its target.
+ * @return 0 on success, -1 if the command cannot be started.
+ */
+int launch_command(Monitor *monitor)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_child_exit; // no SA_RESTART: usleep() returns early
+    sigaction(SIGCHLD, &action, NULL);
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+
+    fflush(stdout);
+    monitor->command.start_ns = monotonic_ns();
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        fprintf(stderr, "Error: cannot start %s\n", monitor->args->command[0]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        setrlimit(RLIMIT_NOFILE, &monitor->fd_limit); // the command gets the limit sysmon was given
+        execvp(monitor->args->command[0], monitor->args->command);
+        fprintf(stderr, "Error: cannot run %s\n", monitor->args->command[0]);
+        _exit(127);
+    }
+    monitor->command.pid = pid;
+    monitor->targets[0].pid = pid;
+    return 0;
+}
+
+/**
+ * Reaps the wrapped command and any orphaned descendants that have exited, 
+ * accumulating their resource usage.
+ * 
+ * @param monitor The monitor holding the command.
+ */
+void reap_command(Monitor *monitor)
+{
+    CommandRun *command = &monitor->command;
+    for (;;)
+    {
+        int status;
+        struct rusage usage;
+        pid_t pid = wait4(-1, &status, WNOHANG, &usage);
+        if (pid <= 0)
+        {
+            break;
+        }
+        if (pid == monitor->flight.snapshot_pid)
+        {
+            monitor->flight.snapshot_pid = 0; // a flight recorder snapshot, not part of the command
+            continue;
+        }
+        timeradd(&command->usage.ru_utime, &usage.ru_utime, &command->usage.ru_utime);
+        timeradd(&command->usage.ru_stime, &usage.ru_stime, &command->usage.ru_stime);
+        if (usage.ru_maxrss > command->usage.ru_maxrss)
+        {
+            command->usage.ru_maxrss = usage.ru_maxrss;
+        }
+        if (pid == command->pid)
+        {
+            command->status = status;
+            command->done = true;
+            command->end_ns = monotonic_ns();
+        }
+    }
+}
+
+/**
+ * Prints the distribution of a target's sampled CPU and memory over the whole 
+ * run to stderr.
+ * 
+ * @param target The target to summarize.
+ */
+void print_target_summary(Target *target)
+{
+    SeriesSummary summary;
+    arena_reset(&scratch_arena);
+    if (summarize_run(target->cpu, &target->cpu_stats, &scratch_arena, &summary) == 0)
+    {
+        fprintf(stderr, "  CPU %% of machine over %zu samples: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+                summary.count, summary.p50, summary.p90, summary.p99, summary.max);
+    }
+    if (summarize_run(target->mem, &target->mem_stats, &scratch_arena, &summary) == 0)
+    {
+        fprintf(stderr, "  RSS MiB over %zu samples: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+                summary.count, summary.p50 * 1024, summary.p90 * 1024, summary.p99 * 1024, summary.max * 1024);
+    }
+}
+
+/**
+ * Prints the wrapped command's resource summary to stderr, in the spirit of 
+ * /usr/bin/time: exit status, wall time, CPU time, peak resident memory and 
+ * the distribution of the sampled CPU and memory of its process tree.
+ * 
+ * @param monitor The monitor holding the command and its target.
+ */
+void print_command_summary(Monitor *monitor)
+{
+    CommandRun *command = &monitor->command;
+    Target *target = &monitor->targets[0];
+    double wall = (command->end_ns - command->start_ns) / 1e9;
+    double user = command->usage.ru_utime.tv_sec + command->usage.ru_utime.tv_usec / 1e6;
+    double system = command->usage.ru_stime.tv_sec + command->usage.ru_stime.tv_usec / 1e6;
+
+    fprintf(stderr, "Command: %s", monitor->args->command[0]);
+    for (int i = 1; monitor->args->command[i] != NULL; i++)
+    {
+        fprintf(stderr, " %s", monitor->args->command[i]);
+    }
+    if (WIFSIGNALED(command->status))
+    {
+        fprintf(stderr, "\n  killed by signal %d", WTERMSIG(command->status));
+    }
+    else
+    {
+        fprintf(stderr, "\n  exit status %d", WEXITSTATUS(command->status));
+    }
+    fprintf(stderr, ", wall %.3f s\n", wall);
+    fprintf(stderr, "  CPU time: user %.3f s, system %.3f s (%.0f%% of one CPU)\n",
+            user, system, wall > 0 ? (user + system) * 100.0 / wall : 0.0);
+    fprintf(stderr, "  peak RSS: %.1f MiB largest process, %.1f MiB whole tree (sampled)\n",
+            command->usage.ru_maxrss / 1024.0, target->peak_rss / 1048576.0);
+
+    print_target_summary(target);
+}
+
+/**
+ * Converts the wrapped command's wait status into this program's exit code, 
+ * the way shells do: the exit status, or 128 plus the signal number.
+ * 
+ * @param monitor The monitor holding the command.
+ * @return The exit code to return from main().
+ */
+int command_exit_code(const Monitor *monitor)
+{
+    if (WIFSIGNALED(monitor->command.status))
+    {
+        return 128 + WTERMSIG(monitor->command.status);
+    }
+    return WEXITSTATUS(monitor->command.status);
+}
+#endif
+
+#if SYSMON_WITH_CGROUPS
+/**
+ * Finds the cgroup v2 hierarchy: /sys/fs/cgroup, or /sys/fs/cgroup/unified on 
+ * hybrid systems.
+ * 
+ * @return The mount point, or NULL if there is no cgroup v2 hierarchy.
+ */
+const char *cgroup_v2_root()
+{
+    static const char *const roots[] = {"/sys/fs/cgroup", "/sys/fs/cgroup/unified"};
+    for (size_t i = 0; i < 2; i++)
+    {
+        char path[64];
+        snprintf(path, sizeof(path), "%s/cgroup.controllers", roots[i]);
+        if (access(path, R_OK) == 0)
+        {
+            return roots[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Resolves a cgroup to the directory holding a controller's files.
+ * 
+ * Paths starting with /sys/ are used as they are; other paths are relative to 
+ * the cgroup v2 hierarchy, or to the controller's v1 hierarchy when there is 
+ * no v2 one. Without a path the monitor's own cgroup is read from 
+ * /proc/self/cgroup: its v2 directory if it has the `probe` file (i.e. the 
+ * controller is enabled there), otherwise its directory in the controller's 
+ * v1 hierarchy.
+ * 
+ * @param spec The cgroup path, or NULL for our own cgroup.
+ * @param controller The controller, e.g. "cpu".
+ * @param probe A file that exists when the controller is enabled, e.g. "cpu.max".
+ * @param dir Receives the directory.
+ * @param size The size of `dir`.
+ * @return 0 on success, -1 if our own cgroup cannot be found.
+ */
+int cgroup_resolve(const char *spec, const char *controller, const char *probe, char *dir, size_t size)
+{
+    const char *v2_root = cgroup_v2_root();
+    if (spec != NULL)
+    {
+        if (strncmp(spec, "/sys/", 5) == 0)
+        {
+            snprintf(dir, size, "%s", spec);
+        }
+        else if (v2_root != NULL)
+        {
+            snprintf(dir, size, "%s/%s", v2_root, spec + (spec[0] == '/'));
+        }
+        else
+        {
+            snprintf(dir, size, "/sys/fs/cgroup/%s/%s", controller, spec + (spec[0] == '/'));
+        }
+        return 0;
+    }
+
+    FILE *fp = fopen("/proc/self/cgroup", "r");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "Error: Failed opening /proc/self/cgroup\n");
+        return -1;
+    }
+    char line[512];
+    char v1_path[256] = "";
+    char v2_path[256] = "";
+    bool found_v1 = false;
+    bool found_v2 = false;
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        line[strcspn(line, "\n")] = '\0';
+        char *controllers = strchr(line, ':'); // "id:controllers:path"
+        char *path = controllers != NULL ? strchr(controllers + 1, ':') : NULL;
+        if (path == NULL)
+        {
+            continue;
+        }
+        *path++ = '\0';
+        controllers++;
+        if (*controllers == '\0')
+        {
+            snprintf(v2_path, sizeof(v2_path), "%s", path);
+            found_v2 = true;
+        }
+        for (char *name = strtok(controllers, ","); name != NULL; name = strtok(NULL, ","))
+        {
+            if (strcmp(name, controller) == 0)
+            {
+                snprintf(v1_path, sizeof(v1_path), "%s", path);
+                found_v1 = true;
+            }
+        }
+    }
+    fclose(fp);
+
+    if (found_v2 && v2_root != NULL)
+    {
+        char probe_path[512];
+        snprintf(dir, size, "%s%s", v2_root, v2_path);
+        snprintf(probe_path, sizeof(probe_path), "%s/%s", dir, probe);
+        if (access(probe_path, R_OK) == 0 || !found_v1)
+        {
+            return 0;
+        }
+    }
+    if (found_v1)
+    {
+        snprintf(dir, size, "/sys/fs/cgroup/%s%s", controller, v1_path);
+        return 0;
+    }
+    fprintf(stderr, "Error: cannot find the %s cgroup of this process\n", controller);
+    return -1;
+}
+
+/**
+ * Reads a small file of a cgroup into a buffer: opened relative to the cached 
+ * directory descriptor, read once and closed.
+ * 
+ * @param dir_fd The cgroup directory.
+ * @param name The file name, e.g. "memory.current".
+ * @param buffer Receives the contents, NUL-terminated.
+ * @param size The size of the buffer.
+ * @return The number of bytes read, or -1 if the file is missing or unreadable.
+ */
+ssize_t cgroup_read_file(int dir_fd, const char *name, char *buffer, size_t size)
+{
+    int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    ssize_t len = read(fd, buffer, size - 1);
+    close(fd);
+    if (len < 0)
+    {
+        return -1;
+    }
+    buffer[len] = '\0';
+    return len;
+}
+
+/**
+ * Reads the CPU time a cgroup and all of its descendants have used.
+ * 
+ * @param node The cgroup.
+ * @param buffer A scratch buffer.
+ * @param size The size of the buffer.
+ * @return usage_usec from cpu.stat, or 0 if it cannot be read.
+ */
+uint64_t cgroup_read_usage(const CgroupNode *node, char *buffer, size_t size)
+{
+    if (node->cpu_fd == -1)
+    {
+        return 0;
+    }
+    ssize_t len = pread(node->cpu_fd, buffer, size - 1, 0);
+    if (len <= 0)
+    {
+        return 0;
+    }
+    buffer[len] = '\0';
+    char *field = strstr(buffer, "usage_usec ");
+    return field != NULL ? strtoull(field + 11, NULL, 10) : 0;
+}
+
+/**
+ * Reads the memory, I/O and pressure of a cgroup. All of them are hierarchical 
+ * in cgroup v2, so a collapsed node already accounts for its subtree.
+ * 
+ * @param tree The cgroup tree.
+ * @param node The cgroup to read.
+ * @param first `true` on the node's first read, when no I/O rate can be computed.
+ */
+void cgroup_read_details(CgroupTree *tree, CgroupNode *node, bool first)
+{
+    static const char *const pressure_files[3] = {"cpu.pressure", "memory.pressure", "io.pressure"};
+    char buffer[PROC_READ_SIZE];
+
+    node->has_memory = cgroup_read_file(node->dir_fd, "memory.current", buffer, sizeof(buffer)) > 0;
+    node->memory = node->has_memory ? (size_t)strtoull(buffer, NULL, 10) : 0;
+
+    uint64_t io_bytes = 0;
+    node->has_io = cgroup_read_file(node->dir_fd, "io.stat", buffer, sizeof(buffer)) >= 0;
+    for (char *field = buffer; node->has_io && (field = strstr(field, "bytes=")) != NULL; field += 6)
+    {
+        io_bytes += strtoull(field + 6, NULL, 10); // rbytes= and wbytes=
+    }
+    node->io_rate = !first && tree->seconds > 0 && io_bytes >= node->io_bytes ? (io_bytes - node->io_bytes) / tree->seconds : 0;
+    node->io_bytes = io_bytes;
+
+    node->has_pressure = false;
+    for (int i = 0; i < 3; i++)
+    {
+        node->pressure[i] = 0;
+        if (cgroup_read_file(node->dir_fd, pressure_files[i], buffer, sizeof(buffer)) > 0)
+        {
+            char *field = strstr(buffer, "avg10=");
+            node->pressure[i] = field != NULL ? strtof(field + 6, NULL) : 0;
+            node->has_pressure = true;
+        }
+    }
+}
+
+/**
+ * Releases a node and its whole subtree, closing their descriptors. The node 
+ * must already be unlinked from its parent.
+ * 
+ * @param tree The cgroup tree.
+ * @param index The node to release.
+ */
+void cgroup_release(CgroupTree *tree, int index)
+{
+    CgroupNode *node = &tree->nodes[index];
+    for (int child = node->first_child; child != -1;)
+    {
+        int next = tree->nodes[child].next_sibling;
+        cgroup_release(tree, child);
+        child = next;
+    }
+    close(node->dir_fd);
+    if (node->cpu_fd != -1)
+    {
+        close(node->cpu_fd);
+    }
+    node->used = false;
+    node->next_sibling = tree->free;
+    tree->free = index;
+    tree->count--;
+}
+
+/**
+ * Adds a cgroup directory to the tree, opening its directory and cpu.stat 
+ * descriptors once.
+ * 
+ * @param tree The cgroup tree.
+ * @param parent The parent node, or -1 for the root.
+ * @param dir_fd The directory it is opened relative to (ignored for the root).
+ * @param name The directory name, or the absolute path of the root.
+ * @return The new node's index, or -1 if the tree is full or the directory cannot be opened.
+ */
+int cgroup_add(CgroupTree *tree, int parent, int dir_fd, const char *name)
+{
+    size_t len = strlen(name);
+    if (tree->free == -1 || len >= CGROUP_NAME_SIZE)
+    {
+        tree->untracked++;
+        return -1;
+    }
+    int fd = parent == -1 ? open(name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+                          : openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        tree->untracked++;
+        return -1;
+    }
+    int index = tree->free;
+    CgroupNode *node = &tree->nodes[index];
+    tree->free = node->next_sibling;
+    tree->count++;
+    memset(node, 0, sizeof(*node));
+    node->used = true;
+    node->fresh = true;
+    node->parent = parent;
+    node->first_child = -1;
+    node->next_sibling = -1;
+    node->dir_fd = fd;
+    node->cpu_fd = openat(fd, "cpu.stat", O_RDONLY | O_CLOEXEC);
+    node->name_hash = hash_bytes(name, len);
+    memcpy(node->name, name, len + 1);
+    if (parent != -1)
+    {
+        CgroupNode *parent_node = &tree->nodes[parent];
+        node->depth = parent_node->depth + 1;
+        node->next_sibling = parent_node->first_child;
+        parent_node->first_child = index;
+    }
+    return index;
+}
+
+/**
+ * Re-lists a cgroup directory: new child cgroups are added and children whose 
+ * directory has gone are released with their subtrees.
+ * 
+ * @param tree The cgroup tree.
+ * @param index The node to list.
+ */
+void cgroup_list_children(CgroupTree *tree, int index)
+{
+    CgroupNode *node = &tree->nodes[index];
+    if (tree->dirents == NULL || node->depth >= 32)
+    {
+        return;
+    }
+    lseek(node->dir_fd, 0, SEEK_SET);
+    for (;;)
+    {
+        long len = syscall(SYS_getdents64, node->dir_fd, tree->dirents, DIRENT_BUFFER_SIZE);
+        if (len <= 0)
+        {
+            break;
+        }
+        for (long offset = 0; offset < len;)
+        {
+            LinuxDirent64 *dirent = (LinuxDirent64 *)(tree->dirents + offset);
+            offset += dirent->d_reclen;
+            if (dirent->d_type != DT_DIR || dirent->d_name[0] == '.')
+            {
+                continue;
+            }
+            uint32_t hash = hash_bytes(dirent->d_name, strlen(dirent->d_name));
+            int child = node->first_child;
+            while (child != -1 && (tree->nodes[child].name_hash != hash || strcmp(tree->nodes[child].name, dirent->d_name) != 0))
+            {
+                child = tree->nodes[child].next_sibling;
+            }
+            if (child == -1)
+            {
+                child = cgroup_add(tree, index, node->dir_fd, dirent->d_name);
+            }
+            if (child != -1)
+            {
+                tree->nodes[child].generation = tree->generation;
+            }
+        }
+    }
+    for (int *link = &node->first_child; *link != -1;)
+    {
+        int child = *link;
+        if (tree->nodes[child].generation != tree->generation)
+        {
+            *link = tree->nodes[child].next_sibling;
+            cgroup_release(tree, child);
+        }
+        else
+        {
+            link = &tree->nodes[child].next_sibling;
+        }
+    }
+}
+
+/**
+ * Marks a subtree as idle for this tick without reading it.
+ * 
+ * @param tree The cgroup tree.
+ * @param index The root of the subtree.
+ */
+void cgroup_idle(CgroupTree *tree, int index)
+{
+    CgroupNode *node = &tree->nodes[index];
+    node->cpu = 0;
+    node->io_rate = 0;
+    for (int child = node->first_child; child != -1; child = tree->nodes[child].next_sibling)
+    {
+        cgroup_idle(tree, child);
+    }
+}
+
+/**
+ * Updates a cgroup and, if it was active, its subtree.
+ * 
+ * cpu.stat usage_usec includes every descendant, so when it has not moved 
+ * since the last tick nothing below the node has run either: the subtree is 
+ * marked idle and none of its files are read. Every `CGROUP_RESCAN_TICKS` 
+ * ticks the whole tree is walked anyway, to pick up new or removed cgroups and 
+ * memory that changed without CPU activity (e.g. reclaim).
+ * 
+ * @param tree The cgroup tree.
+ * @param index The node to update.
+ * @param full `true` to walk the subtree even if it was idle.
+ */
+void cgroup_walk(CgroupTree *tree, int index, bool full)
+{
+    CgroupNode *node = &tree->nodes[index];
+    char buffer[512];
+    bool first = node->fresh;
+    node->fresh = false;
+    uint64_t usage = cgroup_read_usage(node, buffer, sizeof(buffer));
+    bool active = node->cpu_fd == -1 || usage != node->usage_usec;
+    node->cpu = !first && tree->seconds > 0 && usage > node->usage_usec
+                    ? (usage - node->usage_usec) / (tree->seconds * 1e4 * tree->cpus)
+                    : 0;
+    node->usage_usec = usage;
+    if (!active && !full && !first)
+    {
+        cgroup_idle(tree, index);
+        return;
+    }
+    tree->reread++;
+    cgroup_read_details(tree, node, first);
+    cgroup_list_children(tree, index);
+    for (int child = node->first_child; child != -1; child = tree->nodes[child].next_sibling)
+    {
+        cgroup_walk(tree, child, full);
+    }
+}
+
+/**
+ * Writes one cgroup and, down to `--cgroup-depth`, its busiest children into 
+ * the panel. Nodes with children are marked "-" when expanded and "+" when 
+ * collapsed; a collapsed node's figures already include its subtree.
+ * 
+ * @param monitor The monitor holding the tree and its panel.
+ * @param index The node to write.
+ * @param row The next free panel row; updated.
+ */
+void cgroup_format_node(Monitor *monitor, int index, int *row)
+{
+    CgroupTree *tree = monitor->cgroups;
+    TextPanel *panel = monitor->cgroups_panel;
+    const CgroupNode *node = &tree->nodes[index];
+    if (*row >= panel->rows)
+    {
+        return;
+    }
+    bool expanded = node->depth < monitor->args->cgroup_depth;
+    char name[2 * 16 + CGROUP_NAME_SIZE + 4]; // indent of the deepest --cgroup-depth level, marker, name
+    char memory[12] = "-";
+    char io[12] = "-";
+    char pressure[24] = "-";
+    snprintf(name, sizeof(name), "%*s%c %s", 2 * (node->depth < 16 ? node->depth : 16), "",
+             node->first_child == -1 ? ' ' : expanded ? '-' : '+', node->parent == -1 ? "/" : node->name);
+    if (node->has_memory)
+    {
+        format_bytes(memory, sizeof(memory), (double)node->memory);
+    }
+    if (node->has_io)
+    {
+        format_bytes(io, sizeof(io), node->io_rate);
+    }
+    if (node->has_pressure)
+    {
+        snprintf(pressure, sizeof(pressure), "%.1f %.1f %.1f", node->pressure[0], node->pressure[1], node->pressure[2]);
+    }
+    snprintf(panel_line(panel, (*row)++), panel->width + 1, "%-38.38s %6.1f %8s %8s  %s",
+             name, node->cpu, memory, io, pressure);
+    if (!expanded)
+    {
+        return;
+    }
+
+    int top[CGROUP_ROWS];
+    double keys[CGROUP_ROWS];
+    int count = 0;
+    int limit = panel->rows - *row;
+    for (int child = node->first_child; child != -1 && limit > 0; child = tree->nodes[child].next_sibling)
+    {
+        const CgroupNode *entry = &tree->nodes[child];
+        insert_top(top, keys, &count, limit, child, entry->cpu + entry->memory / 1e15);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        cgroup_format_node(monitor, top[i], row);
+    }
+}
+
+/**
+ * Sets up the cgroup tree collector on the cgroup v2 hierarchy: 
+ * /sys/fs/cgroup, or /sys/fs/cgroup/unified on hybrid systems.
+ * 
+ * Every tracked cgroup keeps two descriptors open, so the capacity from the 
+ * memory plan is limited to the cgroup tree's share of the open file limit by 
+ * plan_descriptors().
+ * 
+ * @param monitor The monitor to attach the tree and its panel to.
+ * @return 0 on success, -1 on failure.
+ */
+int cgroups_setup(Monitor *monitor)
+{
+    CgroupTree *tree = (CgroupTree *)arena_alloc(&run_arena, sizeof(CgroupTree));
+    size_t capacity = monitor->plan.cgroup_capacity;
+    CgroupNode *nodes = tree != NULL ? (CgroupNode *)arena_alloc(&run_arena, capacity * sizeof(CgroupNode)) : NULL;
+    if (nodes == NULL)
+    {
+        fprintf(stderr, "Error:Memory allocation\n");
+        return -1;
+    }
+    tree->root_path = cgroup_v2_root();
+    if (tree->root_path == NULL)
+    {
+        fprintf(stderr, "Error: no cgroup v2 hierarchy found\n");
+        return -1;
+    }
+
+    tree->nodes = nodes;
+    tree->capacity = capacity;
+    for (size_t i = 0; i < capacity; i++)
+    {
+        nodes[i].next_sibling = i + 1 < capacity ? (int)i + 1 : -1;
+    }
+    tree->free = capacity > 0 ? 0 : -1;
+    tree->cpus = calculate_cores() > 0 ? calculate_cores() : 1;
+    if (cgroup_add(tree, -1, -1, tree->root_path) != 0)
+    {
+        fprintf(stderr, "Error: Failed opening %s\n", tree->root_path);
+        return -1;
+    }
+    monitor->cgroups = tree;
+    monitor->cgroups_panel = add_panel(monitor, 1 + CGROUP_ROWS, CGROUPS_PANEL_WIDTH);
+    return monitor->cgroups_panel != NULL ? 0 : -1;
+}
+
+/**
+ * Walks the active part of the cgroup tree and rewrites the panel.
+ * 
+ * @param monitor The monitor holding the tree.
+ */
+void cgroups_sample(Monitor *monitor)
+{
+    CgroupTree *tree = monitor->cgroups;
+    TextPanel *panel = monitor->cgroups_panel;
+    uint64_t now = monotonic_ns();
+    tree->seconds = tree->last_walk_ns == 0 ? 0 : (now - tree->last_walk_ns) / 1e9;
+    tree->last_walk_ns = now;
+    tree->generation++;
+    tree->reread = 0;
+    tree->dirents = (char *)arena_alloc(&scratch_arena, DIRENT_BUFFER_SIZE);
+    cgroup_walk(tree, 0, monitor->tick % CGROUP_RESCAN_TICKS == 0);
+
+    snprintf(panel->title, sizeof(panel->title), "v Cgroups (%zu tracked, %zu re-read, %zu untracked)",
+             tree->count, tree->reread, tree->untracked);
+    for (int row = 0; row < panel->rows; row++)
+    {
+        panel_line(panel, row)[0] = '\0';
+    }
+    snprintf(panel_line(panel, 0), panel->width + 1, "%-38s %6s %8s %8s  %s",
+             "CGROUP", "CPU%", "MEM", "IO/s", "PSI cpu mem io");
+    int row = 1;
+    cgroup_format_node(monitor, 0, &row);
+}
+
+/**
+ * Reads the throttling counters of a cgroup's cpu.stat. cgroup v2 reports the 
+ * throttled time as throttled_usec, v1 as throttled_time in nanoseconds.
+ * 
+ * @param group The cgroup.
+ * @param periods Receives nr_periods.
+ * @param throttled Receives nr_throttled.
+ * @param throttled_usec Receives the throttled time in microseconds.
+ * @return 0 on success, -1 if cpu.stat cannot be read.
+ */
+int throttle_read(ThrottleGroup *group, uint64_t *periods, uint64_t *throttled, uint64_t *throttled_usec)
+{
+    char *text = read_proc_file(&group->cpu_stat, &scratch_arena, PROC_READ_SIZE);
+    if (text == NULL)
+    {
+        return -1;
+    }
+    *periods = *throttled = *throttled_usec = 0;
+    keyed_value(text, "nr_periods", periods);
+    keyed_value(text, "nr_throttled", throttled);
+    if (!keyed_value(text, "throttled_usec", throttled_usec) && keyed_value(text, "throttled_time", throttled_usec))
+    {
+        *throttled_usec /= 1000;
+    }
+    return 0;
+}
+
+/**
+ * Sets up the CPU throttling collector for the cgroups given with --cgroup, or 
+ * for our own cgroup.
+ * 
+ * The first cgroup gets a "CPU Throttled" graph of the share of enforcement 
+ * periods in which the quota ran out; further cgroups are overlaid on it.
+ * 
+ * @param monitor The monitor to add the series to.
+ * @return 0 on success, -1 on failure.
+ */
+int throttle_setup(Monitor *monitor)
+{
+    static const char glyphs[MAX_SELECTED_CGROUPS] = {'#', '+', 'o', 'x'};
+    ArgsInfo *args = monitor->args;
+    int count = args->cgroup_path_count > 0 ? args->cgroup_path_count : 1;
+    for (int i = 0; i < count; i++)
+    {
+        ThrottleGroup *group = &monitor->throttles[i];
+        const char *spec = args->cgroup_path_count > 0 ? args->cgroup_paths[i] : NULL;
+        char dir[160];
+        if (cgroup_resolve(spec, "cpu", "cpu.max", dir, sizeof(dir)) == -1)
+        {
+            return -1;
+        }
+        snprintf(group->path, sizeof(group->path), "%s/cpu.stat", dir);
+        const char *leaf = strrchr(dir, '/');
+        snprintf(group->name, sizeof(group->name), "%s", spec == NULL ? "self" : leaf != NULL && leaf[1] != '\0' ? leaf + 1 : "root");
+        snprintf(group->series_name, sizeof(group->series_name), "throttle.%s", group->name);
+        if (open_proc_file(&group->cpu_stat, group->path) == -1 ||
+            throttle_read(group, &group->periods, &group->throttled, &group->throttled_usec) == -1)
+        {
+            return -1;
+        }
+
+        Series *series = add_series(monitor, group->series_name, i == 0 ? "v CPU Throttled " : group->name, "%");
+        if (series == NULL)
+        {
+            return -1;
+        }
+        series->glyph = glyphs[i];
+        series->height = 10;
+        series->scale = 10;
+        strcpy(series->top_label, "100%");
+        series->baseline = "0%";
+        if (i > 0)
+        {
+            series->overlay_of = monitor->throttles[0].series;
+            series->overlay_of->overlays++;
+        }
+        group->series = series;
+        monitor->throttle_count++;
+    }
+    return 0;
+}
+
+/**
+ * Samples the throttled share of each cgroup's periods since the last tick. 
+ * The start of a throttling burst is recorded as an event, marked on the CPU 
+ * graph (or on the throttling graph when the CPU collector is off), since 
+ * that is where a latency spike with low average CPU needs explaining.
+ * 
+ * @param monitor The monitor holding the throttling state.
+ */
+void throttle_sample(Monitor *monitor)
+{
+    for (int i = 0; i < monitor->throttle_count; i++)
+    {
+        ThrottleGroup *group = &monitor->throttles[i];
+        uint64_t periods, throttled, throttled_usec;
+        if (throttle_read(group, &periods, &throttled, &throttled_usec) == -1)
+        {
+            group->series->value = 0;
+            continue;
+        }
+        uint64_t new_periods = periods - group->periods;
+        uint64_t new_throttled = throttled - group->throttled;
+        double throttled_ms = (throttled_usec - group->throttled_usec) / 1000.0;
+        group->series->value = new_periods > 0 ? 100.0 * new_throttled / new_periods : 0;
+        if (new_throttled > 0 && !group->throttling)
+        {
+            add_event(monitor, monitor->cpu_utilization != NULL ? monitor->cpu_utilization : group->series, '!',
+                      "%s throttled in %.0f%% of periods (%.1f ms)", group->name, group->series->value, throttled_ms);
+        }
+        group->throttling = new_throttled > 0;
+        group->periods = periods;
+        group->throttled = throttled;
+        group->throttled_usec = throttled_usec;
+    }
+}
+
+/**
+ * Opens a file of a cgroup relative to its directory, to be re-read every 
+ * tick with `read_proc_file`.
+ * 
+ * @param file Receives the open file; its descriptor is -1 if the file does not exist.
+ * @param dir_fd The cgroup directory.
+ * @param name The file name, which must outlive the file.
+ * @return 0 if the file was opened, -1 otherwise.
+ */
+int open_cgroup_file(ProcFile *file, int dir_fd, const char *name)
+{
+    file->path = name;
+    file->fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+    return file->fd == -1 ? -1 : 0;
+}
+
+/**
+ * Reads the memory event counters and memory.stat fields of a cgroup.
+ * 
+ * @param memcg The cgroup.
+ * @param counts Receives the event counters, indexed by MEMCG_LOW ... MEMCG_OOM_KILL.
+ * @return 0 on success, -1 if the event counters cannot be read.
+ */
+int memcg_read(MemoryCgroup *memcg, uint64_t *counts)
+{
+    static const char *const keys[MEMCG_EVENT_COUNT] = {"low", "high", "max", "oom", "oom_kill"};
+    char *text = read_proc_file(&memcg->events, &scratch_arena, PROC_READ_SIZE);
+    if (text == NULL)
+    {
+        return -1;
+    }
+    for (int i = 0; i < MEMCG_EVENT_COUNT; i++)
+    {
+        counts[i] = 0;
+        if (!memcg->v1)
+        {
+            keyed_value(text, keys[i], &counts[i]);
+        }
+    }
+    if (memcg->v1)
+    {
+        keyed_value(text, "oom_kill", &counts[MEMCG_OOM_KILL]);
+        char *failcnt = memcg->failcnt.fd != -1 ? read_proc_file(&memcg->failcnt, &scratch_arena, 64) : NULL;
+        counts[MEMCG_MAX] = failcnt != NULL ? strtoull(failcnt, NULL, 10) : 0;
+    }
+
+    text = memcg->stat.fd != -1 ? read_proc_file(&memcg->stat, &scratch_arena, 2 * PROC_READ_SIZE) : NULL;
+    if (text != NULL)
+    {
+        keyed_value(text, memcg->v1 ? "rss" : "anon", &memcg->anon);
+        keyed_value(text, memcg->v1 ? "cache" : "file", &memcg->file);
+        keyed_value(text, "shmem", &memcg->shmem);
+        keyed_value(text, "pgmajfault", &memcg->major_faults);
+    }
+    return 0;
+}
+
+/**
+ * Sets up memory event tracking for the cgroups given with --cgroup, or for 
+ * our own cgroup.
+ * 
+ * Each cgroup's memory.current is drawn over the memory graph (or over the 
+ * first cgroup's own graph when the memory collector is off), so the events 
+ * marked on that graph line up with the usage they explain. memory.stat 
+ * fields and event totals go to a panel.
+ * 
+ * @param monitor The monitor to add the series and panel to.
+ * @return 0 on success, -1 on failure.
+ */
+int memcg_setup(Monitor *monitor)
+{
+    static const char glyphs[MAX_SELECTED_CGROUPS] = {'=', '+', 'o', 'x'};
+    ArgsInfo *args = monitor->args;
+    int count = args->cgroup_path_count > 0 ? args->cgroup_path_count : 1;
+    long double max_memory = get_total_memory();
+    for (int i = 0; i < count; i++)
+    {
+        MemoryCgroup *memcg = &monitor->memcgs[i];
+        const char *spec = args->cgroup_path_count > 0 ? args->cgroup_paths[i] : NULL;
+        char dir[160];
+        if (cgroup_resolve(spec, "memory", "memory.events", dir, sizeof(dir)) == -1)
+        {
+            return -1;
+        }
+        memcg->dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (memcg->dir_fd == -1)
+        {
+            fprintf(stderr, "Error: Failed opening %s\n", dir);
+            return -1;
+        }
+        memcg->v1 = open_cgroup_file(&memcg->events, memcg->dir_fd, "memory.events") == -1;
+        if (memcg->v1)
+        {
+            open_cgroup_file(&memcg->events, memcg->dir_fd, "memory.oom_control");
+            open_cgroup_file(&memcg->current, memcg->dir_fd, "memory.usage_in_bytes");
+            open_cgroup_file(&memcg->failcnt, memcg->dir_fd, "memory.failcnt");
+        }
+        else
+        {
+            open_cgroup_file(&memcg->current, memcg->dir_fd, "memory.current");
+            memcg->failcnt.fd = -1;
+        }
+        open_cgroup_file(&memcg->stat, memcg->dir_fd, "memory.stat");
+        if (memcg->events.fd == -1 || memcg_read(memcg, memcg->counts) == -1)
+        {
+            fprintf(stderr, "Error: no memory events in %s\n", dir);
+            return -1;
+        }
+
+        const char *leaf = strrchr(dir, '/');
+        snprintf(memcg->name, sizeof(memcg->name), "%s", spec == NULL ? "self" : leaf != NULL && leaf[1] != '\0' ? leaf + 1 : "root");
+        snprintf(memcg->series_name, sizeof(memcg->series_name), "memcg.%s", memcg->name);
+        Series *series = add_series(monitor, memcg->series_name, memcg->name, "GB");
+        if (series == NULL)
+        {
+            return -1;
+        }
+        Series *base = monitor->memory_used != NULL ? monitor->memory_used : i > 0 ? monitor->memcgs[0].series : NULL;
+        series->glyph = glyphs[i];
+        series->height = 10;
+        series->scale = (double)(max_memory / series->height);
+        if (base != NULL)
+        {
+            series->overlay_of = base;
+            base->overlays++;
+        }
+        else
+        {
+            series->label = "v Cgroup Memory ";
+            series->gap = 1;
+            sprintf(series->top_label, "%.Lf GB", max_memory);
+            series->baseline = "0 GB";
+        }
+        memcg->series = series;
+        monitor->memcg_count++;
+    }
+    monitor->memcg_panel = add_panel(monitor, 1 + count, MEMCG_PANEL_WIDTH);
+    return monitor->memcg_panel != NULL ? 0 : -1;
+}
+
+/**
+ * Samples each cgroup's memory and turns increments of its memory event 
+ * counters into events marked on the memory graph, so that a sudden drop in 
+ * used memory can be told apart from an OOM kill.
+ * 
+ * @param monitor The monitor holding the cgroups.
+ */
+void memcg_sample(Monitor *monitor)
+{
+    static const char *const names[MEMCG_EVENT_COUNT] = {"low", "high", "max", "oom", "oom_kill"};
+    static const char glyphs[MEMCG_EVENT_COUNT] = {'l', 'h', 'M', 'O', 'K'};
+    TextPanel *panel = monitor->memcg_panel;
+    uint64_t now = monotonic_ns();
+    double seconds = monitor->memcg_last_ns == 0 ? 0 : (now - monitor->memcg_last_ns) / 1e9;
+    monitor->memcg_last_ns = now;
+
+    snprintf(panel->title, sizeof(panel->title), "v Cgroup memory events");
+    snprintf(panel_line(panel, 0), panel->width + 1, "%-16s %9s %9s %9s %9s %8s %6s %6s %6s %6s %6s",
+             "CGROUP", "CURRENT", "ANON", "FILE", "SHMEM", "MAJFLT/s", "LOW", "HIGH", "MAX", "OOM", "KILL");
+    for (int i = 0; i < monitor->memcg_count; i++)
+    {
+        MemoryCgroup *memcg = &monitor->memcgs[i];
+        uint64_t counts[MEMCG_EVENT_COUNT];
+        uint64_t major_faults = memcg->major_faults;
+        char *current = memcg->current.fd != -1 ? read_proc_file(&memcg->current, &scratch_arena, 64) : NULL;
+        memcg->series->value = current != NULL ? strtoull(current, NULL, 10) / (1024.0 * 1024.0 * 1024.0) : 0;
+        if (memcg_read(memcg, counts) == -1)
+        {
+            continue;
+        }
+        memcg->major_fault_rate = seconds > 0 && memcg->major_faults >= major_faults ? (memcg->major_faults - major_faults) / seconds : 0;
+        for (int e = 0; e < MEMCG_EVENT_COUNT; e++)
+        {
+            if (counts[e] > memcg->counts[e])
+            {
+                add_event(monitor, memcg->series, glyphs[e], "%s: %s +%llu (total %llu)", memcg->name, names[e],
+                          (unsigned long long)(counts[e] - memcg->counts[e]), (unsigned long long)counts[e]);
+            }
+            memcg->counts[e] = counts[e];
+        }
+
+        char sizes[4][12];
+        format_bytes(sizes[0], sizeof(sizes[0]), memcg->series->value * 1024.0 * 1024.0 * 1024.0);
+        format_bytes(sizes[1], sizeof(sizes[1]), (double)memcg->anon);
+        format_bytes(sizes[2], sizeof(sizes[2]), (double)memcg->file);
+        format_bytes(sizes[3], sizeof(sizes[3]), (double)memcg->shmem);
+        snprintf(panel_line(panel, i + 1), panel->width + 1, "%-16.16s %9s %9s %9s %9s %8.1f %6llu %6llu %6llu %6llu %6llu",
+                 memcg->name, sizes[0], sizes[1], sizes[2], sizes[3], memcg->major_fault_rate,
+                 (unsigned long long)memcg->counts[MEMCG_LOW], (unsigned long long)memcg->counts[MEMCG_HIGH],
+                 (unsigned long long)memcg->counts[MEMCG_MAX], (unsigned long long)memcg->counts[MEMCG_OOM],
+                 (unsigned long long)memcg->counts[MEMCG_OOM_KILL]);
+    }
+}
+#endif
+
+#if SYSMON_WITH_DISKS
+/**
+ * Parses the counters of one device's line of /proc/diskstats or of its 
+ * /sys/block/<dev>/stat file: reads completed, reads merged, sectors read, 
+ * ms reading, writes completed, writes merged, sectors written, ms writing, 
+ * requests in flight, ms with requests in flight and weighted ms in queue.
+ * 
+ * @param text The counters, starting with reads completed.
+ * @param fields Receives the DISK_FIELDS counters.
+ */
+void disk_parse(const char *text, unsigned long long *fields)
+{
+    char *p = (char *)text;
+    for (int i = 0; i < DISK_FIELDS; i++)
+    {
+        fields[i] = strtoull(p, &p, 10);
+    }
+}
+
+/**
+ * Reads a device's counters, from its pre-opened stat file or, when there is 
+ * none, from its line of /proc/diskstats.
+ * 
+ * @param monitor The monitor holding /proc/diskstats.
+ * @param disk The device.
+ * @param fields Receives the DISK_FIELDS counters.
+ * @return 0 on success, -1 if the device's counters cannot be found.
+ */
+int disk_read(Monitor *monitor, Disk *disk, unsigned long long *fields)
+{
+    if (disk->stat.fd != -1)
+    {
+        char *text = read_proc_file(&disk->stat, &scratch_arena, 256);
+        if (text == NULL)
+        {
+            return -1;
+        }
+        disk_parse(text, fields);
+        return 0;
+    }
+    char *text = monitor->diskstats.fd != -1 ? read_proc_file(&monitor->diskstats, &scratch_arena, 8 * PROC_READ_SIZE) : NULL;
+    size_t len = strlen(disk->name);
+    for (char *line = text; line != NULL && *line != '\0'; line = strchr(line, '\n'), line = line != NULL ? line + 1 : NULL)
+    {
+        char *name = line + strspn(line, " 0123456789"); // skip major and minor numbers
+        if (strncmp(name, disk->name, len) == 0 && name[len] == ' ')
+        {
+            disk_parse(name + len, fields);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Adds a block device, pre-opening its /sys/block/<dev>/stat file.
+ * 
+ * @param monitor The monitor to add the device to.
+ * @param name The device name, e.g. "sda".
+ * @return 0 on success, -1 if the device cannot be read.
+ */
+int disk_add(Monitor *monitor, const char *name)
+{
+    static const char glyphs[MAX_DISKS] = {'#', '+', 'o', 'x', '%', '@', '&', '='};
+    if (monitor->disk_count == MAX_DISKS)
+    {
+        fprintf(stderr, "Error: too many disks (at most %d)\n", MAX_DISKS);
+        return -1;
+    }
+    Disk *disk = &monitor->disks[monitor->disk_count];
+    snprintf(disk->name, sizeof(disk->name), "%s", name);
+    snprintf(disk->path, sizeof(disk->path), "/sys/block/%.31s/stat", name);
+    snprintf(disk->series_name, sizeof(disk->series_name), "disk.%.31s.await", name);
+    disk->stat.path = disk->path;
+    disk->stat.fd = open(disk->path, O_RDONLY | O_CLOEXEC);
+    if (disk_read(monitor, disk, disk->fields) == -1)
+    {
+        fprintf(stderr, "Error: no statistics for disk %s\n", name);
+        return -1;
+    }
+
+    Series *series = add_series(monitor, disk->series_name, disk->name, "ms");
+    if (series == NULL)
+    {
+        return -1;
+    }
+    series->glyph = glyphs[monitor->disk_count];
+    series->height = 10;
+    series->scale = 0.1;
+    if (monitor->disk_count > 0)
+    {
+        series->overlay_of = monitor->disks[0].series;
+        series->overlay_of->overlays++;
+    }
+    else
+    {
+        series->label = "v Disk latency ";
+        series->gap = 1;
+        series->auto_scale = true;
+        strcpy(series->top_label, "1 ms");
+        series->baseline = "0 ms";
+    }
+    disk->series = series;
+    monitor->disk_count++;
+    return 0;
+}
+
+/**
+ * Sets up the disk latency collector for the devices given with --disks=, or 
+ * for every block device except loop and RAM disks.
+ * 
+ * @param monitor The monitor to add the devices and panel to.
+ * @return 0 on success, -1 on failure.
+ */
+int disks_setup(Monitor *monitor)
+{
+    ArgsInfo *args = monitor->args;
+    monitor->diskstats.path = "/proc/diskstats";
+    monitor->diskstats.fd = open("/proc/diskstats", O_RDONLY | O_CLOEXEC);
+    for (int i = 0; i < args->disk_name_count; i++)
+    {
+        if (disk_add(monitor, args->disk_names[i]) == -1)
+        {
+            return -1;
+        }
+    }
+    if (args->disk_name_count == 0)
+    {
+        DIR *dir = opendir("/sys/block");
+        struct dirent *entry;
+        while (dir != NULL && (entry = readdir(dir)) != NULL && monitor->disk_count < MAX_DISKS)
+        {
+            if (entry->d_name[0] != '.' && strncmp(entry->d_name, "loop", 4) != 0 && strncmp(entry->d_name, "ram", 3) != 0)
+            {
+                disk_add(monitor, entry->d_name);
+            }
+        }
+        if (dir != NULL)
+        {
+            closedir(dir);
+        }
+    }
+    if (monitor->disk_count == 0)
+    {
+        fprintf(stderr, "Error: no block devices found\n");
+        return -1;
+    }
+    monitor->disks_last_ns = monotonic_ns();
+    monitor->disks_panel = add_panel(monitor, 1 + monitor->disk_count, DISKS_PANEL_WIDTH);
+    return monitor->disks_panel != NULL ? 0 : -1;
+}
+
+/**
+ * Samples every device's request rates, throughput, average read and write 
+ * latency, queue depth and utilization since the last tick.
+ * 
+ * Latency is the time spent by the requests completed during the tick 
+ * divided by their number, as in iostat's r_await and w_await; the queue 
+ * depth is the weighted time in queue divided by the elapsed time.
+ * 
+ * @param monitor The monitor holding the devices.
+ */
+void disks_sample(Monitor *monitor)
+{
+    TextPanel *panel = monitor->disks_panel;
+    uint64_t now = monotonic_ns();
+    double ms = (now - monitor->disks_last_ns) / 1e6;
+    monitor->disks_last_ns = now;
+
+    snprintf(panel->title, sizeof(panel->title), "v Disks");
+    snprintf(panel_line(panel, 0), panel->width + 1, "%-10s %8s %8s %8s %8s %8s %8s %6s %6s",
+             "DEVICE", "r/s", "w/s", "READ/s", "WRITE/s", "r_await", "w_await", "aqu-sz", "util%");
+    for (int i = 0; i < monitor->disk_count; i++)
+    {
+        Disk *disk = &monitor->disks[i];
+        unsigned long long fields[DISK_FIELDS];
+        if (disk_read(monitor, disk, fields) == -1 || ms <= 0)
+        {
+            continue;
+        }
+        unsigned long long delta[DISK_FIELDS];
+        for (int f = 0; f < DISK_FIELDS; f++)
+        {
+            delta[f] = fields[f] >= disk->fields[f] ? fields[f] - disk->fields[f] : 0;
+            disk->fields[f] = fields[f];
+        }
+        disk->reads = delta[0] * 1000.0 / ms;
+        disk->writes = delta[4] * 1000.0 / ms;
+        disk->read_bytes = delta[2] * 512 * 1000.0 / ms;
+        disk->write_bytes = delta[6] * 512 * 1000.0 / ms;
+        disk->read_await = delta[0] > 0 ? (double)delta[3] / delta[0] : 0;
+        disk->write_await = delta[4] > 0 ? (double)delta[7] / delta[4] : 0;
+        disk->queue_depth = delta[10] / ms;
+        disk->utilization = delta[9] * 100.0 / ms;
+        disk->series->value = delta[0] + delta[4] > 0 ? (double)(delta[3] + delta[7]) / (delta[0] + delta[4]) : 0;
+
+        char rates[2][12];
+        format_bytes(rates[0], sizeof(rates[0]), disk->read_bytes);
+        format_bytes(rates[1], sizeof(rates[1]), disk->write_bytes);
+        snprintf(panel_line(panel, i + 1), panel->width + 1, "%-10.10s %8.1f %8.1f %8s %8s %8.2f %8.2f %6.2f %6.1f",
+                 disk->name, disk->reads, disk->writes, rates[0], rates[1], disk->read_await, disk->write_await,
+                 disk->queue_depth, disk->utilization > 100 ? 100.0 : disk->utilization);
+    }
+}
+#endif
+
+/*
+ * Collector registration table. Only compiled-in collectors are listed, so a 
+ * minimal build carries neither their code nor their flags.
+ */
+static const Collector collectors[] = {
+#if SYSMON_WITH_MEMORY
+    {"memory", "--memory", offsetof(ArgsInfo, memory_flag), true, memory_setup, memory_sample, NULL},
+    {"writeback", "--writeback", offsetof(ArgsInfo, writeback_flag), false, writeback_setup, writeback_sample, NULL},
+#endif
+#if SYSMON_WITH_CPU
+    {"cpu", "--cpu", offsetof(ArgsInfo, cpu_flag), true, cpu_setup, cpu_sample, NULL},
+#endif
+#if SYSMON_WITH_CORES
+    {"cores", "--cores", offsetof(ArgsInfo, cores_flag), true, NULL, NULL, cores_finish},
+    {"cstates", "--cstates", offsetof(ArgsInfo, cstates_flag), false, cstates_setup, cstates_sample, NULL},
+#endif
+#if SYSMON_WITH_PROCS
+    {"procs", "--procs", offsetof(ArgsInfo, procs_flag), false, procs_setup, procs_sample, NULL},
+#endif
+#if SYSMON_WITH_CGROUPS
+    {"cgroups", "--cgroups", offsetof(ArgsInfo, cgroups_flag), false, cgroups_setup, cgroups_sample, NULL},
+    {"throttle", "--throttle", offsetof(ArgsInfo, throttle_flag), false, throttle_setup, throttle_sample, NULL},
+    {"memcg", "--memory-events", offsetof(ArgsInfo, memcg_flag), false, memcg_setup, memcg_sample, NULL},
+#endif
+#if SYSMON_WITH_DISKS
+    {"disks", "--disks", offsetof(ArgsInfo, disks_flag), false, disks_setup, disks_sample, NULL},
+#endif
+};
+#define COLLECTOR_COUNT ((int)(sizeof(collectors) / sizeof(collectors[0])))
+_Static_assert(COLLECTOR_COUNT <= MAX_COLLECTORS, "raise MAX_COLLECTORS");
+
+/**
+ * Returns the enable flag of a collector inside `ArgsInfo`.
+ * 
+ * @param argsInfo The parsed command-line arguments.
+ * @param collector The collector whose flag is wanted.
+ * @return A pointer to the collector's flag.
+ */
+bool *collector_flag(ArgsInfo *argsInfo, const Collector *collector)
+{
+    return (bool *)((char *)argsInfo + collector->flag_offset);
+}
+
+#if SYSMON_WITH_TERMINAL
+void terminal_begin(Monitor *monitor);
+void terminal_frame(Monitor *monitor);
+void terminal_redraw(Monitor *monitor);
+void terminal_end(Monitor *monitor);
+#endif
+#if SYSMON_WITH_HEADLESS
+void headless_begin(Monitor *monitor);
+void headless_frame(Monitor *monitor);
+void headless_end(Monitor *monitor);
+#endif
+
+/*
+ * Renderer registration table. The first entry is used unless another 
+ * renderer is selected by its flag.
+ */
+static const Renderer renderers[] = {
+#if SYSMON_WITH_TERMINAL
+    {"terminal", NULL, terminal_begin, terminal_frame, terminal_redraw, terminal_end},
+#endif
+#if SYSMON_WITH_HEADLESS
+    {"headless", "--headless", headless_begin, headless_frame, NULL, headless_end},
+#endif
+};
+#define RENDERER_COUNT ((int)(sizeof(renderers) / sizeof(renderers[0])))
+
+/**
+ * Determines if the current command-line argument (CLA) is a positional argument.
+ * 
+ * In the CLA syntax, positional arguments `[samples [tdelay]]` must appear before 
+ * flagged arguments (`--memory`, `--cpu`, `--cores`, `--samples=N`, `--tdelay=T`).
+ * This function validates whether an argument is positional, ensuring `samples` 
+ * and `tdelay` appear immediately after the executable name.
+ * 
+ * @param argsInfo A pointer to the structure containing command-line arguments.
+ * @param current_index A pointer to the current argument index being processed.
+ * @return `true` if the argument is valid and assigned to `samples` or `tdelay`; 
+ *         otherwise, `false` if the value is invalid, NULL, or out of order.
+ */
+bool isPositional(ArgsInfo *argsInfo, int current_index)
+{
+    char* arg = argsInfo->argv[current_index];
+    while (*arg) {
+        if (!isdigit((unsigned char)*arg)) // Check if character is not a digit
+            return false;
+        arg++;
+    }
+    return true;
+}
+
+/**
+ * Identifies and processes command-line flag arguments.
+ * 
+ * This function checks if the given argument is a recognized flag: the flag 
+ * of a compiled-in collector (`--memory`, `--cpu`, `--cores`) or renderer 
+ * (`--headless`), `--samples=N`, `--tdelay=T`, `--trace=FILE`, `--max-rss=SIZE`, 
+ * a process table option (`--group=user|cgroup`, `--sort=cpu|rss|io`, `--top=N`), 
+ * `--cgroup-depth=N` to expand the cgroup tree N levels deep, `--cgroup=PATH,...` 
+ * to point `--throttle` and `--memory-events` at other cgroups than our own, 
+ * `--disks=NAME,...` to pick block devices, or 
+ * `--pid=A,B,C` to compare processes by pid or name pattern. If a flag is 
+ * detected, it updates the corresponding field in the `argsInfo` structure.
+ * 
+ * @param argsInfo A pointer to the structure containing command-line arguments.
+ * @param current_index A pointer to the current argument index being processed.
+ * @return `true` if a valid flag is detected and processed; 
+ *         `false` if the argument is invalid or missing required values.
+ */
+bool isFlag(ArgsInfo *argsInfo, int *current_index)
+{
+    if (argsInfo == NULL || strlen(argsInfo->argv[*current_index]) == 0)
+    {
+        return false;
+    }
+    char *argv = argsInfo->argv[*current_index];
+    for (int i = 0; i < COLLECTOR_COUNT; i++)
+    {
+        if (strcmp(argv, collectors[i].flag) == 0)
+        {
+            *collector_flag(argsInfo, &collectors[i]) = true;
+            return true;
+        }
+    }
+    for (int i = 0; i < RENDERER_COUNT; i++)
+    {
+        if (renderers[i].flag != NULL && strcmp(argv, renderers[i].flag) == 0)
+        {
+            argsInfo->renderer = i;
+            return true;
+        }
+    }
+    if (strcmp(argv, "--overview") == 0)
+    {
+        argsInfo->overview_flag = true;
+        return true;
+    }
+    if (strncmp(argv, "--samples=", 10) == 0)
+    {
+        char *value_str = argv + 10;
+        if (value_str == NULL || *value_str == '\0')
+        {
+            fprintf(stderr, "Error: Missing value\n");
+            return false;
+        }
+
+        if(argsInfo->updated_sample == true){
+            fprintf(stderr,"Error: cannot have multiple sample values\n");
+            return false;
+        }
+        value_str = removeWhiteSpace(value_str);
+        char *endptr;
+        long value = strtol(value_str, &endptr, 10);
+
+        if(*endptr != '\0' || value <= 0){
+           fprintf(stderr,"Error: Invalid value for --samples\n");
+            return false;
+        }
+        else{
+            argsInfo->samples = (int)value;
+            argsInfo->updated_sample = true;
+            return true;
+        }
+    }
+    else if (strncmp(argv, "--tdelay=", 9) == 0)
+    {
+        char *value_str = argv + 9;
+         if (value_str == NULL || *value_str == '\0')
+        {
+            fprintf(stderr, "Error: Missing value\n");
+            return false;
+        }
+
+        if(argsInfo->updated_tdelay == true){
+            fprintf(stderr,"Error: cannot have multiple tdelay values\n");
+            return false;
+        }
+
+        value_str = removeWhiteSpace(value_str);
+        char *endptr;
+        long value = strtol(value_str, &endptr, 10);
+
+        if (*endptr != '\0' || value <= 0)
+        {
+           fprintf(stderr, "Error:Invalid value for tdelay\n");
+            return false;
+        }
+        else{
+            argsInfo->tdelay = value;
+            argsInfo->updated_tdelay = true;
+            return true;
+        }
+    }
+    else if (strncmp(argv, "--trace=", 8) == 0)
+    {
+        char *value_str = argv + 8;
+        if (*value_str == '\0')
+        {
+            fprintf(stderr, "Error: Missing value\n");
+            return false;
+        }
+        argsInfo->trace_file = value_str;
+        return true;
+    }
+    else if (strncmp(argv, "--flight=", 9) == 0)
+    {
+        char *value_str = argv + 9;
+        char *minutes = strchr(value_str, ',');
+        if (minutes != NULL)
+        {
+            *minutes++ = '\0';
+            char *endptr;
+            long value = strtol(minutes, &endptr, 10);
+            if (*endptr != '\0' || value <= 0 || value > 24 * 60)
+            {
+                fprintf(stderr, "Error: Invalid value for --flight\n");
+                return false;
+            }
+            argsInfo->flight_minutes = (int)value;
+        }
+        if (*value_str == '\0')
+        {
+            fprintf(stderr, "Error: Missing value\n");
+            return false;
+        }
+        argsInfo->flight_file = value_str;
+        return true;
+    }
+    else if (strncmp(argv, "--record=", 9) == 0 || strncmp(argv, "--control=", 10) == 0)
+    {
+        char *value_str = strchr(argv, '=') + 1;
+        if (*value_str == '\0')
+        {
+            fprintf(stderr, "Error: Missing value\n");
+            return false;
+        }
+        if (argv[2] == 'r')
+        {
+            argsInfo->record_file = value_str;
+        }
+        else
+        {
+            argsInfo->control_path = value_str;
+        }
+        return true;
+    }
+    else if (strncmp(argv, "--gate=", 7) == 0)
+    {
+        if (argv[7] == '\0')
+        {
+            fprintf(stderr, "Error: Missing value\n");
+            return false;
+        }
+        argsInfo->gate_rules = argv + 7;
+        // A gate is read by scripts: select the headless renderer when it is compiled in
+        for (int i = 0; i < RENDERER_COUNT; i++)
+        {
+            if (strcmp(renderers[i].name, "headless") == 0)
+            {
+                argsInfo->renderer = i;
+            }
+        }
+        return true;
+    }
+    else if (strncmp(argv, "--web=", 6) == 0)
+    {
+        char *value_str = argv + 6;
+        if (strchr(value_str, ':') == NULL)
+        {
+            fprintf(stderr, "Error: Invalid value for --web (expected ADDRESS:PORT)\n");
+            return false;
+        }
+        argsInfo->web_address = value_str;
+        return true;
+    }
+    else if (strncmp(argv, "--export-trace=", 15) == 0)
+    {
+        char *value_str = argv + 15;
+        if (*value_str == '\0')
+        {
+            fprintf(stderr, "Error: Missing value\n");
+            return false;
+        }
+        argsInfo->export_trace_file = value_str;
+        return true;
+    }
+    else if (strncmp(argv, "--markers=", 10) == 0)
+    {
+        char *value_str = argv + 10;
+        if (*value_str == '\0')
+        {
+            fprintf(stderr, "Error: Missing value\n");
+            return false;
+        }
+        argsInfo->markers_path = value_str;
+        return true;
+    }
+    else if (strncmp(argv, "--trigger=", 10) == 0)
+    {
+        char *value_str = argv + 10;
+        size_t name_length = strcspn(value_str, "<>");
+        for (int i = 0; i < CAPTURE_METRICS; i++)
+        {
+            if (strlen(capture_metrics[i]) == name_length && strncmp(value_str, capture_metrics[i], name_length) == 0)
+            {
+                argsInfo->trigger_metric = i;
+            }
+        }
+        char *endptr = value_str + name_length;
+        if (argsInfo->trigger_metric == -1 || *endptr == '\0')
+        {
+            fprintf(stderr, "Error: Invalid value for --trigger (expected cpu, psi.cpu, psi.memory or psi.io, then > or < and a percentage)\n");
+            return false;
+        }
+        argsInfo->trigger_above = *endptr == '>';
+        char *number = endptr + 1;
+        argsInfo->trigger_threshold = strtod(number, &endptr);
+        if (endptr == number || (*endptr != '\0' && strcmp(endptr, "%") != 0))
+        {
+            fprintf(stderr, "Error: Invalid value for --trigger\n");
+            return false;
+        }
+        return true;
+    }
+    else if (strncmp(argv, "--capture=", 10) == 0)
+    {
+        char *value_str = argv + 10;
+        char *prefix = strchr(value_str, ',');
+        if (prefix != NULL)
+        {
+            *prefix++ = '\0';
+            if (*prefix == '\0')
+            {
+                fprintf(stderr, "Error: Missing value\n");
+                return false;
+            }
+            argsInfo->capture_prefix = prefix;
+        }
+        char *endptr;
+        argsInfo->capture_pre_ms = strtoul(value_str, &endptr, 10);
+        if (*endptr != ':')
+        {
+            fprintf(stderr, "Error: Invalid value for --capture (expected PRE:POST in milliseconds)\n");
+            return false;
+        }
+        char *post = endptr + 1;
+        argsInfo->capture_post_ms = strtoul(post, &endptr, 10);
+        if (endptr == post || *endptr != '\0' || argsInfo->capture_pre_ms + argsInfo->capture_post_ms == 0)
+        {
+            fprintf(stderr, "Error: Invalid value for --capture (expected PRE:POST in milliseconds)\n");
+            return false;
+        }
+        return true;
+    }
+    else if (strncmp(argv, "--capture-rate=", 15) == 0)
+    {
+        char *endptr;
+        argsInfo->capture_rate = strtoul(argv + 15, &endptr, 10);
+        if (endptr == argv + 15 || *endptr != '\0' || argsInfo->capture_rate < 100)
+        {
+            fprintf(stderr, "Error: Invalid value for --capture-rate (at least 100 microseconds)\n");
+            return false;
+        }
+        return true;
+    }
+    else if (strncmp(argv, "--group=", 8) == 0)
+    {
+        char *value_str = argv + 8;
+        if (strcmp(value_str, "user") == 0)
+        {
+            argsInfo->group_by = GROUP_USER;
+        }
+        else if (strcmp(value_str, "cgroup") == 0)
+        {
+            argsInfo->group_by = GROUP_CGROUP;
+        }
+        else
+        {
+            fprintf(stderr, "Error: Invalid value for --group (user or cgroup)\n");
+            return false;
+        }
+        argsInfo->procs_flag = true;
+        return true;
+    }
+    else if (strncmp(argv, "--sort=", 7) == 0)
+    {
+        char *value_str = argv + 7;
+        if (strcmp(value_str, "cpu") == 0)
+        {
+            argsInfo->sort_key = SORT_CPU;
+        }
+        else if (strcmp(value_str, "rss") == 0)
+        {
+            argsInfo->sort_key = SORT_RSS;
+        }
+        else if (strcmp(value_str, "io") == 0)
+        {
+            argsInfo->sort_key = SORT_IO;
+        }
+        else
+        {
+            fprintf(stderr, "Error: Invalid value for --sort (cpu, rss or io)\n");
+            return false;
+        }
+        argsInfo->procs_flag = true;
+        return true;
+    }
+    else if (strncmp(argv, "--top=", 6) == 0)
+    {
+        char *endptr;
+        long value = strtol(argv + 6, &endptr, 10);
+        if (argv[6] == '\0' || *endptr != '\0' || value <= 0 || value > MAX_TOP)
+        {
+            fprintf(stderr, "Error: Invalid value for --top (1 to %d)\n", MAX_TOP);
+            return false;
+        }
+        argsInfo->top = (int)value;
+        argsInfo->procs_flag = true;
+        return true;
+    }
+    else if (strncmp(argv, "--cgroup-depth=", 15) == 0)
+    {
+        char *endptr;
+        long value = strtol(argv + 15, &endptr, 10);
+        if (argv[15] == '\0' || *endptr != '\0' || value < 0 || value > 16)
+        {
+            fprintf(stderr, "Error: Invalid value for --cgroup-depth (0 to 16)\n");
+            return false;
+        }
+        argsInfo->cgroup_depth = (int)value;
+        argsInfo->cgroups_flag = true;
+        return true;
+    }
+    else if (strncmp(argv, "--cgroup=", 9) == 0)
+    {
+        for (char *path = strtok(argv + 9, ","); path != NULL; path = strtok(NULL, ","))
+        {
+            if (argsInfo->cgroup_path_count == MAX_SELECTED_CGROUPS)
+            {
+                fprintf(stderr, "Error: too many cgroups for --cgroup (at most %d)\n", MAX_SELECTED_CGROUPS);
+                return false;
+            }
+            argsInfo->cgroup_paths[argsInfo->cgroup_path_count++] = path;
+        }
+        if (argsInfo->cgroup_path_count == 0)
+        {
+            fprintf(stderr, "Error: Missing value\n");
+            return false;
+        }
+        return true;
+    }
+    else if (strncmp(argv, "--disks=", 8) == 0)
+    {
+        for (char *name = strtok(argv + 8, ","); name != NULL; name = strtok(NULL, ","))
+        {
+            if (argsInfo->disk_name_count == MAX_DISKS)
+            {
+                fprintf(stderr, "Error: too many disks for --disks (at most %d)\n", MAX_DISKS);
+                return false;
+            }
+            argsInfo->disk_names[argsInfo->disk_name_count++] = name;
+        }
+        argsInfo->disks_flag = true;
+        return true;
+    }
+    else if (strncmp(argv, "--pid=", 6) == 0)
+    {
+        // Split the list in place; the specs point into argv for the whole run
+        for (char *spec = strtok(argv + 6, ","); spec != NULL; spec = strtok(NULL, ","))
+        {
+            if (argsInfo->target_spec_count == MAX_TARGETS)
+            {
+                fprintf(stderr, "Error: too many targets for --pid (at most %d)\n", MAX_TARGETS);
+                return false;
+            }
+            argsInfo->target_specs[argsInfo->target_spec_count++] = spec;
+        }
+        if (argsInfo->target_spec_count == 0)
+        {
+            fprintf(stderr, "Error: Missing value\n");
+            return false;
+        }
+        return true;
+    }
+    else if (strncmp(argv, "--max-rss=", 10) == 0)
+    {
+        char *value_str = argv + 10;
+        if (*value_str == '\0')
+        {
+            fprintf(stderr, "Error: Missing value\n");
+            return false;
+        }
+        if (parse_size(value_str, &argsInfo->max_rss) == -1 || argsInfo->max_rss == 0)
+        {
+            fprintf(stderr, "Error: Invalid value for --max-rss\n");
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Parses and processes command-line arguments to configure program settings.
+ * 
+ * This function determines which flags and positional arguments are provided 
+ * by the user. It ensures the correct order of arguments and applies default 
+ * values when necessary.
+ * 
+ * Behavior:
+ * - If no arguments are given, it enables every compiled-in collector that is 
+ *   on by default (memory, CPU, and core monitoring).
+ * - If arguments are provided:
+ *   - Positional arguments (samples, tdelay) must appear first.
+ *   - Flag arguments (--memory, --cpu, --cores, --samples=N, --tdelay=T) follow.
+ *   - `--pid=A,B,C` overlays the CPU and memory of each listed pid, or of all 
+ *     processes whose name matches a pattern such as `nginx*`, on the graphs.
+ *   - `--` ends the flags; everything after it is a command to run and measure. 
+ *     Its process tree is tracked through the process table, sampled every 
+ *     100 ms unless a delay is given, until the command exits.
+ *   - Errors are triggered for unknown or misplaced arguments.
+ * - If no collector flag is set, the default collectors are enabled.
+ * 
+ * @param argc The number of command-line arguments.
+ * @param argsInfo A pointer to the structure storing argument flags and values.
+ */
+int processCommandLineArguments(int argc, ArgsInfo* argsInfo){
+    if (argc > 1)
+    {
+        int current_index = 1;
+        if(argc >= 2 && isPositional(argsInfo,1)){
+            char *endptr;
+            long value = strtol(argsInfo->argv[1], &endptr, 10);
+            if(*endptr != '\0' || value <=0){
+                fprintf(stderr, "Error: invalid value for samples\n");
+                return -1;
+            }
+
+            argsInfo->samples = (int)value;
+            argsInfo->updated_sample = true;
+            current_index++;
+            if (argc >= 3 && isPositional(argsInfo,2)) {
+                value = strtol(argsInfo->argv[2], &endptr, 10);
+                if(*endptr != '\0' || value <=0){
+                    fprintf(stderr,"Error: invalid value for tdelay\n");
+                    return -1;
+                }
+                argsInfo->tdelay = (unsigned long)value;
+                argsInfo->updated_tdelay = true;
+                current_index++;
+            }
+        }
+        for (;current_index < argc; current_index++)
+        {
+            if (strcmp(argsInfo->argv[current_index], "--") == 0)
+            {
+#if SYSMON_WITH_PROCS
+                if (current_index + 1 == argc)
+                {
+                    fprintf(stderr, "Error: missing command after --\n");
+                    return -1;
+                }
+                argsInfo->command = &argsInfo->argv[current_index + 1];
+                break;
+#else
+                fprintf(stderr, "Error: running a command requires the process collector\n");
+                return -1;
+#endif
+            }
+            if (!isFlag(argsInfo, &current_index))
+            {
+                fprintf(stderr, "Error: Unknown argument\n");
+                return -1;
+            }
+        }
+    }
+    bool any_collector = false;
+    for (int i = 0; i < COLLECTOR_COUNT; i++)
+    {
+        any_collector = any_collector || *collector_flag(argsInfo, &collectors[i]);
+    }
+    if (!any_collector)
+    {
+        for (int i = 0; i < COLLECTOR_COUNT; i++)
+        {
+            *collector_flag(argsInfo, &collectors[i]) = collectors[i].default_on;
+        }
+    }
+    argsInfo->procs_view = argsInfo->procs_flag;
+#if !SYSMON_WITH_PROCS
+    if (argsInfo->target_spec_count > 0)
+    {
+        fprintf(stderr, "Error: --pid requires the process collector\n");
+        return -1;
+    }
+#endif
+    if (argsInfo->target_spec_count > 0)
+    {
+        // --pid targets are measured from the process table's scan
+        argsInfo->procs_flag = true;
+    }
+    if (argsInfo->command != NULL)
+    {
+        // The command's process tree is found through the process table
+        argsInfo->procs_flag = true;
+        if (!argsInfo->updated_tdelay)
+        {
+            argsInfo->tdelay = 100000;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Draws the initial structure of the graph, including the label, unit, height, 
+ * and baseline, based on available memory usage, CPU utilization, or sample count.
+ * 
+ * The function prints the graph's heading and vertical label, allowing values 
+ * to be updated dynamically in real-time based on collected data. It then draws 
+ * the y-axis and horizontal axis using escape codes specified in the assignment handout.
+ * 
+ * 
+ * @param label The title of the graph.
+ * @param unit The measurement unit (e.g., total memory in GB or CPU utilization in %).
+ * @param height The height of the y-axis.
+ * @param baseline The starting value for the y-axis (e.g., "0GB" or "0%").
+ * @param current_row A pointer to the current row position in the terminal.
+ * @param current_column A pointer to the current column position in the terminal.
+ * @param samples The number of data points to be plotted (minimum 20 for proper scaling).
+ * @return The cursor position where real-time updates should be applied.
+ */
+CursorPosition draw_graph(const char *label, const char *unit, int height, const char *baseline, int *current_row, int *current_column, int samples)
+{
+    printf("\033[%d;%dH%s\n", *current_row, *current_column, label);
+    CursorPosition pos = save_position(*current_row, *current_column + strlen(label) + 1);
+
+    // Move down 1 line to print the maximum unit
+    *(current_row) += 1;
+    printf("\033[%d;%dH %s", *current_row, *current_column, unit);
+
+    //align the rest of the graph 8 columns after the maximum unit
+    *(current_column) += 8;
+
+    for (int i = 0; i < height; i++)
+    {
+        printf("\033[%d;%dH|\n", *current_row + i, *current_column);
+    }
+    *(current_row) += height;
+
+    // Print label for the baseline
+    printf("\033[%d;%dH %s", *current_row, (int)(*(current_column) - strlen(baseline) - 2), baseline);
+
+    //** */ Print horizontal axis: If samples is smaller than 20, set the default samples to 20 to create a graph
+    if (samples < 20)
+    {
+        samples = 20;
+    }
+    for (int j = 0; j < samples + 1; j++)
+    {
+        printf("\033[%d;%dH\u2500", *(current_row), *(current_column) + j);
+    }
+
+    printf("%s", "\n");
+    *current_row += 1;
+
+    return pos;
+}
+
+/**
+ * Draws a visual representation of CPU cores in a grid format.
+ * 
+ * This function prints the number of available CPU cores along with their 
+ * maximum frequency. It then visualizes the cores as small box-like units 
+ * arranged in rows and columns.
+ * 
+ * The layout consists of:
+ * - A heading displaying the number of cores and their frequency.
+ * - A grid where each core is represented as a boxed unit.
+ * 
+ * The function dynamically adjusts the number of rows based on the total number 
+ * of cores, ensuring a maximum of 4 cores per row for readability.
+ * 
+ * Structure:
+ * ```
+ * +───+ +───+ +───+ +───+
+ * |   | |   | |   | |   |
+ * +───+ +───+ +───+ +───+
+ * ```
+ * 
+ * @param coresNumber The total number of CPU cores.
+ * @param currentcol A pointer to the current column position in the terminal.
+ * @param currentrow A pointer to the current row position in the terminal.
+ * @param frequency The maximum CPU frequency in GHz.
+ * @return A `CursorPosition` struct representing the final cursor position after drawing.
+ */
+CursorPosition coresGraph(int coresNumber, int *currentcol, int *currentrow, double frequency)
+{
+    (*currentrow) += 2;
+    printf("\033[%d;%dHv Number of Cores: %d @ %.2f GHz\n", *currentrow, *currentcol, coresNumber, frequency);
+    (*currentrow)++;
+
+    char *top = "+───+";
+    char *middle = "|   |";
+
+    int cols = 4;
+    int rows = (coresNumber + cols - 1) / cols;
+    int width = 6;
+
+    for (int row = 0; row < rows; row++)
+    {
+        for (int col = 0; col < cols; col++)
+        {
+            if (row * cols + col < coresNumber)
+            {
+                printf("\033[%d;%dH%s", *currentrow + row * 2, *currentcol + col * width, top);
+            }
+        }
+        printf("\n");
+
+        for (int col = 0; col < cols; col++)
+        {
+            if (row * cols + col < coresNumber)
+            {
+                printf("\033[%d;%dH%s", *currentrow + row * 2 + 1, *currentcol + col * width, middle);
+            }
+        }
+        printf("\n");
+
+        for (int col = 0; col < cols; col++)
+        {
+            if (row * cols + col < coresNumber)
+            {
+                printf("\033[%d;%dH%s", *currentrow + row * 2 + 2, *currentcol + col * width, top);
+            }
+        }
+
+        (*currentrow)++;
+        printf("\n");
+    }
+    (*currentrow) += rows * 2 + 2;
+    CursorPosition pos = save_position(*currentrow, 1);
+    return pos;
+}
+
+
+#if SYSMON_WITH_TERMINAL
+/**
+ * Clears the screen and lays out a graph for every series.
+ * 
+ * Graphs are stacked top to bottom in the order their collectors are 
+ * registered. The position of each graph's heading (where the latest value is 
+ * printed) and of its plot area are stored in the series.
+ * 
+ * @param monitor The monitor whose series are laid out.
+ */
+void terminal_begin(Monitor *monitor)
+{
+    ArgsInfo *argsInfo = monitor->args;
+    printf("\033c");  // Resets screen
+    printf("\033[H"); // position cursor at the top left corner
+
+    double seconds = argsInfo->tdelay / 1000000.0;
+    printf("Nbr of samples: %d -- every %lu microSecs (%f secs)", argsInfo->samples, argsInfo->tdelay, seconds);
+
+    monitor->current_column = 1;
+    monitor->current_row = 1;
+    for (int i = 0; i < monitor->series_count; i++)
+    {
+        Series *series = &monitor->series[i];
+        if (series->overlay_of != NULL)
+        {
+            continue;
+        }
+        change_line(series->gap);
+        monitor->current_row += series->gap;
+        monitor->current_column = 1;
+        series->heading = draw_graph(series->label, series->top_label, series->height, series->baseline,
+                                     &monitor->current_row, &monitor->current_column, argsInfo->samples);
+        series->plot = save_position(monitor->current_row - 1, monitor->current_column + 1);
+        series->overlays = 0;
+    }
+    // Overlaid series share their base's plot area; their values are printed after the base's heading
+    for (int i = 0; i < monitor->series_count; i++)
+    {
+        Series *series = &monitor->series[i];
+        Series *base = series->overlay_of;
+        if (base != NULL)
+        {
+            base->overlays++;
+            series->plot = base->plot;
+            series->heading = save_position(base->heading.row, base->heading.col + 20 * base->overlays);
+        }
+    }
+    for (int i = 0; i < monitor->panel_count; i++)
+    {
+        TextPanel *panel = &monitor->panels[i];
+        monitor->current_row += 1;
+        panel->origin = save_position(monitor->current_row, 1);
+        monitor->current_row += panel->rows + 1;
+    }
+}
+
+/**
+ * Plots one value of a series in a given column of its graph, clamped to the 
+ * graph's height. NaN values are gaps and are not plotted.
+ * 
+ * @param series The series (or overlay) being plotted.
+ * @param column The column offset from the start of the plot area.
+ * @param value The value to plot.
+ */
+void terminal_plot(const Series *series, int column, double value)
+{
+    if (value != value)
+    {
+        return; // a gap, such as a paused collector
+    }
+    int level = (int)(value / series->scale);
+    if (level < 0)
+    {
+        level = 0;
+    }
+    if (level > series->height - 1)
+    {
+        level = series->height - 1;
+    }
+    printf("\033[%d;%dH%c", series->plot.row - level - 1, series->plot.col + column, series->glyph);
+}
+
+/**
+ * Marks an event on the time axis of its graph.
+ * 
+ * @param event The event.
+ * @param column The column offset from the start of the plot area.
+ */
+void terminal_mark(const Event *event, int column)
+{
+    printf("\033[%d;%dH%c", event->series->plot.row, event->series->plot.col + column, event->glyph);
+}
+
+/**
+ * Draws an external marker as a vertical line through a graph's plot area.
+ * 
+ * @param base The series that owns the graph.
+ * @param column The column offset from the start of the plot area.
+ */
+void terminal_marker_line(const Series *base, int column)
+{
+    for (int row = 1; row <= base->height; row++)
+    {
+        printf("\033[%d;%dH|", base->plot.row - row, base->plot.col + column);
+    }
+}
+
+/**
+ * Draws an external marker across every graph, then plots the samples of its 
+ * tick again on top of the line.
+ * 
+ * @param monitor The monitor holding the series.
+ * @param event The marker.
+ */
+void terminal_marker(Monitor *monitor, const Event *event)
+{
+    for (int i = 0; i < monitor->series_count; i++)
+    {
+        if (monitor->series[i].overlay_of == NULL)
+        {
+            terminal_marker_line(&monitor->series[i], event->tick);
+        }
+    }
+    for (int i = 0; i < monitor->series_count; i++)
+    {
+        Series *series = &monitor->series[i];
+        size_t age = (size_t)(monitor->tick - event->tick); // samples pushed since the marker's tick
+        if (age < series->count && age < series->capacity)
+        {
+            terminal_plot(series, event->tick, series->history[(series->count - 1 - age) % series->capacity]);
+        }
+    }
+}
+
+/**
+ * Redraws a graph's plot area from history once it is full, so that the graph 
+ * scrolls: the newest `width` samples of the series and of everything 
+ * overlaid on it are plotted from the left edge, and the time axis is redrawn 
+ * with the markers of the events still in view.
+ * 
+ * With `--overview` the whole history ring is drawn instead, each column 
+ * standing for a bucket of consecutive samples: the glyph sits at the bucket's 
+ * mean and, for the base series, the span between its minimum and maximum is 
+ * filled with ':' so short spikes stay visible.
+ * 
+ * @param monitor The monitor holding the series.
+ * @param base The series that owns the graph.
+ * @param width The number of columns of the plot area.
+ */
+void terminal_replot(Monitor *monitor, Series *base, int width)
+{
+    for (int row = 1; row <= base->height; row++)
+    {
+        printf("\033[%d;%dH%*s", base->plot.row - row, base->plot.col, width, "");
+    }
+    size_t window = base->count < base->capacity ? base->count : base->capacity;
+    if (!monitor->args->overview_flag && window > (size_t)width)
+    {
+        window = (size_t)width;
+    }
+    size_t columns = window < (size_t)width ? window : (size_t)width;
+    // The newest sample is in the last plotted column
+    int first_tick = monitor->tick - (int)window + 1;
+    size_t kept = monitor->event_count < EVENT_RING_SIZE ? monitor->event_count : EVENT_RING_SIZE;
+    for (size_t i = monitor->event_count - kept; i < monitor->event_count; i++)
+    {
+        const Event *event = &monitor->events[i % EVENT_RING_SIZE];
+        if (event->marker && event->tick >= first_tick)
+        {
+            terminal_marker_line(base, (int)((size_t)(event->tick - first_tick) * columns / window));
+        }
+    }
+    for (int i = 0; i < monitor->series_count; i++)
+    {
+        Series *series = &monitor->series[i];
+        if (series != base && series->overlay_of != base)
+        {
+            continue;
+        }
+        // Series added after the base (such as a target that appeared later) start further right
+        long long first = (long long)series->count - (long long)window;
+        long long oldest = series->count < series->capacity ? 0 : (long long)(series->count - series->capacity);
+        for (size_t column = 0; column < columns; column++)
+        {
+            long long from = first + (long long)(column * window / columns);
+            long long to = first + (long long)((column + 1) * window / columns);
+            from = from < oldest ? oldest : from;
+            if (to <= from)
+            {
+                continue;
+            }
+            if (to - from == 1)
+            {
+                terminal_plot(series, (int)column, series->history[from % series->capacity]);
+                continue;
+            }
+            Reduction bucket;
+            reduce_history(series, (size_t)from, (size_t)(to - from), &bucket);
+            if (bucket.count == 0)
+            {
+                continue;
+            }
+            if (series == base)
+            {
+                int low = (int)(bucket.min / series->scale);
+                int high = (int)(bucket.max / series->scale);
+                for (int level = low < 0 ? 0 : low; level <= high && level < series->height; level++)
+                {
+                    printf("\033[%d;%dH:", series->plot.row - level - 1, series->plot.col + (int)column);
+                }
+            }
+            terminal_plot(series, (int)column, bucket.sum / bucket.count);
+        }
+    }
+    for (int column = 0; column < width; column++)
+    {
+        printf("\033[%d;%dH\u2500", base->plot.row, base->plot.col + column);
+    }
+    for (size_t i = monitor->event_count - kept; i < monitor->event_count; i++)
+    {
+        const Event *event = &monitor->events[i % EVENT_RING_SIZE];
+        if (event->series == base && event->tick >= first_tick)
+        {
+            terminal_mark(event, (int)((size_t)(event->tick - first_tick) * columns / window));
+        }
+    }
+}
+
+/**
+ * Grows the scale of an auto-scaled graph when the latest value of its series 
+ * or of an overlay no longer fits, to the next 1-2-5 step, then redraws the 
+ * y-axis label and the plot area with the new scale. Scales only grow, so the 
+ * graph stays comparable across a run.
+ * 
+ * @param monitor The monitor holding the series.
+ * @param base The auto-scaled series that owns the graph.
+ * @param width The number of columns of the plot area.
+ */
+void terminal_rescale(Monitor *monitor, Series *base, int width)
+{
+    double needed = base->value;
+    for (int i = 0; i < monitor->series_count; i++)
+    {
+        if (monitor->series[i].overlay_of == base && monitor->series[i].value > needed)
+        {
+            needed = monitor->series[i].value;
+        }
+    }
+    double top = base->scale * base->height;
+    if (needed <= top || needed <= 0 || needed - needed != 0) // also skips NaN and infinity
+    {
+        return;
+    }
+    if (top <= 0)
+    {
+        top = 1; // no scale to step from; start at the power of ten below the value
+        while (top * 10 <= needed)
+        {
+            top *= 10;
+        }
+        while (top > needed)
+        {
+            top /= 10;
+        }
+    }
+    while (top < needed)
+    {
+        double magnitude = 1; // power of ten at or below `top`
+        while (magnitude * 10 <= top)
+        {
+            magnitude *= 10;
+        }
+        while (magnitude > top)
+        {
+            magnitude /= 10;
+        }
+        double step = top / magnitude;
+        top = (step < 2 ? 2 : step < 5 ? 5 : 10) * magnitude;
+    }
+    base->scale = top / base->height;
+    for (int i = 0; i < monitor->series_count; i++)
+    {
+        if (monitor->series[i].overlay_of == base)
+        {
+            monitor->series[i].scale = base->scale;
+        }
+    }
+    snprintf(base->top_label, sizeof(base->top_label), "%g %s", top, base->unit);
+    printf("\033[%d;1H %-7s", base->plot.row - base->height, base->top_label);
+    terminal_replot(monitor, base, width);
+}
+
+/**
+ * Prints the latest value of every series and plots it in the next column. 
+ * Once a graph is full (only possible while running a command, which has no 
+ * fixed sample count) it scrolls instead. New events are marked on their 
+ * graph's time axis and the latest one is described on the top line.
+ * 
+ * @param monitor The monitor whose series are drawn.
+ */
+void terminal_frame(Monitor *monitor)
+{
+    int width = monitor->args->samples;
+    for (int i = 0; i < monitor->series_count; i++)
+    {
+        Series *series = &monitor->series[i];
+        if (series->overlay_of != NULL)
+        {
+            printf("\033[%d;%dH %c %s %.2f %s   ", series->heading.row, series->heading.col, series->glyph, series->label, series->value, series->unit);
+        }
+        else
+        {
+            printf("\033[%d;%dH %.2f %s          ", series->heading.row, series->heading.col, series->value, series->unit);
+        }
+        if (series->auto_scale)
+        {
+            terminal_rescale(monitor, series, width);
+        }
+        if (monitor->tick < width)
+        {
+            terminal_plot(series, monitor->tick, series->value);
+        }
+        else if (series->overlay_of == NULL)
+        {
+            terminal_replot(monitor, series, width);
+        }
+    }
+    for (; monitor->events_drawn < monitor->event_count; monitor->events_drawn++)
+    {
+        const Event *event = &monitor->events[monitor->events_drawn % EVENT_RING_SIZE];
+        if (event->series != NULL && event->tick < width)
+        {
+            terminal_mark(event, event->tick);
+        }
+        if (event->marker && event->tick < width)
+        {
+            terminal_marker(monitor, event);
+        }
+        printf("\033[1;64H %c %-*s", event->glyph, (int)sizeof(event->text), event->text);
+    }
+    for (int i = 0; i < monitor->panel_count; i++)
+    {
+        TextPanel *panel = &monitor->panels[i];
+        printf("\033[%d;%dH%-*s", panel->origin.row, panel->origin.col, panel->width, panel->title);
+        for (int row = 0; row < panel->rows; row++)
+        {
+            printf("\033[%d;%dH%-*s", panel->origin.row + 1 + row, panel->origin.col, panel->width, panel_line(panel, row));
+        }
+    }
+}
+
+/**
+ * Draws the whole screen again from history: the layout, every graph with 
+ * its event markers, and the panels. Used after frames were dropped.
+ * 
+ * @param monitor The monitor whose series are drawn.
+ */
+void terminal_redraw(Monitor *monitor)
+{
+    terminal_begin(monitor);
+    for (int i = 0; i < monitor->series_count; i++)
+    {
+        if (monitor->series[i].overlay_of == NULL)
+        {
+            terminal_replot(monitor, &monitor->series[i], monitor->args->samples);
+        }
+    }
+}
+
+/**
+ * Draws the cores panel (if enabled) below the graphs and leaves the cursor 
+ * after the last line of output.
+ * 
+ * @param monitor The monitor holding the layout and core information.
+ */
+void terminal_end(Monitor *monitor)
+{
+    CursorPosition ending_position = save_position(monitor->current_row, 1);
+    if (monitor->args->cores_flag)
+    {
+        monitor->current_column = 1;
+        monitor->current_row += 1;
+        ending_position = coresGraph(monitor->cores, &monitor->current_column, &monitor->current_row, monitor->max_frequency);
+    }
+    printf("\033[%d;%dH", ending_position.row, ending_position.col);
+}
+#endif
+
+#if SYSMON_WITH_HEADLESS
+/**
+ * Prints the headless header: the sampling parameters and one column name per 
+ * series, so the output can be read by scripts and spreadsheets.
+ * 
+ * @param monitor The monitor whose series are printed.
+ */
+void headless_begin(Monitor *monitor)
+{
+    printf("# Nbr of samples: %d -- every %lu microSecs\n", monitor->args->samples, monitor->args->tdelay);
+    printf("tick\ttime");
+    for (int i = 0; i < monitor->series_count; i++)
+    {
+        printf("\t%s[%s]", monitor->series[i].name, monitor->series[i].unit);
+    }
+    printf("\n");
+}
+
+/**
+ * Prints one tab-separated line per tick: the tick index, the seconds since 
+ * the monitor started and the latest value of every series. Events seen 
+ * during the tick follow as "# event" comment lines.
+ * 
+ * @param monitor The monitor whose series are printed.
+ */
+void headless_frame(Monitor *monitor)
+{
+    printf("%d\t%.3f", monitor->tick, (monotonic_ns() - monitor->start_ns) / 1e9);
+    for (int i = 0; i < monitor->series_count; i++)
+    {
+        printf("\t%.2f", monitor->series[i].value);
+    }
+    printf("\n");
+    for (; monitor->events_drawn < monitor->event_count; monitor->events_drawn++)
+    {
+        const Event *event = &monitor->events[monitor->events_drawn % EVENT_RING_SIZE];
+        printf("# %s\t%d\t%.3f\t%s\n", event->marker ? "marker" : "event", event->tick, (event->t_ns - monitor->start_ns) / 1e9, event->text);
+    }
+}
+
+/**
+ * Prints the final contents of every text panel and the core information (if 
+ * enabled) as trailing comment lines.
+ * 
+ * @param monitor The monitor holding the core information.
+ */
+void headless_end(Monitor *monitor)
+{
+    for (int i = 0; i < monitor->panel_count; i++)
+    {
+        TextPanel *panel = &monitor->panels[i];
+        printf("# %s\n", panel->title);
+        for (int row = 0; row < panel->rows; row++)
+        {
+            if (panel_line(panel, row)[0] != '\0')
+            {
+                printf("# %s\n", panel_line(panel, row));
+            }
+        }
+    }
+    if (monitor->args->cores_flag)
+    {
+        printf("# cores: %d @ %.2f GHz\n", monitor->cores, monitor->max_frequency);
+    }
+}
+#endif
+
+/*
+ * The --web dashboard page. It draws one chart per graph from the "series" 
+ * message (names and units) and the per-tick "data" messages (values).
+ */
+static const char web_page[] =
+    "<!DOCTYPE html><html><head><meta charset=\"utf-8\"><title>sysmon</title><style>"
+    "body{font:13px monospace;background:#111;color:#ddd;margin:1em}"
+    "canvas{background:#1b1b1b;display:block;margin:2px 0 12px}#events{white-space:pre;color:#fc6}"
+    "</style></head><body><div id=\"status\">connecting</div><div id=\"charts\"></div><div id=\"events\"></div><script>"
+    "const N=300;let series=[],data=[];"
+    "const src=new EventSource('/events');"
+    "src.addEventListener('series',e=>{series=JSON.parse(e.data);data=series.map(()=>[]);"
+    "const c=document.getElementById('charts');c.innerHTML='';"
+    "series.forEach((s,i)=>{const h=document.createElement('div');h.id='h'+i;c.appendChild(h);"
+    "const k=document.createElement('canvas');k.id='c'+i;k.width=900;k.height=90;c.appendChild(k);});});"
+    "src.onmessage=e=>{const f=JSON.parse(e.data);"
+    "document.getElementById('status').textContent='tick '+f.tick+'  '+f.time.toFixed(1)+' s';"
+    "f.values.forEach((v,i)=>{if(!data[i])return;data[i].push(v);if(data[i].length>N)data[i].shift();draw(i);});"
+    "f.events.forEach(t=>{document.getElementById('events').textContent+=f.tick+'  '+t+'\\n';});};"
+    "src.onerror=()=>{document.getElementById('status').textContent='disconnected';};"
+    "function draw(i){const k=document.getElementById('c'+i),g=k.getContext('2d'),d=data[i];"
+    "let m=0;d.forEach(v=>{if(v!==null&&v>m)m=v;});m=m||1;"
+    "g.clearRect(0,0,k.width,k.height);g.strokeStyle='#6cf';g.beginPath();let up=false;"
+    "d.forEach((v,x)=>{if(v===null){up=false;return;}const X=x*k.width/N,Y=k.height-v/m*(k.height-4)-2;"
+    "up?g.lineTo(X,Y):g.moveTo(X,Y);up=true;});g.stroke();"
+    "const l=d[d.length-1];document.getElementById('h'+i).textContent=series[i].name+'  '+"
+    "(l===null?'-':l.toFixed(2))+' '+series[i].unit+'  (max '+m.toFixed(2)+')';}"
+    "</script></body></html>";
+
+/**
+ * Starts the --web dashboard: a non-blocking TCP listener, and per-client 
+ * send queues and the shared frame buffer carved out of the run arena.
+ * 
+ * @param monitor The monitor.
+ * @return 0 on success, -1 on failure.
+ */
+int web_setup(Monitor *monitor)
+{
+    WebServer *web = &monitor->web;
+    char host[64];
+    const char *address = monitor->args->web_address;
+    const char *colon = strrchr(address, ':');
+    snprintf(host, sizeof(host), "%.*s", (int)(colon - address), address);
+    struct sockaddr_in bind_address;
+    memset(&bind_address, 0, sizeof(bind_address));
+    bind_address.sin_family = AF_INET;
+    char *endptr;
+    unsigned long port = strtoul(colon + 1, &endptr, 10);
+    if (endptr == colon + 1 || *endptr != '\0' || port < 1 || port > 65535)
+    {
+        fprintf(stderr, "Error: invalid --web port %s (expected 1-65535)\n", colon + 1);
+        return -1;
+    }
+    bind_address.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &bind_address.sin_addr) != 1)
+    {
+        fprintf(stderr, "Error: invalid --web address %s\n", host);
+        return -1;
+    }
+    int yes = 1;
+    web->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (web->fd == -1 || setsockopt(web->fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) == -1 ||
+        bind(web->fd, (struct sockaddr *)&bind_address, sizeof(bind_address)) == -1 || listen(web->fd, MAX_WEB_CLIENTS) == -1)
+    {
+        fprintf(stderr, "Error: cannot listen on %s\n", address);
+        return -1;
+    }
+    web->frame = (char *)arena_alloc(&run_arena, WEB_FRAME_SIZE);
+    for (int i = 0; i < MAX_WEB_CLIENTS; i++)
+    {
+        web->clients[i].fd = -1;
+        web->clients[i].queue = (char *)arena_alloc(&run_arena, WEB_QUEUE_SIZE);
+        if (web->clients[i].queue == NULL)
+        {
+            break;
+        }
+    }
+    if (web->frame == NULL || web->clients[MAX_WEB_CLIENTS - 1].queue == NULL)
+    {
+        fprintf(stderr, "Error: cannot allocate the web client queues\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Disconnects a web client and frees its slot.
+ * 
+ * @param client The client.
+ */
+void web_drop(WebClient *client)
+{
+    close(client->fd);
+    client->fd = -1;
+}
+
+/**
+ * Sends bytes to a web client behind whatever it has queued. What the socket 
+ * does not take is queued; a client that falls more than WEB_QUEUE_SIZE 
+ * behind is dropped rather than slowing the monitor down.
+ * 
+ * @param client The client.
+ * @param data The bytes.
+ * @param length The number of bytes.
+ */
+void web_send(WebClient *client, const char *data, size_t length)
+{
+    if (client->queued > 0)
+    {
+        ssize_t sent = send(client->fd, client->queue, client->queued, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            web_drop(client);
+            return;
+        }
+        if (sent > 0)
+        {
+            memmove(client->queue, client->queue + sent, client->queued - sent);
+            client->queued -= sent;
+        }
+    }
+    if (client->queued == 0 && length > 0)
+    {
+        ssize_t sent = send(client->fd, data, length, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            web_drop(client);
+            return;
+        }
+        if (sent > 0)
+        {
+            data += sent;
+            length -= sent;
+        }
+    }
+    if (length > WEB_QUEUE_SIZE - client->queued)
+    {
+        web_drop(client);
+        return;
+    }
+    memcpy(client->queue + client->queued, data, length);
+    client->queued += length;
+}
+
+/**
+ * Copies text into a JSON string body: quotes and backslashes are escaped and 
+ * control characters become spaces. The copy is cut short rather than 
+ * overflowing, and always NUL-terminated.
+ * 
+ * @param buffer The destination.
+ * @param size The size of the destination.
+ * @param text The text, such as a series or cgroup name.
+ * @return The number of bytes written, without the NUL.
+ */
+size_t json_escape(char *buffer, size_t size, const char *text)
+{
+    size_t length = 0;
+    for (const char *c = text; *c != '\0' && length + 2 < size; c++)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            buffer[length++] = '\\';
+        }
+        buffer[length++] = (unsigned char)*c < ' ' ? ' ' : *c;
+    }
+    if (size > 0)
+    {
+        buffer[length] = '\0';
+    }
+    return length;
+}
+
+/**
+ * Encodes the names and units of the series as an SSE "series" message.
+ * 
+ * @param monitor The monitor.
+ * @param buffer Receives the message.
+ * @param size The size of `buffer`.
+ * @return The length of the message.
+ */
+size_t web_encode_series(const Monitor *monitor, char *buffer, size_t size)
+{
+    size_t length = snprintf(buffer, size, "event: series\ndata: [");
+    for (int i = 0; i < monitor->series_count && length < size; i++)
+    {
+        length += snprintf(buffer + length, size - length, "%s{\"name\":\"", i > 0 ? "," : "");
+        length += length < size ? json_escape(buffer + length, size - length, monitor->series[i].name) : 0;
+        length += length < size ? snprintf(buffer + length, size - length, "\",\"unit\":\"") : 0;
+        length += length < size ? json_escape(buffer + length, size - length, monitor->series[i].unit) : 0;
+        length += length < size ? snprintf(buffer + length, size - length, "\"}") : 0;
+    }
+    if (length < size)
+    {
+        length += snprintf(buffer + length, size - length, "]\n\n");
+    }
+    return length < size ? length : size - 1;
+}
+
+/**
+ * Answers a web client's request once its headers are complete: the page for 
+ * "/", an SSE stream for "/events", and 404 for anything else.
+ * 
+ * @param monitor The monitor.
+ * @param client The client.
+ */
+void web_answer(Monitor *monitor, WebClient *client)
+{
+    static const char ok_headers[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\nConnection: close\r\nContent-Length: ";
+    static const char sse_headers[] = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\nConnection: keep-alive\r\n\r\n";
+    static const char not_found[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    if (strncmp(client->request, "GET /events ", 12) == 0)
+    {
+        char series[WEB_FRAME_SIZE];
+        client->streaming = true;
+        web_send(client, sse_headers, sizeof(sse_headers) - 1);
+        if (client->fd != -1)
+        {
+            web_send(client, series, web_encode_series(monitor, series, sizeof(series)));
+        }
+        return;
+    }
+    if (strncmp(client->request, "GET / ", 6) == 0)
+    {
+        char length[32];
+        web_send(client, ok_headers, sizeof(ok_headers) - 1);
+        snprintf(length, sizeof(length), "%zu\r\n\r\n", sizeof(web_page) - 1);
+        if (client->fd != -1)
+        {
+            web_send(client, length, strlen(length));
+        }
+        if (client->fd != -1)
+        {
+            web_send(client, web_page, sizeof(web_page) - 1);
+        }
+    }
+    else
+    {
+        web_send(client, not_found, sizeof(not_found) - 1);
+    }
+    client->request_length = 0;
+    client->request[0] = '\0';
+}
+
+/**
+ * Encodes the latest tick once as an SSE message and sends it to every 
+ * streaming client, after accepting new connections and answering complete 
+ * requests. Series that appeared since the previous tick (a collector enabled 
+ * from the control socket) are announced first.
+ * 
+ * @param monitor The monitor.
+ */
+void web_tick(Monitor *monitor)
+{
+    WebServer *web = &monitor->web;
+    int fd;
+    while ((fd = accept4(web->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+    {
+        int slot = 0;
+        while (slot < MAX_WEB_CLIENTS && web->clients[slot].fd != -1)
+        {
+            slot++;
+        }
+        if (slot == MAX_WEB_CLIENTS)
+        {
+            close(fd);
+            continue;
+        }
+        WebClient *client = &web->clients[slot];
+        client->fd = fd;
+        client->streaming = false;
+        client->request_length = 0;
+        client->queued = 0;
+    }
+
+    size_t length = snprintf(web->frame, WEB_FRAME_SIZE, "data: {\"tick\":%d,\"time\":%.3f,\"values\":[", monitor->tick,
+                             (monotonic_ns() - monitor->start_ns) / 1e9);
+    for (int i = 0; i < monitor->series_count && length < WEB_FRAME_SIZE; i++)
+    {
+        double value = monitor->series[i].value;
+        length += value == value ? snprintf(web->frame + length, WEB_FRAME_SIZE - length, "%s%.3f", i > 0 ? "," : "", value)
+                                 : snprintf(web->frame + length, WEB_FRAME_SIZE - length, "%snull", i > 0 ? "," : "");
+    }
+    if (length < WEB_FRAME_SIZE)
+    {
+        length += snprintf(web->frame + length, WEB_FRAME_SIZE - length, "],\"events\":[");
+    }
+    size_t first = web->events_sent + EVENT_RING_SIZE < monitor->event_count ? monitor->event_count - EVENT_RING_SIZE : web->events_sent;
+    for (size_t i = first; i < monitor->event_count && length < WEB_FRAME_SIZE; i++)
+    {
+        const Event *event = &monitor->events[i % EVENT_RING_SIZE];
+        length += snprintf(web->frame + length, WEB_FRAME_SIZE - length, "%s\"", i > first ? "," : "");
+        length += length < WEB_FRAME_SIZE ? json_escape(web->frame + length, WEB_FRAME_SIZE - length, event->text) : 0;
+        length += snprintf(web->frame + length, WEB_FRAME_SIZE - length, "\"");
+    }
+    web->events_sent = monitor->event_count;
+    if (length < WEB_FRAME_SIZE)
+    {
+        length += snprintf(web->frame + length, WEB_FRAME_SIZE - length, "]}\n\n");
+    }
+    if (length >= WEB_FRAME_SIZE)
+    {
+        length = 0; // never send a cut frame
+    }
+
+    char series[WEB_FRAME_SIZE];
+    size_t series_length = 0;
+    if (web->series_count != monitor->series_count)
+    {
+        series_length = web_encode_series(monitor, series, sizeof(series));
+        web->series_count = monitor->series_count;
+    }
+    for (int slot = 0; slot < MAX_WEB_CLIENTS; slot++)
+    {
+        WebClient *client = &web->clients[slot];
+        if (client->fd == -1)
+        {
+            continue;
+        }
+        if (client->streaming)
+        {
+            if (series_length > 0)
+            {
+                web_send(client, series, series_length);
+            }
+            if (client->fd != -1)
+            {
+                web_send(client, web->frame, length);
+            }
+            continue;
+        }
+        ssize_t received = recv(client->fd, client->request + client->request_length,
+                                WEB_REQUEST_SIZE - 1 - client->request_length, MSG_DONTWAIT);
+        if (received == 0 || (received == -1 && errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            web_drop(client);
+            continue;
+        }
+        if (received > 0)
+        {
+            client->request_length += received;
+            client->request[client->request_length] = '\0';
+        }
+        if (strstr(client->request, "\r\n\r\n") != NULL || client->request_length == WEB_REQUEST_SIZE - 1)
+        {
+            web_answer(monitor, client);
+        }
+        else if (client->queued > 0)
+        {
+            web_send(client, NULL, 0); // a page still being sent
+        }
+    }
+}
+
+/**
+ * Writes the buffered events of the trace export to its file. A failed write 
+ * stops the export rather than the monitor.
+ * 
+ * @param export The trace export.
+ */
+void export_flush(TraceExport *export)
+{
+    size_t written = 0;
+    while (written < export->length)
+    {
+        ssize_t n = write(export->fd, export->chunk + written, export->length - written);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            fprintf(stderr, "Error: cannot write the trace export, stopping it\n");
+            close(export->fd);
+            export->fd = -1;
+            break;
+        }
+        written += n;
+    }
+    export->length = 0;
+}
+
+/**
+ * Appends one formatted event to the chunk, writing the chunk out first when 
+ * less than `EXPORT_EVENT_SIZE` bytes are left in it.
+ * 
+ * @param export The trace export.
+ * @param format The printf format of the event.
+ */
+__attribute__((format(printf, 2, 3)))
+void export_append(TraceExport *export, const char *format, ...)
+{
+    if (EXPORT_CHUNK_SIZE - export->length < EXPORT_EVENT_SIZE)
+    {
+        export_flush(export);
+    }
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(export->chunk + export->length, EXPORT_CHUNK_SIZE - export->length, format, args);
+    va_end(args);
+    if (n > 0)
+    {
+        export->length += (size_t)n < EXPORT_CHUNK_SIZE - export->length ? (size_t)n : EXPORT_CHUNK_SIZE - export->length - 1;
+    }
+}
+
+/**
+ * Reads the cpuN lines of `/proc/stat` and computes each core's utilization 
+ * over the last tick. Cores are identified by N, which skips offline CPUs.
+ * 
+ * @param export The trace export.
+ * @param utilization Receives the % of cpuN at index N; NaN for the first 
+ *        reading and for CPUs that are offline.
+ * @return One more than the highest CPU number read.
+ */
+int export_read_cores(TraceExport *export, float *utilization)
+{
+    char *text = read_proc_file(&export->stat, &scratch_arena, (EXPORT_MAX_CPUS + 1) * 128);
+    int cores = 0;
+    for (char *line = text; line != NULL; line = strchr(line, '\n'))
+    {
+        line += *line == '\n';
+        if (strncmp(line, "cpu", 3) != 0)
+        {
+            break; // the cpuN lines come first
+        }
+        if (line[3] < '0' || line[3] > '9')
+        {
+            line++; // the aggregate "cpu" line
+            continue;
+        }
+        char *cursor = line + 3;
+        unsigned long cpu = strtoul(cursor, &cursor, 10);
+        if (cpu >= EXPORT_MAX_CPUS)
+        {
+            line = cursor;
+            continue;
+        }
+        uint64_t fields[8] = {0};
+        for (int i = 0; i < 8; i++)
+        {
+            fields[i] = strtoull(cursor, &cursor, 10);
+        }
+        uint64_t total = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            total += fields[i];
+        }
+        uint64_t idle = fields[3] + fields[4];
+        while (cores <= (int)cpu)
+        {
+            utilization[cores++] = __builtin_nanf(""); // offline CPUs have no line
+        }
+        utilization[cpu] = export->core_total[cpu] > 0 && total > export->core_total[cpu]
+                               ? 100.0f * (1 - (float)(idle - export->core_idle[cpu]) / (total - export->core_total[cpu]))
+                               : __builtin_nanf("");
+        export->core_total[cpu] = total;
+        export->core_idle[cpu] = idle;
+        line = cursor;
+    }
+    return cores;
+}
+
+/**
+ * Starts the --export-trace file: a Chrome trace-event JSON array, written a 
+ * chunk at a time as ticks are sampled. The closing bracket is optional in 
+ * that format, so a run that is killed still leaves a loadable trace.
+ * 
+ * Timestamps are CLOCK_MONOTONIC microseconds, not relative to the start of 
+ * the run, so the counters line up with traces recorded by other processes 
+ * on the same clock.
+ * 
+ * @param monitor The monitor.
+ * @return 0 on success, -1 on failure.
+ */
+int export_setup(Monitor *monitor)
+{
+    TraceExport *export = &monitor->export;
+    export->chunk = (char *)arena_alloc(&run_arena, EXPORT_CHUNK_SIZE);
+    export->core_total = (uint64_t *)arena_alloc(&run_arena, EXPORT_MAX_CPUS * sizeof(uint64_t));
+    export->core_idle = (uint64_t *)arena_alloc(&run_arena, EXPORT_MAX_CPUS * sizeof(uint64_t));
+    if (export->chunk == NULL || export->core_total == NULL || export->core_idle == NULL ||
+        open_proc_file(&export->stat, "/proc/stat") == -1)
+    {
+        fprintf(stderr, "Error: cannot set up the trace export\n");
+        return -1;
+    }
+    export->fd = open(monitor->args->export_trace_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (export->fd == -1)
+    {
+        fprintf(stderr, "Error: cannot open trace export %s\n", monitor->args->export_trace_file);
+        return -1;
+    }
+    export->length = 0;
+    export->events_exported = 0;
+    export->pid = (int)getpid();
+    float discard[EXPORT_MAX_CPUS];
+    export_read_cores(export, discard);
+    export_append(export, "[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"sysmon\"}}",
+                  export->pid);
+    return 0;
+}
+
+/**
+ * Appends the latest tick to the trace export: one counter event per series 
+ * (system, per-process and per-cgroup alike) and per core, and an instant 
+ * event for every monitor event seen since the previous tick. Series without 
+ * a sample this tick are left out, so their counter holds its last value.
+ * 
+ * @param monitor The monitor.
+ */
+void export_tick(Monitor *monitor)
+{
+    TraceExport *export = &monitor->export;
+    double ts = monotonic_ns() / 1000.0;
+    for (int i = 0; i < monitor->series_count; i++)
+    {
+        const Series *series = &monitor->series[i];
+        if (series->value == series->value)
+        {
+            char name[2 * RECORD_NAME_SIZE];
+            char unit[16];
+            json_escape(name, sizeof(name), series->name);
+            json_escape(unit, sizeof(unit), series->unit);
+            export_append(export, ",\n{\"name\":\"%s\",\"cat\":\"system\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,\"tid\":0,\"args\":{\"%s\":%.3f}}",
+                          name, ts, export->pid, unit, series->value);
+        }
+    }
+
+    float utilization[EXPORT_MAX_CPUS];
+    int cores = export_read_cores(export, utilization);
+    for (int i = 0; i < cores; i++)
+    {
+        if (utilization[i] == utilization[i])
+        {
+            export_append(export, ",\n{\"name\":\"core.%d\",\"cat\":\"cores\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,\"tid\":0,\"args\":{\"%%\":%.1f}}",
+                          i, ts, export->pid, utilization[i]);
+        }
+    }
+
+    size_t first = export->events_exported + EVENT_RING_SIZE < monitor->event_count ? monitor->event_count - EVENT_RING_SIZE
+                                                                                      : export->events_exported;
+    for (size_t i = first; i < monitor->event_count; i++)
+    {
+        const Event *event = &monitor->events[i % EVENT_RING_SIZE];
+        char text[2 * sizeof(event->text)];
+        json_escape(text, sizeof(text), event->text);
+        export_append(export, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,\"pid\":%d,\"tid\":0}",
+                      text, event->marker ? "marker" : "event", event->t_ns / 1000.0, export->pid);
+    }
+    export->events_exported = monitor->event_count;
+}
+
+/**
+ * Closes the trace-event array and writes out what is left of the chunk.
+ * 
+ * @param monitor The monitor.
+ */
+void export_finish(Monitor *monitor)
+{
+    TraceExport *export = &monitor->export;
+    if (export->fd == -1)
+    {
+        return;
+    }
+    export_append(export, "\n]\n");
+    export_flush(export);
+    if (export->fd != -1)
+    {
+        close(export->fd);
+        export->fd = -1;
+    }
+}
+
+/**
+ * Writes to the monitor's own description of stdout without blocking.
+ * 
+ * @param output The frame output.
+ * @param data The bytes to write.
+ * @param length The number of bytes.
+ * @return The number of bytes written, or -1.
+ */
+ssize_t output_write(FrameOutput *output, const char *data, size_t length)
+{
+    return output->socket ? send(output->fd, data, length, MSG_DONTWAIT) : write(output->fd, data, length);
+}
+
+/**
+ * Gives the monitor its own way of writing stdout without blocking. The 
+ * O_NONBLOCK flag belongs to the open file description, which the shell and a 
+ * `-- command` share, so it is never set on fd 1 itself: a pipe or terminal 
+ * is opened again through /proc/self/fd/1 for a description of our own, a 
+ * socket is sent to with MSG_DONTWAIT, and a regular file never blocks.
+ * 
+ * @param output The frame output.
+ */
+void output_open(FrameOutput *output)
+{
+    struct stat st;
+    output->fd = STDOUT_FILENO;
+    output->socket = false;
+    if (fstat(STDOUT_FILENO, &st) == -1)
+    {
+        return;
+    }
+    if (S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode))
+    {
+        int fd = open("/proc/self/fd/1", O_WRONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+        if (fd != -1)
+        {
+            output->fd = fd;
+        }
+    }
+    output->socket = S_ISSOCK(st.st_mode);
+}
+
+/**
+ * Writes as much of the unwritten end of the last chunk as stdout accepts.
+ * 
+ * @param output The frame output.
+ * @return true once nothing is left to write.
+ */
+bool output_drain(FrameOutput *output)
+{
+    while (output->pending_offset < output->pending_length)
+    {
+        ssize_t written = output_write(output, output->pending + output->pending_offset, output->pending_length - output->pending_offset);
+        if (written <= 0)
+        {
+            return false;
+        }
+        output->pending_offset += written;
+    }
+    output->pending_length = output->pending_offset = 0;
+    return true;
+}
+
+/**
+ * Sends the chunk of the frame rendered so far, once the previous chunk has 
+ * drained. Whatever stdout does not accept is kept and written first next 
+ * time.
+ * 
+ * @param output The frame output.
+ * @return true if the chunk was sent, false if stdout was still busy.
+ */
+bool output_send(FrameOutput *output)
+{
+    if (!output_drain(output))
+    {
+        return false;
+    }
+    size_t written = 0;
+    while (written < output->length)
+    {
+        ssize_t result = output_write(output, output->frame + written, output->length - written);
+        if (result <= 0)
+        {
+            break;
+        }
+        written += result;
+    }
+    memcpy(output->pending, output->frame + written, output->length - written);
+    output->pending_length = output->length - written;
+    output->length = 0;
+    return true;
+}
+
+/**
+ * Write function of the stream installed as stdout. Frames are collected in 
+ * `frame` and a full chunk is sent mid-frame, so a frame of any size goes out 
+ * whole. Each write is kept in one chunk, so a chunk never ends inside an 
+ * escape sequence; once a chunk cannot be sent the rest of the frame is 
+ * discarded.
+ * 
+ * @param cookie The frame output.
+ * @param data The bytes written to stdout.
+ * @param size The number of bytes.
+ * @return `size`: stdout never fails for the renderer.
+ */
+ssize_t output_stream_write(void *cookie, const char *data, size_t size)
+{
+    FrameOutput *output = (FrameOutput *)cookie;
+    if (size <= output->size && output->length + size > output->size && !output->discarding && !output_send(output))
+    {
+        output->discarding = true;
+    }
+    for (size_t done = 0; done < size && !output->discarding;)
+    {
+        if (output->length == output->size && !output_send(output))
+        {
+            output->discarding = true; // only a write longer than a whole chunk is split
+            break;
+        }
+        size_t n = size - done < output->size - output->length ? size - done : output->size - output->length;
+        memcpy(output->frame + output->length, data + done, n);
+        output->length += n;
+        done += n;
+    }
+    return size;
+}
+
+/**
+ * Renders frames into a memory stream installed as stdout, so that a slow 
+ * terminal (a paused SSH session, a scrolled tmux pane) can no longer stall 
+ * sampling: frames are written without blocking, and frames rendered while 
+ * the previous one is still draining are dropped. Only installed for a 
+ * renderer that can redraw after a drop; headless rows stay blocking, since a 
+ * dropped row there is lost data.
+ * 
+ * @param monitor The monitor.
+ * @param size The size of the frame chunk.
+ * @return 0 on success, -1 on failure.
+ */
+int output_setup(Monitor *monitor, size_t size)
 {
-    int row;
-    int col;
-} CursorPosition;
+    FrameOutput *output = &monitor->output;
+    cookie_io_functions_t functions = {NULL, output_stream_write, NULL, NULL};
+    output->size = size;
+    output->frame = (char *)arena_alloc(&run_arena, size);
+    output->pending = (char *)arena_alloc(&run_arena, size);
+    FILE *frame_stream = output->frame != NULL && output->pending != NULL ? fopencookie(output, "w", functions) : NULL;
+    if (frame_stream == NULL)
+    {
+        fprintf(stderr, "Error: cannot allocate the frame buffer\n");
+        return -1;
+    }
+    setvbuf(frame_stream, NULL, _IONBF, 0); // the frame chunk is the buffer
+    fflush(stdout);
+    output_open(output);
+    output->terminal = stdout;
+    stdout = frame_stream;
+    return 0;
+}
 
 /**
- * Initializes the `ArgsInfo` structure with default values.
- * 
- * This function dynamically allocates memory for the `ArgsInfo` structure and 
- * initializes its fields. It sets default values for the number of samples and 
- * time delay while ensuring that flags for memory, CPU, and core usage are 
- * initially disabled. The `updated_sample` and `updated_tdelay` fields are set 
- * to `false` to prevent the user from specifying multiple values for `samples` 
- * and `tdelay`.
+ * Sends the rest of the frame rendered this tick. If the previous frame has 
+ * still not drained, this one is dropped and counted, and the renderer is 
+ * asked to draw everything once the terminal catches up. Without the frame 
+ * stream this is a plain blocking flush.
  * 
- * Behavior:
- * - `samples` is set to 20 (default sample count).
- * - `tdelay` is set to 500,000 microseconds (default time delay).
- * - `memory_flag`, `cpu_flag`, and `cores_flag` are set to `false` (disabled by default).
- * - `updated_sample` and `updated_tdelay` are set to `false` to track whether 
- *   user-specified values have been assigned.
- * - The `argc` and `argv` fields store the command-line arguments.
+ * @param monitor The monitor.
+ */
+void output_flush(Monitor *monitor)
+{
+    FrameOutput *output = &monitor->output;
+    fflush(stdout);
+    if (output->terminal == NULL)
+    {
+        return;
+    }
+    output->frames++;
+    if (output->discarding || !output_send(output))
+    {
+        output->dropped++;
+        output->redraw = true;
+    }
+    output->discarding = false;
+    output->length = 0;
+}
+
+/**
+ * Asks the renderer to draw everything if frames were dropped and the 
+ * terminal has caught up. Called before rendering a frame.
  * 
- * @return A pointer to an initialized `ArgsInfo` structure.
- *         Exits the program if memory allocation fails.
+ * @param monitor The monitor.
+ * @param renderer The active renderer.
  */
-ArgsInfo* initializeArgument(int argc, char **argv){
-    ArgsInfo *argsInfo = (ArgsInfo *)malloc(sizeof(ArgsInfo));
-    if (argsInfo == NULL)
+void output_catch_up(Monitor *monitor, const Renderer *renderer)
+{
+    FrameOutput *output = &monitor->output;
+    if (output->redraw && output_drain(output))
     {
-        fprintf(stderr, "Error:Memory allocation\n");
-        exit(1);
+        if (renderer->redraw != NULL)
+        {
+            renderer->redraw(monitor);
+        }
+        output->redraw = false;
     }
-    argsInfo->argc = argc;
-    argsInfo->argv = argv;
-    argsInfo->cores_flag = false;
-    argsInfo->cpu_flag = false;
-    argsInfo->memory_flag = false;
-    argsInfo->samples = 20;    // default values
-    argsInfo->tdelay = 500000; // default values
-    argsInfo->updated_sample = false;
-    argsInfo->updated_tdelay = false;
-    return argsInfo;
 }
 
 /**
- * Removes leading whitespace characters from a given string.
- * Uses the isspace function to check for spaces and moves the pointer
- * forward to the first non-space character.
- * @param str The input string.
- * @return A pointer to the modified string with leading spaces removed,
- *         or NULL if the input is NULL.
+ * Puts the real stdout back and writes what is left of the last frame through 
+ * it, blocking as it always did, drawing everything again if frames were 
+ * dropped, then reports dropped frames.
+ * 
+ * @param monitor The monitor.
+ * @param renderer The active renderer.
  */
-char *removeWhiteSpace(char *str)
+void output_finish(Monitor *monitor, const Renderer *renderer)
 {
-    if (str == NULL)
+    FrameOutput *output = &monitor->output;
+    if (output->terminal == NULL)
     {
-        return NULL;
+        return;
     }
-    while (isspace((unsigned char)*str))
+    fclose(stdout);
+    stdout = output->terminal;
+    if (output->fd != STDOUT_FILENO)
     {
-        str++;
+        close(output->fd);
+    }
+    output->fd = STDOUT_FILENO;
+    output->socket = false;
+    output_drain(output);
+    if (output->redraw && renderer->redraw != NULL)
+    {
+        renderer->redraw(monitor);
+        renderer->frame(monitor);
+    }
+    if (output->dropped > 0)
+    {
+        fprintf(stderr, "Dropped %lu of %lu frames while the terminal was not keeping up\n", output->dropped, output->frames);
     }
-    return str;
 }
 
 /**
- * Stores a cursor position (row and column) for terminal-based graph plotting.
- * Used to track positions for elements like headers, memory, and CPU plots,
- * as well as terminal navigation using escape codes.
- * @param row The row position in the terminal.
- * @param col The column position in the terminal.
- * @return A CursorPosition struct containing the given row and column values.
+ * Runs a collector's setup and notes which series it added, so that the 
+ * collector can later be paused and resumed from the control socket.
+ * 
+ * @param monitor The monitor.
+ * @param c The index of the collector.
+ * @return 0 on success, -1 on failure.
  */
-CursorPosition save_position(int row, int col)
+int collector_setup(Monitor *monitor, int c)
 {
-    CursorPosition pos;
-    pos.row = row;
-    pos.col = col;
-    return pos;
+    CollectorState *state = &monitor->collector_states[c];
+    state->first_series = monitor->series_count;
+    if (collectors[c].setup != NULL && collectors[c].setup(monitor) == -1)
+    {
+        return -1;
+    }
+    state->series_count = monitor->series_count - state->first_series;
+    state->set_up = true;
+    return 0;
 }
 
 /**
- * Prints a specified number of newline characters to move the cursor down.
+ * Creates the `--control` socket: a Unix stream socket accepting one command 
+ * per line, such as `rate 100000`, `disable procs`, `record start FILE` or 
+ * `stats`.
  * 
- * This function iterates and prints newline characters to shift the terminal output 
- * down by the specified number of lines.
+ * @param monitor The monitor.
+ * @return 0 on success, -1 on failure.
+ */
+int control_setup(Monitor *monitor)
+{
+    ControlSocket *control = &monitor->control;
+    const char *path = monitor->args->control_path;
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "Error: control socket path too long\n");
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+    // Only a stale socket is replaced; anything else at the path is left alone
+    struct stat st;
+    if (lstat(path, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+        {
+            fprintf(stderr, "Error: %s exists and is not a socket\n", path);
+            return -1;
+        }
+        unlink(path);
+    }
+    // Commands can write files as our user, so only our user may connect
+    control->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (control->fd == -1 || bind(control->fd, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+        chmod(path, 0600) == -1 || listen(control->fd, MAX_CONTROL_CLIENTS) == -1)
+    {
+        fprintf(stderr, "Error: cannot create control socket %s\n", path);
+        return -1;
+    }
+    for (int i = 0; i < MAX_CONTROL_CLIENTS; i++)
+    {
+        control->clients[i] = -1;
+    }
+    return 0;
+}
+
+/**
+ * Sends a printf-style reply to a control client. Replies that do not fit in 
+ * the socket buffer are cut short rather than stalling the monitor.
  * 
- * @param num_lines The number of lines to move down.
+ * @param fd The client socket.
+ * @param format printf-style reply.
  */
-void change_line(int num_lines)
+void control_reply(int fd, const char *format, ...)
 {
-    for (int i = 0; i < num_lines; i++)
+    char reply[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(reply, sizeof(reply), format, args);
+    va_end(args);
+    if (length > 0)
     {
-        printf("%s", "\n");
+        send(fd, reply, (size_t)length < sizeof(reply) ? (size_t)length : sizeof(reply) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
     }
 }
 
 /**
- * Gets the total memory using 'sysinfo()'
- * This function fetches the total RAM available in the system 
- * and converts it from bytes to gigabytes.
+ * Replies with the state of the monitor: the tick and rate, the state of 
+ * every collector and recording, and the latest value of every series.
  * 
- * @return The total system memory in gigabytes as a long double.
- *         Exits the program if `sysinfo()` fails.
+ * @param monitor The monitor.
+ * @param fd The client socket.
  */
-long double get_total_memory()
+void control_stats(Monitor *monitor, int fd)
 {
-    struct sysinfo info;
-    if (sysinfo(&info) == -1)
+    ArgsInfo *argsInfo = monitor->args;
+    control_reply(fd, "tick %d\nrate %lu\nevents %zu\n", monitor->tick, argsInfo->tdelay, monitor->event_count);
+    for (int c = 0; c < COLLECTOR_COUNT; c++)
     {
-        fprintf(stderr, "Error: Cannot read system memory information\n");
-        exit(1);
+        bool enabled = *collector_flag(argsInfo, &collectors[c]);
+        control_reply(fd, "collector %s %s\n", collectors[c].name,
+                      enabled ? "on" : monitor->collector_states[c].set_up ? "paused" : "off");
     }
-    long double total_memory = (info.totalram * info.mem_unit) / (1024.0 * 1024.0 * 1024.0); 
-    if(total_memory < 0){
-        fprintf(stderr,"Error:Total memory cannot be negative\n");
+    if (monitor->recording.fd != -1)
+    {
+        control_reply(fd, "recording %s %llu\n", monitor->recording.path, (unsigned long long)monitor->recording.entries);
+    }
+    for (int i = 0; i < monitor->series_count; i++)
+    {
+        control_reply(fd, "series %s %.2f %s\n", monitor->series[i].name, monitor->series[i].value, monitor->series[i].unit);
     }
-    return total_memory;
 }
 
 /**
- * Calculates the CPU utilization percentage over time.
- * 
- * This function reads CPU time statistics from `/proc/stat` and calculates the 
- * CPU utilization using the following method:
- * 
- * 1. **Total CPU Utilization Time** (Tᵢ) is computed as:
- *      Tᵢ = user + nice + system + idle + iowait + irq + softirq + steal;
- * 
- * 2. **Idle Time** (Iᵢ) consists of:
- *      Iᵢ = idle + iowait;
- * 
- * 3. **CPU Usage Time** (Uᵢ) at time i is determined by:
- *      Uᵢ = Tᵢ - Iᵢ;
- * 
- * 4. **CPU Utilization Calculation**:
- *    The CPU utilization between two sampling times is given by:
- * 
- *        CPU Utilization (%) = ((U₂ - U₁) / (T₂ - T₁)) * 100;
- * 
- *    Where:
- *    - **T₁, I₁, U₁** represent total, idle, and usage times at the first sampling.
- *    - **T₂, I₂, U₂** represent total, idle, and usage times at the second sampling.
- *    - **U₂ - U₁** is the change in CPU usage.
- *    - **T₂ - T₁** is the change in total CPU time.
+ * Runs one control command and replies "ok" or "error: ..." to its client.
  * 
- * The function updates the previous total and idle CPU values for subsequent calculations.
+ * Disabling a collector pauses it: its series record gaps until it is enabled 
+ * again. Enabling a collector the monitor was not started with sets it up 
+ * and lays the display out again; its graphs start empty.
  * 
- * @param preTotalCPU A pointer to store the previous total CPU time.
- * @param preIdleCPU A pointer to store the previous idle CPU time.
- * @param finalTotalCPU A pointer to store the current total CPU time.
- * @param finalIdleCPU A pointer to store the current idle CPU time.
- * @return The CPU utilization as a percentage. Returns 0 if no valid data is available.
+ * @param monitor The monitor.
+ * @param renderer The active renderer.
+ * @param fd The client socket.
+ * @param line The command.
  */
-long double calculate_cpu_utilization(long double *preTotalCPU, long double *preIdleCPU, long double *finalTotalCPU, long double *finalIdleCPU)
+void control_command(Monitor *monitor, const Renderer *renderer, int fd, char *line)
 {
-    char input_string[1024];
-    long double user, nice, system, idle, iowait, irq, softirq, steal;
-
-    FILE *fp = fopen("/proc/stat", "r");
-    if (fp == NULL)
+    ArgsInfo *argsInfo = monitor->args;
+    char *argument = strchr(line, ' ');
+    if (argument != NULL)
     {
-        fprintf(stderr, "Error: Failed opening /proc/stat\n");
-        return 0;
+        *argument++ = '\0';
     }
-
-    fscanf(fp, "%s %Lf %Lf %Lf %Lf %Lf %Lf %Lf %Lf",
-           input_string, &user, &nice, &system, &idle,
-           &iowait, &irq, &softirq, &steal);
-
-    if (fclose(fp) != 0)
+    if (strcmp(line, "rate") == 0 && argument != NULL)
     {
-        fprintf(stderr, "Error: Failed to close file\n");
-        return -1;
+        char *endptr;
+        unsigned long tdelay = strtoul(argument, &endptr, 10);
+        if (endptr == argument || *endptr != '\0' || tdelay == 0)
+        {
+            control_reply(fd, "error: rate needs microseconds\n");
+            return;
+        }
+        argsInfo->tdelay = tdelay;
     }
-
-    // Compute total and idle CPU times
-    long double currentTotalCPU = user + nice + system + idle + iowait + irq + softirq + steal;
-    long double currentIdleCPU = idle + iowait;
-
-    // First run initialization
-    if (*preTotalCPU == 0 && *preIdleCPU == 0)
+    else if ((strcmp(line, "enable") == 0 || strcmp(line, "disable") == 0) && argument != NULL)
     {
-        *preTotalCPU = currentTotalCPU;
-        *preIdleCPU = currentIdleCPU;
-        return 0;
+        bool enable = line[0] == 'e';
+        int c = 0;
+        while (c < COLLECTOR_COUNT && strcmp(collectors[c].name, argument) != 0)
+        {
+            c++;
+        }
+        if (c == COLLECTOR_COUNT)
+        {
+            control_reply(fd, "error: no collector %s\n", argument);
+            return;
+        }
+        if (enable && !monitor->collector_states[c].set_up)
+        {
+            // Setting up may open files through stdio; this is a reconfiguration, not steady state
+            ALLOC_CHECK_ARM(false);
+            int series_count = monitor->series_count;
+            int panel_count = monitor->panel_count;
+            int target_count = monitor->target_count;
+            size_t arena_used = run_arena.used;
+            bool was_open[CONTROL_FD_LIMIT];
+            for (int i = 0; i < CONTROL_FD_LIMIT; i++)
+            {
+                was_open[i] = fcntl(i, F_GETFD) != -1;
+            }
+            if (collectors[c].flag_offset == offsetof(ArgsInfo, procs_flag))
+            {
+                argsInfo->procs_view = true; // enabled by name, so the table is shown
+            }
+            int status = collector_setup(monitor, c);
+            ALLOC_CHECK_ARM(true);
+            if (status == -1)
+            {
+                // Undo the partial setup: its series, panels, arena space and open files
+                monitor->series_count = series_count;
+                monitor->panel_count = panel_count;
+                monitor->target_count = target_count;
+                run_arena.used = arena_used;
+                for (int i = 0; i < CONTROL_FD_LIMIT; i++)
+                {
+                    if (!was_open[i] && fcntl(i, F_GETFD) != -1)
+                    {
+                        close(i);
+                    }
+                }
+                control_reply(fd, "error: cannot set up %s\n", argument);
+                return;
+            }
+            renderer->begin(monitor);
+        }
+        *collector_flag(argsInfo, &collectors[c]) = enable;
     }
-
-    long double U_initial = *preTotalCPU - *preIdleCPU;
-    *finalTotalCPU = currentTotalCPU;
-    *finalIdleCPU = currentIdleCPU;
-    long double U_final = *finalTotalCPU - *finalIdleCPU;
-
-    // Compute deltas
-    long double delta_total = U_final - U_initial;
-    long double delta_idle = *finalTotalCPU - *preTotalCPU;
-
-    // Update stored values for next iteration
-    *preTotalCPU = currentTotalCPU;
-    *preIdleCPU = currentIdleCPU;
-
-    if (delta_total == 0 || delta_idle == 0)
+    else if (strcmp(line, "record") == 0 && argument != NULL && strncmp(argument, "start ", 6) == 0)
     {
-        return 0;
+        record_stop(monitor);
+        if (record_start(monitor, argument + 6) == -1)
+        {
+            control_reply(fd, "error: cannot record to %s\n", argument + 6);
+            return;
+        }
     }
-    return (delta_total / delta_idle) * 100.0;
+    else if (strcmp(line, "record") == 0 && argument != NULL && strcmp(argument, "stop") == 0)
+    {
+        record_stop(monitor);
+    }
+    else if (strcmp(line, "marker") == 0 && argument != NULL)
+    {
+        marker_add(monitor, argument);
+    }
+    else if (strcmp(line, "stats") == 0)
+    {
+        control_stats(monitor, fd);
+    }
+    else
+    {
+        control_reply(fd, "error: commands are rate US, enable NAME, disable NAME, record start FILE, record stop, marker TEXT, stats\n");
+        return;
+    }
+    control_reply(fd, "ok\n");
 }
 
 /**
- * Calculates the amount of free memory available in the system.
+ * Accepts control clients and runs the commands they have sent since the 
+ * previous tick, so that every change applies at a tick boundary.
  * 
- * This function uses 'sysinfo()' to retrieve the "freeram" value, 
- * converts it from kilobytes to gigabytes, and subtracts it from total memory 
- * and then returns the available memory.
+ * @param monitor The monitor.
+ * @param renderer The active renderer.
+ */
+void control_poll(Monitor *monitor, const Renderer *renderer)
+{
+    ControlSocket *control = &monitor->control;
+    int client;
+    while ((client = accept4(control->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+    {
+        int slot = 0;
+        while (slot < MAX_CONTROL_CLIENTS && control->clients[slot] != -1)
+        {
+            slot++;
+        }
+        if (slot == MAX_CONTROL_CLIENTS)
+        {
+            control_reply(client, "error: too many control clients\n");
+            close(client);
+            continue;
+        }
+        control->clients[slot] = client;
+        control->lengths[slot] = 0;
+    }
+    for (int slot = 0; slot < MAX_CONTROL_CLIENTS; slot++)
+    {
+        int fd = control->clients[slot];
+        char buffer[256];
+        ssize_t len;
+        while (fd != -1 && (len = read(fd, buffer, sizeof(buffer))) > 0)
+        {
+            for (ssize_t i = 0; i < len; i++)
+            {
+                if (buffer[i] != '\n' && buffer[i] != '\r')
+                {
+                    if (control->lengths[slot] < CONTROL_LINE_SIZE - 1)
+                    {
+                        control->lines[slot][control->lengths[slot]++] = buffer[i];
+                    }
+                    continue;
+                }
+                control->lines[slot][control->lengths[slot]] = '\0';
+                if (control->lengths[slot] > 0)
+                {
+                    control_command(monitor, renderer, fd, control->lines[slot]);
+                }
+                control->lengths[slot] = 0;
+            }
+        }
+        if (fd != -1 && len == 0)
+        {
+            close(fd);
+            control->clients[slot] = -1;
+        }
+    }
+}
+
+/**
+ * Converts a unit to a scale within its kind: bytes for K/M/G sizes (powers 
+ * of 1024, as in the monitor's own GB and MB), milliseconds for times, and 
+ * percent.
  * 
- * @return The amount of used system memory in gigabytes as a long double.
- *         Returns 0 if the sysinfo() fails.
+ * @param unit The unit, such as "GiB", "GB", "ms", "s" or "%".
+ * @param scale Receives the size of the unit within its kind.
+ * @return 'b' for sizes, 't' for times, '%' for percentages, or 0 for an unknown unit.
  */
-long double calculate_memory_used()
+int gate_unit(const char *unit, double *scale)
 {
-    struct sysinfo info;
-    if (sysinfo(&info) == -1)
+    char one[16];
+    size_t bytes;
+    snprintf(one, sizeof(one), "1%s", unit);
+    if (parse_size(one, &bytes) == 0)
     {
-        fprintf(stderr, "Error: Cannot read memory used file\n");
-        return 0;
+        *scale = (double)bytes;
+        return 'b';
     }
-    long double freeMemory = (info.freeram * info.mem_unit)/(1024.0 * 1024.0 * 1024.0);
-    return (get_total_memory()- freeMemory);
+    static const char *const times[3] = {"us", "ms", "s"};
+    static const double time_scales[3] = {0.001, 1, 1000};
+    for (int i = 0; i < 3; i++)
+    {
+        if (strcmp(unit, times[i]) == 0)
+        {
+            *scale = time_scales[i];
+            return 't';
+        }
+    }
+    *scale = 1;
+    return strcmp(unit, "%") == 0 ? '%' : 0;
 }
 
 /**
- * Retrieves the maximum CPU frequency from the system.
- * 
- * This function reads the `/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq` 
- * file to determine the highest supported CPU frequency, converting it from 
- * kilohertz to gigahertz.
+ * Parses one gate rule, `func(metric) op value[unit]`, such as `p99(cpu) < 70` 
+ * or `max(mem.used) < 12GiB`. Spaces are optional.
  * 
- * @return The maximum CPU frequency in gigahertz as a long double.
- *         Returns 0 if the file cannot be accessed.
+ * @param text The rule.
+ * @param rule Receives the parsed rule.
+ * @return 0 on success, -1 if the rule is malformed.
  */
-long double calculate_max_frequency()
-{ 
-    FILE *fp = fopen("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq", "r");
-    if (fp == NULL)
+int gate_parse(const char *text, GateRule *rule)
+{
+    static const char *const functions[6] = {"min", "max", "mean", "p50", "p90", "p99"};
+    char function[8], metric[RECORD_NAME_SIZE], op[3], rest[32];
+    memset(rule, 0, sizeof(*rule));
+    snprintf(rule->text, sizeof(rule->text), "%s", text);
+    if (sscanf(text, " %7[a-z0-9] ( %31[^) ] ) %2[<>=] %31s", function, metric, op, rest) != 4)
     {
-        fprintf(stderr, "Error reading the file\n");
-        return 0;
+        return -1;
     }
-    long double max_freq;
-    if (fscanf(fp, "%Lf", &max_freq) == 1)
+    rule->function = -1;
+    for (int i = 0; i < 6; i++)
     {
-        fclose(fp);
-        return max_freq / 1000000;
+        if (strcmp(function, functions[i]) == 0 || (i == GATE_MEAN && strcmp(function, "avg") == 0))
+        {
+            rule->function = i;
+        }
     }
-    else
+    char *unit;
+    rule->threshold = strtod(rest, &unit);
+    if (rule->function == -1 || unit == rest || strlen(unit) >= sizeof(rule->unit) ||
+        (strcmp(op, "<") != 0 && strcmp(op, "<=") != 0 && strcmp(op, ">") != 0 && strcmp(op, ">=") != 0))
     {
-        fclose(fp);
-        fprintf(stderr, "Error: failed to calculate max frequency\n");
-        exit(1);
+        return -1;
+    }
+    double scale;
+    if (*unit != '\0' && gate_unit(unit, &scale) == 0)
+    {
+        return -1;
     }
+    strcpy(rule->unit, unit);
+    strcpy(rule->metric, metric);
+    strcpy(rule->op, op);
+    return 0;
 }
 
 /**
- * Counts the number of CPU cores available on the system.
- * 
- * This function reads the `/proc/cpuinfo` file and counts occurrences of the 
- * "processor" keyword, which indicates the total number of logical CPU cores.
+ * Parses the `--gate` rules, separated by commas, semicolons or newlines, or 
+ * read from a file when written as `@FILE` (where `#` starts a comment), and 
+ * resolves each metric to a series. Thresholds with a unit are converted to 
+ * the series' unit.
  * 
- * @return The total number of CPU cores.
- *         Returns -1 if the file cannot be accessed or closed improperly.
+ * @param monitor The monitor, with every collector set up.
+ * @return 0 on success, -1 on a malformed rule or an unknown metric.
  */
-int calculate_cores()
+int gate_setup(Monitor *monitor)
 {
-    char input_string[1024];
-    FILE *fp = fopen("/proc/cpuinfo", "r");
-    if (fp == NULL)
+    char file_text[4096];
+    const char *rules = monitor->args->gate_rules;
+    if (rules[0] == '@')
     {
-        fprintf(stderr, "Error reading the file\n");
-        return -1;
+        int fd = open(rules + 1, O_RDONLY | O_CLOEXEC);
+        ssize_t len = fd != -1 ? read(fd, file_text, sizeof(file_text) - 1) : -1;
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        if (len < 0)
+        {
+            fprintf(stderr, "Error: cannot read gate rules from %s\n", rules + 1);
+            return -1;
+        }
+        file_text[len] = '\0';
+        rules = file_text;
     }
-
-    int cores = 0;
-    while (fgets(input_string, sizeof(input_string), fp))
+    char text[64];
+    for (const char *cursor = rules; *cursor != '\0';)
     {
-        if (strncmp("processor", input_string, 9) == 0)
+        size_t length = strcspn(cursor, ",;\n");
+        const char *next = cursor[length] != '\0' ? cursor + length + 1 : cursor + length;
+        size_t comment = strcspn(cursor, "#");
+        length = comment < length ? comment : length;
+        while (length > 0 && isspace((unsigned char)cursor[length - 1]))
+        {
+            length--;
+        }
+        size_t blank = strspn(cursor, " \t\r");
+        blank = blank < length ? blank : length;
+        snprintf(text, sizeof(text), "%.*s", (int)(length - blank), cursor + blank);
+        cursor = next;
+        if (text[0] == '\0')
+        {
+            continue; // blank or comment-only line
+        }
+        if (monitor->gate_rule_count == MAX_GATE_RULES)
+        {
+            fprintf(stderr, "Error: too many gate rules (at most %d)\n", MAX_GATE_RULES);
+            return -1;
+        }
+        GateRule *rule = &monitor->gate_rules[monitor->gate_rule_count];
+        if (gate_parse(text, rule) == -1)
+        {
+            fprintf(stderr, "Error: invalid gate rule \"%s\" (expected func(metric) op value[unit], func one of min, max, mean, p50, p90, p99)\n", text);
+            return -1;
+        }
+        for (int i = 0; i < monitor->series_count && rule->series == NULL; i++)
+        {
+            if (strcmp(monitor->series[i].name, rule->metric) == 0)
+            {
+                rule->series = &monitor->series[i];
+            }
+        }
+        if (rule->series == NULL)
         {
-            cores++;
+            fprintf(stderr, "Error: gate rule \"%s\": no metric %s; metrics are", text, rule->metric);
+            for (int i = 0; i < monitor->series_count; i++)
+            {
+                fprintf(stderr, " %s", monitor->series[i].name);
+            }
+            fprintf(stderr, "\n");
+            return -1;
+        }
+        double rule_scale, series_scale;
+        if (rule->unit[0] != '\0')
+        {
+            int rule_kind = gate_unit(rule->unit, &rule_scale);
+            int series_kind = gate_unit(rule->series->unit, &series_scale);
+            if (rule_kind != series_kind)
+            {
+                fprintf(stderr, "Error: gate rule \"%s\": %s is measured in %s\n", text, rule->metric, rule->series->unit);
+                return -1;
+            }
+            rule->threshold = rule->threshold * rule_scale / series_scale;
         }
+        monitor->gate_rule_count++;
     }
-    if (fclose(fp) != 0)
+    if (monitor->gate_rule_count == 0)
     {
-        fprintf(stderr, "Error: Failed to close file\n");
+        fprintf(stderr, "Error: no gate rules\n");
         return -1;
     }
-    return cores;
+    return 0;
 }
 
 /**
- * Determines if the current command-line argument (CLA) is a positional argument.
- * 
- * In the CLA syntax, positional arguments `[samples [tdelay]]` must appear before 
- * flagged arguments (`--memory`, `--cpu`, `--cores`, `--samples=N`, `--tdelay=T`).
- * This function validates whether an argument is positional, ensuring `samples` 
- * and `tdelay` appear immediately after the executable name.
+ * Adds the latest sample of every gated series to its rule's whole-run 
+ * statistics.
  * 
- * @param argsInfo A pointer to the structure containing command-line arguments.
- * @param current_index A pointer to the current argument index being processed.
- * @return `true` if the argument is valid and assigned to `samples` or `tdelay`; 
- *         otherwise, `false` if the value is invalid, NULL, or out of order.
+ * @param monitor The monitor.
  */
-bool isPositional(ArgsInfo *argsInfo, int current_index)
+void gate_tick(Monitor *monitor)
 {
-    char* arg = argsInfo->argv[current_index];
-    while (*arg) {
-        if (!isdigit((unsigned char)*arg)) // Check if character is not a digit
-            return false;
-        arg++;
+    for (int i = 0; i < monitor->gate_rule_count; i++)
+    {
+        run_stats_add(&monitor->gate_rules[i].stats, monitor->gate_rules[i].series->value);
     }
-    return true;
 }
 
 /**
- * Identifies and processes command-line flag arguments.
+ * Evaluates the gate rules over the whole run and prints one "# gate" line 
+ * per rule and a verdict. The minimum, maximum and mean are exact; the 
+ * percentiles are exact while the series' history still holds every sample, 
+ * and come from the histogram once it has wrapped.
  * 
- * This function checks if the given argument is a recognized flag 
- * (`--memory`, `--cpu`, `--cores`, `--samples=N`, `--tdelay=T`). If a flag is detected, 
- * it updates the corresponding field in the `argsInfo` structure.
- * 
- * @param argsInfo A pointer to the structure containing command-line arguments.
- * @param current_index A pointer to the current argument index being processed.
- * @return `true` if a valid flag is detected and processed; 
- *         `false` if the argument is invalid or missing required values.
+ * @param monitor The monitor.
+ * @return true if every rule holds.
  */
-bool isFlag(ArgsInfo *argsInfo, int *current_index)
+bool gate_evaluate(Monitor *monitor)
 {
-    if (argsInfo == NULL || strlen(argsInfo->argv[*current_index]) == 0)
+    int failed = 0;
+    for (int i = 0; i < monitor->gate_rule_count; i++)
     {
-        return false;
+        GateRule *rule = &monitor->gate_rules[i];
+        SeriesSummary summary;
+        arena_reset(&scratch_arena);
+        bool pass = false;
+        double value = 0;
+        if (summarize_run(rule->series, &rule->stats, &scratch_arena, &summary) == 0)
+        {
+            const double values[6] = {summary.min, summary.max, summary.mean, summary.p50, summary.p90, summary.p99};
+            value = values[rule->function];
+            pass = rule->op[0] == '<' ? (rule->op[1] == '=' ? value <= rule->threshold : value < rule->threshold)
+                                      : (rule->op[1] == '=' ? value >= rule->threshold : value > rule->threshold);
+        }
+        failed += !pass;
+        printf("# gate\t%s\t%s\t%.4g %s (limit %.4g %s)\n", pass ? "PASS" : "FAIL", rule->text, value, rule->series->unit,
+               rule->threshold, rule->series->unit);
     }
-    char *argv = argsInfo->argv[*current_index];
-    if (strcmp(argv, "--memory") == 0)
+    printf("# gate\t%s\t%d of %d rules failed\n", failed == 0 ? "PASS" : "FAIL", failed, monitor->gate_rule_count);
+    fflush(stdout);
+    return failed == 0;
+}
+
+/**
+ * Maps a recording (a flight recorder ring, a snapshot, a capture or a 
+ * `--record` file) read-only and works out which of its entries are held.
+ * 
+ * @param path The recording.
+ * @param view Receives the mapping.
+ * @return 0 on success, -1 if the file is not a readable recording.
+ */
+int recording_open(const char *path, RecordingView *view)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if (fd == -1 || fstat(fd, &info) == -1 || info.st_size < RECORD_HEADER_SIZE)
     {
-        argsInfo->memory_flag = true;
-        return true;
+        fprintf(stderr, "Error: cannot read recording %s\n", path);
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return -1;
     }
-    else if (strcmp(argv, "--cpu") == 0)
+    view->map_size = (size_t)info.st_size;
+    void *map = mmap(NULL, view->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
     {
-        argsInfo->cpu_flag = true;
-        return true;
+        fprintf(stderr, "Error: cannot map recording %s\n", path);
+        return -1;
     }
-    else if (strcmp(argv, "--cores") == 0)
+    view->header = (const RecordHeader *)map;
+    view->entries = (const RecordEntry *)((const unsigned char *)map + RECORD_HEADER_SIZE);
+    const RecordHeader *header = view->header;
+    uint64_t stored = (view->map_size - RECORD_HEADER_SIZE) / sizeof(RecordEntry);
+    if (memcmp(header->magic, RECORD_MAGIC, sizeof(header->magic)) != 0 || header->entry_size != sizeof(RecordEntry) ||
+        header->series_count > MAX_SERIES || (header->capacity > 0 && header->capacity > stored))
     {
-        argsInfo->cores_flag = true;
-        return true;
+        fprintf(stderr, "Error: %s is not a sysmon recording\n", path);
+        return -1;
     }
-    else if (strncmp(argv, "--samples=", 10) == 0)
+    if (header->capacity > 0)
     {
-        char *value_str = argv + 10;
-        printf("here");
-        if (value_str == NULL || *value_str == '\0')
-        {
-            fprintf(stderr, "Error: Missing value\n");
-            return false;
-        }
-
-         printf("here2");
-        if(argsInfo->updated_sample == true){
-            fprintf(stderr,"Error: cannot have multiple sample values\n");
-            return false;
-        }
-        printf("here3");
-        value_str = removeWhiteSpace(value_str);
-        char *endptr;
-        long value = strtol(value_str, &endptr, 10);
-
-        if(*endptr != '\0' || value <= 0){
-           fprintf(stderr,"Error: Invalid value for --samples\n");
-            return false;
-        }
-        else{
-            argsInfo->samples = (int)value;
-            argsInfo->updated_sample = true;
-            return true;
-        }
+        view->count = header->head < header->capacity ? header->head : header->capacity;
+        view->first = header->head - view->count;
     }
-    else if (strncmp(argv, "--tdelay=", 9) == 0)
+    else
     {
-        char *value_str = argv + 9;
-         if (value_str == NULL || *value_str == '\0')
-        {
-            fprintf(stderr, "Error: Missing value\n");
-            return false;
-        }
-
-        if(argsInfo->updated_tdelay == true){
-            fprintf(stderr,"Error: cannot have multiple tdelay values\n");
-            return false;
-        }
+        view->count = header->head < stored ? header->head : stored;
+        view->first = 0;
+    }
+    return 0;
+}
 
-        value_str = removeWhiteSpace(value_str);
-        char *endptr;
-        long value = strtol(value_str, &endptr, 10);
+/**
+ * Returns the i-th oldest entry held in a recording.
+ * 
+ * @param view The recording.
+ * @param i The position from the oldest entry.
+ * @return The entry.
+ */
+const RecordEntry *recording_entry(const RecordingView *view, uint64_t i)
+{
+    uint64_t capacity = view->header->capacity;
+    return &view->entries[capacity > 0 ? (view->first + i) % capacity : i];
+}
 
-        if (*endptr != '\0' || value <= 0)
+/**
+ * Finds the time a recording is aligned on: its first marker with the given 
+ * text, or its first sample.
+ * 
+ * @param view The recording.
+ * @param marker The marker text, or NULL to align on the start.
+ * @param start Receives the CLOCK_MONOTONIC time to align on.
+ * @return 0 on success, -1 if there is no such marker or no sample.
+ */
+int recording_align(const RecordingView *view, const char *marker, uint64_t *start)
+{
+    for (uint64_t i = 0; i < view->count; i++)
+    {
+        const RecordEntry *entry = recording_entry(view, i);
+        if (marker == NULL ? entry->kind == RECORD_SAMPLES
+                           : entry->kind == RECORD_MARKER && strncmp(entry->text, marker, sizeof(entry->text)) == 0)
         {
-           fprintf(stderr, "Error:Invalid value for tdelay\n");
-            return false;
-        }
-        else{
-            argsInfo->tdelay = value;
-            argsInfo->updated_tdelay = true;
-            return true;
+            *start = entry->t_ns;
+            return 0;
         }
     }
-    return false;
+    return -1;
 }
 
-
 /**
- * Parses and processes command-line arguments to configure program settings.
- * 
- * This function determines which flags and positional arguments are provided 
- * by the user. It ensures the correct order of arguments and applies default 
- * values when necessary.
- * 
- * Behavior:
- * - If no arguments are given, it enables memory, CPU, and core monitoring by default.
- * - If arguments are provided:
- *   - Positional arguments (samples, tdelay) must appear first.
- *   - Flag arguments (--memory, --cpu, --cores, --samples=N, --tdelay=T) follow.
- *   - Errors are triggered for unknown or misplaced arguments.
- * - If no valid flag is set, all flags (memory, CPU, cores) are enabled by default.
+ * Collects a series' samples from a recording, leaving out gaps, within a 
+ * window after the alignment time.
  * 
- * @param argc The number of command-line arguments.
- * @param argsInfo A pointer to the structure storing argument flags and values.
+ * @param view The recording.
+ * @param series The index of the series in the recording's header.
+ * @param start The alignment time.
+ * @param length The length of the window in nanoseconds.
+ * @param values Receives the samples; room for `view->count` floats.
+ * @return The number of samples.
  */
-int processCommandLineArguments(int argc, ArgsInfo* argsInfo){
-    if (argc == 1){
-        argsInfo->cores_flag = argsInfo->cpu_flag = argsInfo->memory_flag = true;
-    } else
+size_t recording_values(const RecordingView *view, int series, uint64_t start, uint64_t length, float *values)
+{
+    size_t count = 0;
+    for (uint64_t i = 0; i < view->count; i++)
     {
-        int current_index = 1;
-        if(argc >= 2 && isPositional(argsInfo,1)){
-            char *endptr;
-            long value = strtol(argsInfo->argv[1], &endptr, 10);
-            if(*endptr != '\0' || value <=0){
-                fprintf(stderr, "Error: invalid value for samples\n");
-                return -1;
-            }
-
-            argsInfo->samples = (int)value;
-            argsInfo->updated_sample = true;
-            current_index++;
-            if (argc >= 3 && isPositional(argsInfo,2)) {
-                value = strtol(argsInfo->argv[2], &endptr, 10);
-                if(*endptr != '\0' || value <=0){
-                    fprintf(stderr,"Error: invalid value for tdelay\n");
-                    return -1;
-                }
-                argsInfo->tdelay = (unsigned long)value;
-                argsInfo->updated_tdelay = true;
-                current_index++;
-            }
+        const RecordEntry *entry = recording_entry(view, i);
+        if (entry->kind != RECORD_SAMPLES || entry->t_ns < start || entry->t_ns - start > length ||
+            series < entry->first || series >= entry->first + RECORD_VALUES)
+        {
+            continue;
         }
-        for (;current_index < argc; current_index++)
+        float value = entry->values[series - entry->first];
+        if (value == value)
         {
-            if (!isFlag(argsInfo, &current_index))
-            {
-                fprintf(stderr, "Error: Unknown argument\n");
-                return -1;
-            }
+            values[count++] = value;
         }
     }
-    if(argsInfo->cores_flag == false && argsInfo->cpu_flag == false && argsInfo->memory_flag == false){
-        argsInfo->cores_flag = true;
-        argsInfo->cpu_flag = true;
-        argsInfo->memory_flag = true;
-    }
-    return 0;
+    return count;
 }
 
-
 /**
- * Draws the initial structure of the graph, including the label, unit, height, 
- * and baseline, based on available memory usage, CPU utilization, or sample count.
+ * Computes e^x without libm: x is split into k ln 2 + r with |r| <= ln 2 / 2, 
+ * e^r is summed as a Taylor series, then scaled by 2^k.
  * 
- * The function prints the graph's heading and vertical label, allowing values 
- * to be updated dynamically in real-time based on collected data. It then draws 
- * the y-axis and horizontal axis using escape codes specified in the assignment handout.
- * 
- * 
- * @param label The title of the graph.
- * @param unit The measurement unit (e.g., total memory in GB or CPU utilization in %).
- * @param height The height of the y-axis.
- * @param baseline The starting value for the y-axis (e.g., "0GB" or "0%").
- * @param current_row A pointer to the current row position in the terminal.
- * @param current_column A pointer to the current column position in the terminal.
- * @param samples The number of data points to be plotted (minimum 20 for proper scaling).
- * @return The cursor position where real-time updates should be applied.
+ * @param x The exponent.
+ * @return e^x.
+ */
+double compare_exp(double x)
+{
+    const double ln2 = 0.69314718055994530942;
+    if (x < -745)
+    {
+        return 0;
+    }
+    int k = (int)(x / ln2 + (x < 0 ? -0.5 : 0.5));
+    double r = x - k * ln2;
+    double term = 1, sum = 1;
+    for (int n = 1; n < 20; n++)
+    {
+        term *= r / n;
+        sum += term;
+    }
+    for (; k > 0; k--)
+    {
+        sum *= 2;
+    }
+    for (; k < 0; k++)
+    {
+        sum /= 2;
+    }
+    return sum;
+}
+
+/**
+ * Computes the complementary error function with the Chebyshev fit from 
+ * Numerical Recipes (relative error below 1.2e-7).
+ * 
+ * @param x The argument.
+ * @return erfc(x).
  */
-CursorPosition draw_graph(const char *label, const char *unit, int height, const char *baseline, int *current_row, int *current_column, int samples)
+double compare_erfc(double x)
 {
-    printf("\033[%d;%dH%s\n", *current_row, *current_column, label);
-    CursorPosition pos = save_position(*current_row, *current_column + strlen(label) + 1);
-
-    // Move down 1 line to print the maximum unit
-    *(current_row) += 1;
-    printf("\033[%d;%dH %s", *current_row, *current_column, unit);
+    double z = x < 0 ? -x : x;
+    double t = 1 / (1 + 0.5 * z);
+    double result = t * compare_exp(-z * z - 1.26551223 + t * (1.00002368 + t * (0.37409196 + t * (0.09678418 +
+                    t * (-0.18628806 + t * (0.27886807 + t * (-1.13520398 + t * (1.48851587 +
+                    t * (-0.82215223 + t * 0.17087277)))))))));
+    return x >= 0 ? result : 2 - result;
+}
 
-    //align the rest of the graph 8 columns after the maximum unit
-    *(current_column) += 8;
+/**
+ * Returns the nearest-rank percentile of sorted samples.
+ * 
+ * @param sorted The samples, ascending.
+ * @param count The number of samples, at least 1.
+ * @param fraction The percentile as a fraction.
+ * @return The percentile.
+ */
+double compare_percentile(const float *sorted, size_t count, double fraction)
+{
+    return sorted[(size_t)(fraction * (count - 1) + 0.5)];
+}
 
-    for (int i = 0; i < height; i++)
+/**
+ * Compares the distributions of one metric: percentiles and means, and a 
+ * Mann-Whitney U test on the two sorted samples. U is counted in one merge 
+ * pass with ties shared, and tested with the normal approximation with tie 
+ * correction.
+ * 
+ * @param base The baseline samples, ascending.
+ * @param candidate The candidate samples, ascending.
+ * @param comparison Receives the counts, percentiles, means and test result.
+ */
+void compare_metric(const float *base, const float *candidate, MetricComparison *comparison)
+{
+    const float *samples[2] = {base, candidate};
+    for (int r = 0; r < 2; r++)
     {
-        printf("\033[%d;%dH|\n", *current_row + i, *current_column);
+        size_t count = comparison->count[r];
+        double sum = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            sum += samples[r][i];
+        }
+        comparison->p50[r] = compare_percentile(samples[r], count, 0.50);
+        comparison->p90[r] = compare_percentile(samples[r], count, 0.90);
+        comparison->p99[r] = compare_percentile(samples[r], count, 0.99);
+        comparison->mean[r] = sum / count;
     }
-    *(current_row) += height;
 
-    // Print label for the baseline
-    printf("\033[%d;%dH %s", *current_row, (int)(*(current_column) - strlen(baseline) - 2), baseline);
-
-    //** */ Print horizontal axis: If samples is smaller than 20, set the default samples to 20 to create a graph
-    if (samples < 20)
+    double n1 = (double)comparison->count[0], n2 = (double)comparison->count[1];
+    double u = 0; // pairs where the candidate sample is larger, ties counting half
+    double ties = 0; // sum of t^3 - t over groups of equal values
+    size_t i = 0, j = 0;
+    while (i < comparison->count[0] || j < comparison->count[1])
     {
-        samples = 20;
+        float value = j == comparison->count[1] || (i < comparison->count[0] && base[i] < candidate[j]) ? base[i] : candidate[j];
+        size_t equal_base = 0, equal_candidate = 0;
+        while (i < comparison->count[0] && base[i] == value)
+        {
+            i++;
+            equal_base++;
+        }
+        while (j < comparison->count[1] && candidate[j] == value)
+        {
+            j++;
+            equal_candidate++;
+        }
+        // Candidates at this value beat every smaller baseline sample and tie with equal ones
+        u += equal_candidate * ((double)(i - equal_base) + equal_base / 2.0);
+        double t = (double)(equal_base + equal_candidate);
+        ties += t * t * t - t;
     }
-    for (int j = 0; j < samples + 1; j++)
+    comparison->superiority = u / (n1 * n2);
+    double n = n1 + n2;
+    double variance = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+    if (variance <= 0)
     {
-        printf("\033[%d;%dH\u2500", *(current_row), *(current_column) + j);
+        comparison->p_value = 1; // every sample is equal
+        return;
     }
-
-    printf("%s", "\n");
-    *current_row += 1;
-
-    return pos;
+    double deviation = u - n1 * n2 / 2;
+    deviation = deviation > 0 ? deviation - 0.5 : deviation < 0 ? deviation + 0.5 : 0; // continuity correction
+    double root = variance; // Newton's method for sqrt, to stay clear of libm
+    for (int step = 0; step < 64; step++)
+    {
+        root = (root + variance / root) / 2;
+    }
+    double z = deviation / root;
+    comparison->p_value = compare_erfc((z < 0 ? -z : z) / 1.41421356237309504880);
 }
 
 /**
- * Draws the memory usage graph with a fixed scale from 0 to 10.
- * 
- * This function calculates a scaling factor based on the total system memory, 
- * ensuring that each unit on the y-axis represents an appropriate memory increment. 
- * It then calls `draw_graph` to generate a memory graph with proper labeling.
+ * Returns the relative change from a baseline value, in percent.
  * 
- * @param current_row A pointer to the current row position in the terminal.
- * @param current_column A pointer to the current column position in the terminal.
- * @param scalefactor A pointer to store the scaling factor for memory increments.
- * @param samples The total number of samples to be plotted.
- * @return The cursor position after drawing the memory graph.
+ * @param base The baseline value.
+ * @param candidate The candidate value.
+ * @return The change, or 0 when both are 0.
  */
-CursorPosition draw_memory_graph(int *current_row, int *current_column, long double *scalefactor, int samples)
+double compare_delta(double base, double candidate)
 {
-    long double max_memory = get_total_memory();
-
-    int height = 10;
-    *scalefactor = max_memory / height;
-
-    char unit[20];
-    sprintf(unit, "%.Lf GB",max_memory);
-    return draw_graph("v Memory ", unit, height, "0 GB", current_row, current_column, samples);
+    if (base == 0)
+    {
+        return candidate == 0 ? 0 : candidate > 0 ? 100 : -100;
+    }
+    return (candidate - base) / (base < 0 ? -base : base) * 100;
 }
 
 /**
- * Draws the CPU utilization graph with a fixed scale from 0% to 100%.
- * 
- * This function creates a CPU usage graph with a height of 11 units, 
- * representing percentage increments. It calls `draw_graph` to generate 
- * the graph with appropriate labels.
+ * Tells whether a metric regressed: it changed significantly, upwards, and 
+ * higher is worse for it.
  * 
- * 1st unit = 0% to 9%
- * 2nd unit = 10% to 19%
- * ......(and so on)
- * 11th unit = 100%
- * 
- * @param start_row A pointer to the current row position in the terminal.
- * @param start_column A pointer to the current column position in the terminal.
- * @param samples The total number of samples to be plotted.
- * @return The cursor position after drawing the CPU graph.
+ * @param comparison The comparison.
+ * @return true for a significant regression.
  */
-CursorPosition draw_cpu_graph(int *start_row, int *start_column, int samples)
+bool compare_regressed(const MetricComparison *comparison)
 {
-    int height = 11;
-    return draw_graph("v CPU ", "100%", height, "0%", start_row, start_column, samples);
+    return !comparison->neutral && comparison->p_value < 0.05 && comparison->superiority > 0.5;
 }
 
-
 /**
- * Draws a visual representation of CPU cores in a grid format.
- * 
- * This function prints the number of available CPU cores along with their 
- * maximum frequency. It then visualizes the cores as small box-like units 
- * arranged in rows and columns.
- * 
- * The layout consists of:
- * - A heading displaying the number of cores and their frequency.
- * - A grid where each core is represented as a boxed unit.
+ * Orders comparisons for the report: significant regressions first, most 
+ * likely candidate-worse first, then the rest by the size of the median change.
  * 
- * The function dynamically adjusts the number of rows based on the total number 
- * of cores, ensuring a maximum of 4 cores per row for readability.
+ * @param a The first comparison.
+ * @param b The second comparison.
+ * @return A negative, zero or positive value as `a` ranks before, with or after `b`.
+ */
+int compare_rank(const void *a, const void *b)
+{
+    const MetricComparison *x = (const MetricComparison *)a;
+    const MetricComparison *y = (const MetricComparison *)b;
+    bool x_regressed = compare_regressed(x);
+    bool y_regressed = compare_regressed(y);
+    if (x_regressed != y_regressed)
+    {
+        return x_regressed ? -1 : 1;
+    }
+    double x_key = x_regressed ? x->superiority : compare_delta(x->p50[0], x->p50[1]);
+    double y_key = y_regressed ? y->superiority : compare_delta(y->p50[0], y->p50[1]);
+    x_key = x_key < 0 ? -x_key : x_key;
+    y_key = y_key < 0 ? -y_key : y_key;
+    return (y_key > x_key) - (y_key < x_key);
+}
+
+/**
+ * Runs `compare BASE CAND [--align=MARKER]`: compares every metric the two 
+ * recordings share and prints a table ranked by regression.
  * 
- * Structure:
- * ```
- * +───+ +───+ +───+ +───+
- * |   | |   | |   | |   |
- * +───+ +───+ +───+ +───+
- * ```
+ * Both recordings are aligned on the first occurrence of MARKER, or on their 
+ * first sample, and only the span both cover after that point is compared. 
+ * Higher values are taken to be worse for the series that measure a cost 
+ * (utilization, memory, latency, throttling, pressure). The writeback 
+ * thresholds (wb.background, wb.limit) follow reclaimable memory instead, so 
+ * their changes are reported but never counted as regressions.
  * 
- * @param coresNumber The total number of CPU cores.
- * @param currentcol A pointer to the current column position in the terminal.
- * @param currentrow A pointer to the current row position in the terminal.
- * @param frequency The maximum CPU frequency in GHz.
- * @return A `CursorPosition` struct representing the final cursor position after drawing.
+ * @param argc The number of command-line arguments.
+ * @param argv The command-line arguments; argv[1] is "compare".
+ * @return The exit status: 0, 1 on errors, or 3 if a metric regressed significantly.
  */
-CursorPosition coresGraph(int coresNumber, int *currentcol, int *currentrow, double frequency)
+int compare_main(int argc, char **argv)
 {
-    (*currentrow) += 2;
-    printf("\033[%d;%dHv Number of Cores: %d @ %.2f GHz\n", *currentrow, *currentcol, coresNumber, frequency);
-    (*currentrow)++;
-
-    char *top = "+───+";
-    char *middle = "|   |";
-
-    int cols = 4;
-    int rows = (coresNumber + cols - 1) / cols;
-    int width = 6;
-
-    for (int row = 0; row < rows; row++)
+    const char *paths[2] = {NULL, NULL};
+    const char *marker = NULL;
+    for (int i = 2; i < argc; i++)
     {
-        for (int col = 0; col < cols; col++)
+        if (strncmp(argv[i], "--align=", 8) == 0 && argv[i][8] != '\0')
         {
-            if (row * cols + col < coresNumber)
-            {
-                printf("\033[%d;%dH%s", *currentrow + row * 2, *currentcol + col * width, top);
-            }
+            marker = argv[i] + 8;
         }
-        printf("\n");
+        else if (argv[i][0] != '-' && paths[1] == NULL)
+        {
+            paths[paths[0] == NULL ? 0 : 1] = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "Error: Unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (paths[1] == NULL)
+    {
+        fprintf(stderr, "Usage: %s compare BASELINE CANDIDATE [--align=MARKER]\n", argv[0]);
+        return 1;
+    }
 
-        for (int col = 0; col < cols; col++)
+    RecordingView views[2];
+    uint64_t starts[2], ends[2];
+    for (int r = 0; r < 2; r++)
+    {
+        if (recording_open(paths[r], &views[r]) == -1)
         {
-            if (row * cols + col < coresNumber)
+            return 1;
+        }
+        if (recording_align(&views[r], marker, &starts[r]) == -1)
+        {
+            fprintf(stderr, "Error: %s has no %s%s\n", paths[r], marker != NULL ? "marker " : "samples", marker != NULL ? marker : "");
+            return 1;
+        }
+        ends[r] = starts[r];
+        for (uint64_t i = 0; i < views[r].count; i++)
+        {
+            const RecordEntry *entry = recording_entry(&views[r], i);
+            if (entry->kind == RECORD_SAMPLES && entry->t_ns > ends[r])
             {
-                printf("\033[%d;%dH%s", *currentrow + row * 2 + 1, *currentcol + col * width, middle);
+                ends[r] = entry->t_ns;
             }
         }
-        printf("\n");
+    }
+    uint64_t length = ends[0] - starts[0] < ends[1] - starts[1] ? ends[0] - starts[0] : ends[1] - starts[1];
 
-        for (int col = 0; col < cols; col++)
+    MetricComparison comparisons[MAX_SERIES];
+    int compared = 0;
+    const RecordHeader *base = views[0].header;
+    const RecordHeader *candidate = views[1].header;
+    // One pair of buffers, refilled for each metric
+    float *values[2] = {(float *)arena_alloc(&run_arena, views[0].count * sizeof(float)),
+                        (float *)arena_alloc(&run_arena, views[1].count * sizeof(float))};
+    if (values[0] == NULL || values[1] == NULL)
+    {
+        fprintf(stderr, "Error: recordings too large to compare\n");
+        return 1;
+    }
+    for (int s = 0; s < (int)base->series_count; s++)
+    {
+        int c = 0;
+        while (c < (int)candidate->series_count && strncmp(candidate->names[c], base->names[s], RECORD_NAME_SIZE) != 0)
         {
-            if (row * cols + col < coresNumber)
-            {
-                printf("\033[%d;%dH%s", *currentrow + row * 2 + 2, *currentcol + col * width, top);
-            }
+            c++;
         }
+        if (c == (int)candidate->series_count)
+        {
+            continue;
+        }
+        MetricComparison *comparison = &comparisons[compared];
+        comparison->name = base->names[s];
+        comparison->unit = base->units[s];
+        comparison->neutral = strcmp(comparison->name, "wb.background") == 0 || strcmp(comparison->name, "wb.limit") == 0;
+        comparison->count[0] = recording_values(&views[0], s, starts[0], length, values[0]);
+        comparison->count[1] = recording_values(&views[1], c, starts[1], length, values[1]);
+        if (comparison->count[0] == 0 || comparison->count[1] == 0)
+        {
+            continue;
+        }
+        qsort(values[0], comparison->count[0], sizeof(float), compare_floats);
+        qsort(values[1], comparison->count[1], sizeof(float), compare_floats);
+        compare_metric(values[0], values[1], comparison);
+        compared++;
+    }
+    if (compared == 0)
+    {
+        fprintf(stderr, "Error: the recordings share no metric with samples in the compared span\n");
+        return 1;
+    }
+    qsort(comparisons, compared, sizeof(MetricComparison), compare_rank);
 
-        (*currentrow)++;
-        printf("\n");
+    printf("Baseline  %s\nCandidate %s\n", paths[0], paths[1]);
+    printf("Aligned on %s, comparing %.1f s of each\n\n", marker != NULL ? marker : "the first sample", length / 1e9);
+    printf("%-22s %-5s %7s %7s  %10s %10s %8s  %8s %8s  %7s %9s  %s\n", "metric", "unit", "n base", "n cand",
+           "p50 base", "p50 cand", "p50", "p90", "p99", "P(c>b)", "p-value", "verdict");
+    int regressions = 0;
+    for (int i = 0; i < compared; i++)
+    {
+        const MetricComparison *comparison = &comparisons[i];
+        bool significant = comparison->p_value < 0.05;
+        const char *verdict = !significant ? "~" : comparison->neutral ? "changed" : comparison->superiority > 0.5 ? "REGRESSION" : "improvement";
+        regressions += compare_regressed(comparison);
+        printf("%-22.22s %-5.5s %7zu %7zu  %10.2f %10.2f %+7.1f%%  %+7.1f%% %+7.1f%%  %7.3f %9.2g  %s\n", comparison->name,
+               comparison->unit, comparison->count[0], comparison->count[1], comparison->p50[0], comparison->p50[1],
+               compare_delta(comparison->p50[0], comparison->p50[1]), compare_delta(comparison->p90[0], comparison->p90[1]),
+               compare_delta(comparison->p99[0], comparison->p99[1]), comparison->superiority, comparison->p_value, verdict);
     }
-    (*currentrow) += rows * 2 + 2;
-    CursorPosition pos = save_position(*currentrow, 1);
-    return pos;
+    printf("\n%d of %d metrics regressed significantly (Mann-Whitney U, p < 0.05)\n", regressions, compared);
+    return regressions > 0 ? 3 : 0;
 }
 
-
 /**
  * Main point of the system monitoring program.
  * 
@@ -702,124 +8754,345 @@ CursorPosition coresGraph(int coresNumber, int *currentcol, int *currentrow, dou
  * 2. Initialize the display and draw graphs based on user flags.
  * 3. Continuously collect and update memory/CPU utilization data.
  * 4. If enabled, display CPU core information at the end.
- * 5. Restore the terminal cursor and free allocated memory.
+ * 5. Restore the terminal cursor. Arena memory is returned to the system on exit.
  * 
  * Command-line Arguments:
  * - Positional Arguments:
  *   - `[samples]`  → Number of data samples to collect (default: 20).
  *   - `[tdelay]`   → Delay in microseconds between samples (default: 500,000).
- * - Flags:         
+ * - Flags (collector and renderer flags exist only when compiled in):
  *   - `--memory`   → Display memory usage graph.
  *   - `--cpu`      → Display CPU utilization graph.
  *   - `--cores`    → Display the number of CPU cores and their max frequency.
+ *   - `--headless` → Print one tab-separated line per sample instead of graphs.
+ *   - `--procs`    → Display the top processes by CPU.
+ *   - `--group=user|cgroup` → Aggregate the process table by user or cgroup.
+ *   - `--sort=cpu|rss|io` → Rank processes or groups by CPU, resident memory or storage I/O.
+ *   - `--top=N`    → Number of process table rows (default 10).
+ *   - `--pid=A,B,C` → Overlay the CPU and memory of each pid or process name 
+ *                     pattern (e.g. `nginx*`) on the graphs.
+ *   - `--cgroups`  → Display the cgroup tree with CPU, memory, I/O and pressure.
+ *   - `--cgroup-depth=N` → Expand the cgroup tree N levels deep (default 2).
+ *   - `--throttle` → Graph the share of CPU quota periods that were throttled.
+ *   - `--memory-events` → Track cgroup memory events (high, max, OOM kills).
+ *   - `--cgroup=PATH,...` → Cgroups watched by `--throttle` and 
+ *                           `--memory-events` (default: our own).
+ *   - `--writeback` → Graph dirty and writeback memory against the dirty 
+ *                     thresholds, with page dirtying and writeback rates.
+ *   - `--cstates`  → Display per-core time in each idle state and P-state.
+ *   - `--disks[=NAME,...]` → Graph block device latency and list request 
+ *                            rates, throughput, queue depth and utilization.
+ *   - `--overview` → Once a graph is full, draw its whole history downsampled 
+ *                    to the graph's width instead of scrolling.
+ *   - `--flight=FILE[,MINUTES]` → Keep the last MINUTES (default 10) of 
+ *                    samples in a ring in FILE; SIGUSR1 writes a snapshot 
+ *                    of it to FILE.<date>-<time>.
+ *   - `--markers=PATH` → Create a FIFO at PATH; each line written to it is a 
+ *                    marker drawn across the graphs and kept in recordings.
+ *   - `--record=FILE` → Record every sample (and marker) to FILE.
+ *   - `--control=PATH` → Accept commands on a Unix socket at PATH: `rate US`, 
+ *                    `enable NAME`, `disable NAME`, `record start FILE`, 
+ *                    `record stop`, `marker TEXT` and `stats`, applied at 
+ *                    the next tick.
+ *   - `--web=ADDRESS:PORT` → Serve a dashboard page at ADDRESS:PORT that 
+ *                    streams every sample over Server-Sent Events.
+ *   - `--export-trace=FILE` → Stream every sample, per-core utilization and 
+ *                    the events to FILE as Chrome trace counters, to view 
+ *                    next to an application's own trace.
+ *   - `--gate=RULES|@FILE` → Run headless and check rules such as 
+ *                    `p99(cpu) < 70,max(mem.used) < 12GiB` (min, max, mean, 
+ *                    p50, p90, p99) at the end; exit 3 if any fails.
+ *   - `--trigger=METRIC>N` → Sample METRIC (cpu, psi.cpu, psi.memory or 
+ *                    psi.io, in %) between ticks and capture the samples 
+ *                    around the moment it goes above (or with `<`, below) N.
+ *   - `--capture=PRE:POST[,PREFIX]` → Milliseconds kept before and after a 
+ *                    trigger (default 2000:2000), written to PREFIX.<date>-<time>-<n>.
+ *   - `--capture-rate=US` → Microseconds between sub-samples (default 10000).
+ *   - `--max-rss=SIZE` → Size every buffer to keep the monitor under SIZE 
+ *                        (e.g. 64M), refuse to start if it cannot fit, and 
+ *                        report actual versus budgeted memory on exit.
  *   - `--samples=N` → Specify number of samples.
  *   - `--tdelay=T`  → Specify time delay between samples.
+ *   - `--trace=FILE` → Write a Chrome trace of every tick stage to FILE and 
+ *                      print the tick latency histogram on exit.
+ * 
+ * Wrapper mode:
+ *   - `sysmon [flags] -- command args` → Run the command, track its whole 
+ *     process tree over the system graphs until it exits, then print a 
+ *     resource summary and exit with the command's exit code.
+ * 
+ * Compare mode:
+ *   - `sysmon compare BASE CAND [--align=MARKER]` → Compare two recordings 
+ *     metric by metric and print a table ranked by regression; exits 3 if 
+ *     any metric regressed significantly.
  * 
  * @param argc The number of command-line arguments.
  * @param argv The array of command-line argument strings.
- * @return Returns 0 upon successful execution.
+ * @return Returns 0 upon successful execution, or the wrapped command's exit code.
  */
 int main(int argc, char **argv)
 {
-    ArgsInfo * argsInfo = initializeArgument(argc,argv);
+    uint64_t startup_start = monotonic_ns();
+    if (arena_init(&run_arena, RUN_ARENA_SIZE) == -1)
+    {
+        fprintf(stderr, "Error: cannot reserve memory arenas\n");
+        exit(1);
+    }
+    if (argc >= 2 && strcmp(argv[1], "compare") == 0)
+    {
+        return compare_main(argc, argv);
+    }
+
+    ArgsInfo * argsInfo = initializeArgument(&run_arena, argc, argv);
 
     if(argsInfo == NULL){
         fprintf(stderr,"Error: failed to initialize arguments");
+        exit(1);
     }
 
     if(processCommandLineArguments(argc, argsInfo) == -1){
-        free(argsInfo);
         exit(1);
     }
 
-    CursorPosition memory;
-    CursorPosition memory_heading;
-    CursorPosition cpu;
-    CursorPosition cpu_heading;
-    CursorPosition ending_position;
-   
-    printf("\033c");  // Resets screen
-    printf("\033[H"); // position cursor at the top left corner
-    // printf("new run");
-    fflush(stdout);
-
-    double seconds = argsInfo->tdelay / 1000000.0;
-    printf("Nbr of samples: %d -- every %lu microSecs (%f secs)", argsInfo->samples, argsInfo->tdelay, seconds);
-    fflush(stdout);
-
-    int current_column = 1;
-    int current_row = 1;
-    long double scaling_factor = 0.0;
-
-    if (argsInfo->memory_flag)
+    MemoryPlan plan;
+    if (plan_memory(argsInfo, &plan) == -1)
     {
-        current_row += 1;
-        memory_heading = draw_memory_graph(&current_row, &current_column, &scaling_factor, argsInfo->samples);
-        memory = save_position(current_row - 1, current_column + 1);
+        exit(1);
+    }
+    // From here on the run arena cannot hand out more than the plan allows
+    run_arena.size = run_arena.used + plan.run_size;
+    if (arena_init(&scratch_arena, plan.scratch_size) == -1)
+    {
+        fprintf(stderr, "Error: cannot reserve memory arenas\n");
+        exit(1);
+    }
+    // Give stdout its buffer before the first printf, otherwise stdio mallocs one
+    char *output_buffer = (char *)arena_alloc(&run_arena, plan.output_size);
+    Monitor *monitor = (Monitor *)arena_alloc(&run_arena, sizeof(Monitor));
+    if (output_buffer == NULL || monitor == NULL || trace_init(&run_arena, plan.trace_capacity) == -1)
+    {
+        fprintf(stderr, "Error:Memory allocation\n");
+        exit(1);
     }
+    setvbuf(stdout, output_buffer, _IOFBF, plan.output_size);
+    monitor->args = argsInfo;
+    monitor->plan = plan;
+    monitor->history_capacity = plan.history_capacity;
+    monitor->start_ns = startup_start;
+    getrlimit(RLIMIT_NOFILE, &monitor->fd_limit);
+    plan_descriptors(argsInfo, &monitor->plan);
 
-    if (argsInfo->cpu_flag)
+    for (int c = 0; c < COLLECTOR_COUNT; c++)
     {
-        const int NUM_NEW_LINES = 2;
-        change_line(NUM_NEW_LINES);
-        current_row += NUM_NEW_LINES;
-        current_column = 1;
+        if (*collector_flag(argsInfo, &collectors[c]) && collector_setup(monitor, c) == -1)
+        {
+            exit(1);
+        }
+    }
 
-        cpu_heading = draw_cpu_graph(&current_row, &current_column, argsInfo->samples);
-        cpu = save_position(current_row - 1, current_column + 1);
+    monitor->markers.fd = -1;
+    monitor->recording.fd = -1;
+    monitor->control.fd = -1;
+    if (argsInfo->record_file != NULL && record_start(monitor, argsInfo->record_file) == -1)
+    {
+        exit(1);
+    }
+    if (argsInfo->control_path != NULL && control_setup(monitor) == -1)
+    {
+        exit(1);
+    }
+    monitor->web.fd = -1;
+    if (argsInfo->web_address != NULL && web_setup(monitor) == -1)
+    {
+        exit(1);
+    }
+    monitor->export.fd = -1;
+    if (argsInfo->export_trace_file != NULL && export_setup(monitor) == -1)
+    {
+        exit(1);
+    }
+    if (argsInfo->markers_path != NULL && markers_setup(monitor) == -1)
+    {
+        exit(1);
+    }
+    if (argsInfo->trigger_metric != -1 && capture_setup(monitor) == -1)
+    {
+        exit(1);
+    }
+    if (argsInfo->flight_file != NULL)
+    {
+        if (flight_open(monitor) == -1)
+        {
+            exit(1);
+        }
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = on_snapshot_signal;
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGUSR1, &action, NULL);
     }
 
-    ending_position = save_position(current_row, current_column);
+    if (argsInfo->gate_rules != NULL && gate_setup(monitor) == -1)
+    {
+        exit(1);
+    }
+    const Renderer *renderer = &renderers[argsInfo->renderer];
+    if (renderer->redraw != NULL && output_setup(monitor, plan.output_size) == -1)
+    {
+        exit(1);
+    }
+    renderer->begin(monitor);
+#if SYSMON_WITH_PROCS
+    if (argsInfo->command != NULL && launch_command(monitor) == -1)
+    {
+        exit(1);
+    }
+#endif
 
-    long double preTotalCPU = 0;
-    long double preIdleCPU = 0;
-    long double finalTotalCPU = 0;
-    long double finalIdleCPU = 0;
-    double max_frequency = 0.0;
+    uint64_t stage_start = monotonic_ns();
+    for (int i = 0; argsInfo->command != NULL ? !monitor->command.done : i < argsInfo->samples; i++)
+    {
+        uint64_t tick_start = stage_start;
+        arena_reset(&scratch_arena);
+        monitor->tick = i;
+        if (monitor->control.fd != -1)
+        {
+            control_poll(monitor, renderer);
+            stage_start = trace_stage("control", stage_start, i);
+        }
 
+        for (int c = 0; c < COLLECTOR_COUNT; c++)
+        {
+            if (*collector_flag(argsInfo, &collectors[c]) && collectors[c].sample != NULL)
+            {
+                collectors[c].sample(monitor);
+                stage_start = trace_stage(collectors[c].name, stage_start, i);
+            }
+        }
 
-    calculate_cpu_utilization(&preTotalCPU, &preIdleCPU, &finalTotalCPU, &finalIdleCPU);
-    for (int i = 0; i < argsInfo->samples; i++)
-    {
-        if (argsInfo->memory_flag)
+        // Paused collectors leave gaps in their series
+        for (int c = 0; c < COLLECTOR_COUNT; c++)
+        {
+            CollectorState *state = &monitor->collector_states[c];
+            for (int s = 0; state->set_up && !*collector_flag(argsInfo, &collectors[c]) && s < state->series_count; s++)
+            {
+                monitor->series[state->first_series + s].value = __builtin_nan("");
+            }
+        }
+        for (int s = 0; s < monitor->series_count; s++)
+        {
+            series_push(&monitor->series[s]);
+        }
+        if (monitor->gate_rule_count > 0)
         {
-            long double memory_used = calculate_memory_used();
+            gate_tick(monitor);
+        }
+        stage_start = trace_stage("aggregate", stage_start, i);
 
-            printf("\033[%d;%dH       ", memory_heading.row, memory_heading.col); 
-            fflush(stdout);
-            
-            char *unit = "GB";
-            printf("\033[%d;%dH %.2Lf %s", memory_heading.row, memory_heading.col, memory_used,unit);
-            fflush(stdout);
-            
-            printf("\033[%d;%dH#", memory.row - (int)(memory_used / scaling_factor) - 1, memory.col++);
-            fflush(stdout);
+        if (monitor->flight.header != NULL)
+        {
+            flight_record(monitor);
+            flight_reap(monitor);
+            if (snapshot_requested)
+            {
+                snapshot_requested = 0;
+                flight_snapshot(monitor);
+            }
+            stage_start = trace_stage("record", stage_start, i);
         }
-        if (argsInfo->cpu_flag)
+        if (monitor->recording.fd != -1)
         {
-            long double cpu_utilization = calculate_cpu_utilization(&preTotalCPU, &preIdleCPU, &finalTotalCPU, &finalIdleCPU);
+            record_tick(monitor);
+            stage_start = trace_stage("record", stage_start, i);
+        }
 
-            printf("\033[%d;%dH %.2Lf %%          ", cpu_heading.row, cpu_heading.col, cpu_utilization);
-            fflush(stdout);
+        if (monitor->web.fd != -1)
+        {
+            web_tick(monitor);
+            stage_start = trace_stage("web", stage_start, i);
+        }
+        if (monitor->export.fd != -1)
+        {
+            export_tick(monitor);
+            stage_start = trace_stage("export", stage_start, i);
+        }
+        output_catch_up(monitor, renderer);
+        renderer->frame(monitor);
+        stage_start = trace_stage("render", stage_start, i);
 
+        output_flush(monitor);
+        stage_start = trace_stage("flush", stage_start, i);
+        trace_tick(tick_start, stage_start, argsInfo->tdelay);
+        if (i == 0)
+        {
+            trace_startup(startup_start, stage_start);
+        }
+        ALLOC_CHECK_ARM(true); // everything after the first tick must be allocation-free
+#if SYSMON_WITH_PROCS
+        if (argsInfo->command != NULL)
+        {
+            reap_command(monitor);
+        }
+#endif
 
-            printf("\033[%d;%dH:",cpu.row - (int)(cpu_utilization / 10) - 1, cpu.col++);
-            fflush(stdout);
+        if (argsInfo->trigger_metric != -1)
+        {
+            capture_sleep(monitor, argsInfo->tdelay);
+        }
+        else if (argsInfo->markers_path != NULL)
+        {
+            markers_sleep(monitor, argsInfo->tdelay);
+        }
+        else
+        {
+            usleep(argsInfo->tdelay);
         }
-        usleep(argsInfo->tdelay);
+        stage_start = trace_stage("wakeup", stage_start, i);
     }
+    ALLOC_CHECK_ARM(false);
 
-    ending_position = save_position(current_row, 1);
- 
-    if (argsInfo->cores_flag)
+    if (monitor->capture.capturing) // cut short by the end of the run
+    {
+        capture_write(monitor);
+        monitor->capture.captures++;
+    }
+    record_stop(monitor);
+    export_finish(monitor);
+    output_finish(monitor, renderer);
+    for (int c = 0; c < COLLECTOR_COUNT; c++)
     {
-        max_frequency = calculate_max_frequency();
-        current_column = 1;
-        current_row += 1;
-        ending_position = coresGraph(calculate_cores(), &current_column, &current_row, max_frequency);
+        if (monitor->collector_states[c].set_up && collectors[c].finish != NULL)
+        {
+            collectors[c].finish(monitor);
+        }
     }
+    renderer->end(monitor);
+    fflush(stdout);
 
-    printf("\033[%d;%dH", ending_position.row, ending_position.col);
-    free(argsInfo);
-    return 0;
+    if (argsInfo->trace_file != NULL)
+    {
+        export_chrome_trace(argsInfo->trace_file);
+        print_tick_histogram(argsInfo->tdelay);
+    }
+    if (argsInfo->max_rss > 0)
+    {
+        print_self_stats(&monitor->plan);
+    }
+    bool gate_passed = argsInfo->gate_rules == NULL || gate_evaluate(monitor);
+#if SYSMON_WITH_PROCS
+    for (int t = argsInfo->command != NULL ? 1 : 0; t < monitor->target_count; t++)
+    {
+        Target *target = &monitor->targets[t];
+        fprintf(stderr, "Target %s: %d processes now, peak RSS %.1f MiB (sampled)\n",
+                target->name, target->processes, target->peak_rss / 1048576.0);
+        print_target_summary(target);
+    }
+    if (argsInfo->command != NULL)
+    {
+        print_command_summary(monitor);
+        int status = command_exit_code(monitor);
+        return status != 0 || gate_passed ? status : 3; // the command's own failure comes first
+    }
+#endif
+    return gate_passed ? 0 : 3;
 }
\ No newline at end of file